@@ -0,0 +1,72 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed asset bundle (written by tools/mkbundle, served with --bundle).
+// One file, host byte order:
+//   bundle_header_t
+//   bundle_entry_t[count], sorted by URL path (bytewise)
+//   data: URL paths, header field blocks, bodies
+// A header field block is complete "Name: value\r\n" lines (Content-Type,
+// Content-Length, ETag, ...) ready to follow the status and Date lines.
+#define BUNDLE_MAGIC "HTBUNDL1"
+#define BUNDLE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t table_off;
+    uint64_t size;           // total file size
+} bundle_header_t;
+
+typedef struct {
+    uint64_t path_off;       // URL path, e.g. "/css/site.css" or "/docs/"
+    uint32_t path_len;
+    uint32_t flags;          // reserved
+    uint64_t fields_off;
+    uint64_t fields_len;
+    uint64_t body_off;
+    uint64_t body_len;
+    uint64_t gz_fields_off;  // gzip variant; gz_fields_len 0 = none
+    uint64_t gz_fields_len;
+    uint64_t gz_body_off;
+    uint64_t gz_body_len;
+} bundle_entry_t;
+
+// A bundle opened for serving: one read-only mapping shared by all
+// connections, reference counted so it can be swapped while responses
+// are in flight. Event loop thread only.
+typedef struct bundle bundle_t;
+
+// One response variant; pointers are into the mapping.
+typedef struct {
+    const char *fields;
+    size_t fields_len;
+    const char *body;
+    size_t body_len;
+} bundle_file_t;
+
+// Map and validate path. Returns a bundle holding one reference, or NULL
+// if it cannot be read or is not a valid bundle.
+bundle_t *bundle_open(const char *path);
+
+void bundle_ref(bundle_t *b);
+
+// Drop a reference; the mapping goes away with the last one.
+void bundle_unref(bundle_t *b);
+
+// Look up a URL path (length len, no query). gzip: client accepts a gzip
+// variant. Returns 0 and fills out on a hit, -1 if not in the bundle.
+int bundle_find(const bundle_t *b, const char *url, size_t len, int gzip, bundle_file_t *out);
+
+// 1 if the file at the bundle's path is no longer the one mapped
+// (replaced by a deploy), else 0.
+int bundle_replaced(const bundle_t *b);
+
+size_t bundle_count(const bundle_t *b);
+const char *bundle_path(const bundle_t *b);
+
+#endif
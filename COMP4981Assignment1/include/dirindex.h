@@ -0,0 +1,64 @@
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Rendered directory listings (HTML or JSON), cached per URL and format
+// and re-rendered when the directory's mtime/inode changes.
+// Event loop thread only, except the dir_entries_* functions.
+typedef struct dir_index dir_index_t;
+typedef struct dir_listing dir_listing_t;
+
+// A directory's entries (hidden names skipped, symlinks followed), read
+// ahead of rendering so the blocking readdir/stat can run on a worker.
+typedef struct dir_entries dir_entries_t;
+
+// Read the entries of the directory open as dir_fd (never closed here).
+// Returns NULL on failure. Safe on any thread.
+dir_entries_t *dir_entries_read(int dir_fd);
+
+// Independent copy of e, or NULL on allocation failure.
+dir_entries_t *dir_entries_copy(const dir_entries_t *e);
+
+// NULL-safe.
+void dir_entries_free(dir_entries_t *e);
+
+// budget: total bytes of rendered listings kept (0 = render every time).
+// Returns NULL on allocation failure.
+dir_index_t *dir_index_create(size_t budget);
+
+// Change the budget; idle listings over it are dropped now.
+void dir_index_set_budget(dir_index_t *di, size_t budget);
+
+// Must only be called once every acquired listing has been released.
+void dir_index_destroy(dir_index_t *di);
+
+// Listing of the directory dir_path, open as dir_fd (metadata st), reached
+// via the decoded, normalized URL path url_dir (ends with '/'; the cache
+// key, and used for links and the title).
+// entries, when not NULL, were read from it already and are taken over;
+// otherwise they are read here if the listing must be rendered.
+// dir_fd is never closed here. Returns a referenced listing, NULL on failure.
+dir_listing_t *dir_index_acquire(dir_index_t *di,
+                                 const char *url_dir,
+                                 const char *dir_path,
+                                 const struct stat *st,
+                                 int dir_fd,
+                                 dir_entries_t *entries,
+                                 int json);
+
+// Forget listings made stale by a change to path: its own listing, its
+// parent's, and with is_dir every listing below it.
+void dir_index_invalidate(dir_index_t *di, const char *path, int is_dir);
+
+// Forget every listing.
+void dir_index_clear(dir_index_t *di);
+
+// Drop a reference taken by dir_index_acquire.
+void dir_index_release(dir_index_t *di, dir_listing_t *l);
+
+const char *dir_listing_data(const dir_listing_t *l);
+size_t dir_listing_size(const dir_listing_t *l);
+
+#endif
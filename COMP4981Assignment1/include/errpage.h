@@ -0,0 +1,27 @@
+#ifndef ERRPAGE_H
+#define ERRPAGE_H
+
+#include <stddef.h>
+
+// Prebuilt error responses of a site. Bodies are immutable and shared by
+// all connections; each response takes its own copy of the header part,
+// whose Date is kept current (rewritten at most once per second).
+// Event loop thread only.
+typedef struct error_pages error_pages_t;
+
+// Build responses for every error status. A file named "<status>.html"
+// in doc_root (e.g. 404.html) replaces the generated body; it is read
+// once here. The 503 response carries "Retry-After: <retry_after>".
+// Returns NULL on failure.
+error_pages_t *error_pages_create(const char *doc_root, int retry_after);
+
+void error_pages_destroy(error_pages_t *ep);
+
+// Response for status (unknown statuses map to 500): copies its header
+// part into hdr (cap bytes) and points *body at the shared body, valid
+// until error_pages_destroy (*body_len is 0 for HEAD).
+// Returns the header length, or -1 if it does not fit.
+int error_page_get(error_pages_t *ep, int status, int is_head, char *hdr, size_t cap, const char **body,
+                   size_t *body_len);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Store of small files read into private memory, shared by all
+// connections. Contents are copies, so a file truncated or rewritten in
+// place never faults a sender (as a MAP_SHARED mapping would).
+// Only used from the event loop thread.
+typedef struct file_cache file_cache_t;
+typedef struct fc_entry fc_entry_t;
+
+// budget: total bytes of copies kept; max_file: largest file worth copying.
+// Returns NULL on allocation failure.
+file_cache_t *file_cache_create(size_t budget, size_t max_file);
+
+// Change limits; idle copies over the new budget are dropped now.
+void file_cache_set_limits(file_cache_t *fc, size_t budget, size_t max_file);
+
+// Must only be called once every acquired entry has been released.
+void file_cache_destroy(file_cache_t *fc);
+
+// Look up the copy of path, whose current metadata is st and open fd is fd.
+// Files are loaded once they are requested repeatedly; changed files
+// (mtime/size/inode) are loaded again. Returns a referenced entry, or NULL if
+// the file should be streamed normally. fd is never closed here.
+fc_entry_t *file_cache_acquire(file_cache_t *fc, const char *path, const struct stat *st, int fd);
+
+// Existing copy of path taken at version st, without touching the file
+// (callers that learn about changes some other way, e.g. fs_watch).
+// Returns a referenced entry, or NULL if path is not loaded at that version.
+fc_entry_t *file_cache_acquire_loaded(file_cache_t *fc, const char *path, const struct stat *st);
+
+// Read the st_size bytes of regular file fd into a buffer for the store
+// (file_cache_adopt) or NULL if the file is now shorter or on failure.
+// Release with free().
+void *file_cache_load(int fd, const struct stat *st);
+
+// Take over data (from file_cache_load) of path as an already hot entry,
+// e.g. preloaded at startup. Returns 0 if taken; on -1 (no room, already
+// present, or allocation failure) the caller frees it.
+int file_cache_adopt(file_cache_t *fc, const char *path, const struct stat *st, void *data);
+
+// Forget path (with is_dir, everything below it too) after it changed.
+// In-flight senders keep their copy until released.
+void file_cache_invalidate(file_cache_t *fc, const char *path, int is_dir);
+
+// Forget everything.
+void file_cache_clear(file_cache_t *fc);
+
+// Drop a reference taken by file_cache_acquire or file_cache_acquire_loaded.
+void file_cache_release(file_cache_t *fc, fc_entry_t *e);
+
+const void *fc_entry_data(const fc_entry_t *e);
+size_t fc_entry_size(const fc_entry_t *e);
+
+#endif
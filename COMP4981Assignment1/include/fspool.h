@@ -0,0 +1,83 @@
+#ifndef FSPOOL_H
+#define FSPOOL_H
+
+#include "dirindex.h"
+#include "pathindex.h"
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+// Result of resolving a URL target and opening the file behind it.
+typedef struct {
+    int status;              // 0 on success, otherwise HTTP error status
+    int fd;                  // Open file when requested, -1 otherwise
+    struct stat st;          // Metadata of the resolved file
+    char path[PATH_MAX];     // doc root + normalized URL path; canonical via symlinks
+    dir_entries_t *entries;  // Directory entries with FS_READ_DIR, else NULL
+} fs_result_t;
+
+// fs_lookup flags.
+#define FS_WANT_FD 1         // open the file (GET); otherwise stat only
+#define FS_ALLOW_DIR 2       // directories resolve (and are always opened)
+#define FS_READ_DIR 4        // with FS_ALLOW_DIR: also read a directory's entries
+
+// Resolve url_target under doc_root, stat it, and open it per flags.
+// root_fd is doc_root's descriptor from path_root_open (-1: none).
+// This is the blocking part of request handling. The caller owns out->fd
+// and out->entries (free with dir_entries_free).
+void fs_lookup(const char *doc_root, int root_fd, const char *url_target, int flags, fs_result_t *out);
+
+// Worker pool running fs_lookup off the event loop.
+typedef struct fs_pool fs_pool_t;
+
+// Start nthreads workers. Returns NULL on failure.
+fs_pool_t *fs_pool_create(int nthreads);
+
+// Readable fd that becomes POLLIN when completions are waiting.
+int fs_pool_notify_fd(const fs_pool_t *pool);
+
+// Queue a lookup. tag/gen are handed back with the completion.
+// doc_root and root_fd must stay valid until the completion is collected.
+// paths, when not NULL, is doc_root's path index (kept equally long): a
+// GET it knows skips resolution and only opens the remembered file.
+// A lookup of the same normalized path with the same doc_root and flags
+// that is still queued or running is joined instead of repeated: every
+// submitter gets a completion, each with its own fd (a duplicate, so
+// read files with pread, and its own copy of the entries).
+// Returns 0 on success, -1 on failure.
+int fs_pool_submit(fs_pool_t *pool,
+                   int tag,
+                   unsigned gen,
+                   const char *doc_root,
+                   int root_fd,
+                   const path_index_t *paths,
+                   const char *url_target,
+                   int flags);
+
+// Make lookups submitted from now on start afresh instead of joining one
+// already queued or running (call when the filesystem may have changed).
+void fs_pool_end_flights(fs_pool_t *pool);
+
+// Lookups queued and not yet picked up by a worker.
+size_t fs_pool_queued(fs_pool_t *pool);
+
+// Lookups handed to a worker so far, and submits that joined one of them
+// instead (both 0 for a NULL pool).
+void fs_pool_counts(fs_pool_t *pool, unsigned long *run, unsigned long *joined);
+
+// Drain the notify fd. Call when it polls readable.
+void fs_pool_ack(fs_pool_t *pool);
+
+// Pop one finished lookup (one per submitter).
+// Returns 1 if a completion was stored in tag/gen/out, 0 if none left.
+int fs_pool_next_done(fs_pool_t *pool, int *tag, unsigned *gen, fs_result_t *out);
+
+// Stop workers and release queued jobs (closing any opened fds).
+void fs_pool_destroy(fs_pool_t *pool);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef FSWATCH_H
+#define FSWATCH_H
+
+#include <stddef.h>
+
+// Recursive change watcher over directory trees (inotify on Linux).
+// Event loop thread only.
+typedef struct fs_watch fs_watch_t;
+
+// Called for each changed path. is_dir: the path is (or was) a directory,
+// so everything below it is affected too. path NULL: events were lost,
+// drop everything.
+typedef void (*fs_watch_cb)(const char *path, int is_dir, void *arg);
+
+// Returns NULL where unsupported or on failure.
+fs_watch_t *fs_watch_create(void);
+
+void fs_watch_destroy(fs_watch_t *w);
+
+// Watch root and every directory below it. Returns 0, or -1 if any
+// directory could not be watched (e.g. the inotify watch limit).
+int fs_watch_add_tree(fs_watch_t *w, const char *root);
+
+// Readable fd that becomes POLLIN when events are waiting.
+int fs_watch_fd(const fs_watch_t *w);
+
+// Read pending events and report them through cb.
+void fs_watch_dispatch(fs_watch_t *w, fs_watch_cb cb, void *arg);
+
+// 0 while every directory is watched; -1 once coverage was lost
+// (watch limit hit or queue overflow before recovery).
+int fs_watch_healthy(const fs_watch_t *w);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef H2_H
+#define H2_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// HTTP/2 (RFC 9113) framing and stream state for one connection. It
+// turns each request into an HTTP/1.1-style head the server already
+// understands, and the server's HTTP/1.1-style response head back into
+// HPACK-compressed HEADERS; bodies are pulled as DATA frames within the
+// peer's flow-control windows, interleaved across streams.
+// Event loop thread only.
+typedef struct h2_conn h2_conn_t;
+
+// Length of the client connection preface "PRI * HTTP/2.0...".
+#define H2_PREFACE_LEN 24
+
+// Largest DATA frame payload sent (the minimum every peer accepts).
+#define H2_FRAME_MAX 16384
+
+// How the connection reads a response body owned by the server.
+typedef struct {
+    // Copy up to cap body bytes into dst. Returns bytes (> 0) or -1.
+    ssize_t (*read)(void *resp, void *dst, size_t cap);
+    // The stream is over (fully sent, reset or connection closed).
+    void (*close)(void *resp);
+} h2_body_ops_t;
+
+// 1 if the len bytes at buf match the start of the connection preface.
+int h2_is_preface(const void *buf, size_t len);
+
+// New server-side connection allowing max_streams concurrent requests.
+// Our SETTINGS are queued for output right away. NULL on failure.
+h2_conn_t *h2_conn_create(const h2_body_ops_t *ops, int max_streams);
+
+// Closes every response still held.
+void h2_conn_destroy(h2_conn_t *h);
+
+// Process received bytes (the preface first). On a connection error a
+// GOAWAY is queued and further input is ignored; see h2_finished.
+void h2_feed(h2_conn_t *h, const void *data, size_t len);
+
+// Next request whose headers are complete, oldest first: returns its
+// stream id (0: none) and its head ("GET /p HTTP/1.1\r\nhost: h\r\n...
+// \r\n"), valid until h2_respond or h2_reset for that id.
+uint32_t h2_next_request(h2_conn_t *h, const char **head, size_t *len);
+
+// Answer stream id with an HTTP/1.1-style response head; body_len body
+// bytes follow through ops->read(resp). The connection owns resp from
+// here on, even on failure. Returns 0, or -1 if the stream was reset.
+int h2_respond(h2_conn_t *h, uint32_t id, void *resp, const char *head, size_t head_len, uint64_t body_len);
+
+// Refuse stream id without an answer (RST_STREAM INTERNAL_ERROR).
+void h2_reset(h2_conn_t *h, uint32_t id);
+
+// Bytes ready to send, topped up with DATA frames the windows allow.
+// *data stays valid until the next call. 0: nothing to send now.
+size_t h2_output(h2_conn_t *h, const void **data);
+
+// n bytes from h2_output were sent.
+void h2_consume(h2_conn_t *h, size_t n);
+
+// 1 while input should not be read: so much output waits that the peer
+// has to take some first. A peer whose answers (acks, window updates)
+// pile up unsent beyond a limit gets GOAWAY ENHANCE_YOUR_CALM.
+int h2_input_paused(const h2_conn_t *h);
+
+// Take no new streams (GOAWAY); open ones still finish.
+void h2_shutdown(h2_conn_t *h);
+
+// 1 once the connection can be closed: GOAWAY sent or received (or a
+// connection error), no stream left to answer, and the output drained.
+int h2_finished(const h2_conn_t *h);
+
+#endif
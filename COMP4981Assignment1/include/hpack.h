@@ -0,0 +1,35 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+
+// HPACK header compression (RFC 7541) for HTTP/2. A table holds one
+// direction's dynamic table: the decoder table follows what the peer
+// indexed, the encoder table what we told the peer to index.
+typedef struct hpack_table hpack_table_t;
+
+// Dynamic table size both sides start with (and the most we accept).
+#define HPACK_TABLE_SIZE 4096
+
+// Called once per decoded field; strings are not NUL-terminated.
+typedef void (*hpack_field_fn)(void *arg, const char *name, size_t name_len,
+                               const char *value, size_t value_len);
+
+hpack_table_t *hpack_table_create(void);
+void hpack_table_destroy(hpack_table_t *t);
+
+// Decode one complete header block. Returns 0, or -1 on a compression
+// error (the connection must be closed: the tables are out of sync).
+int hpack_decode(hpack_table_t *t, const unsigned char *in, size_t len, hpack_field_fn fn, void *arg);
+
+// Encoder: the peer's SETTINGS_HEADER_TABLE_SIZE (capped at
+// HPACK_TABLE_SIZE); the change is signalled in the next block.
+void hpack_set_max_size(hpack_table_t *t, size_t size);
+
+// Append one field (lowercase name) to a header block. index: let the
+// peer remember it, for values repeated across responses. Returns bytes
+// written, or -1 if dst is too small.
+int hpack_encode(hpack_table_t *t, unsigned char *dst, size_t cap,
+                 const char *name, size_t name_len, const char *value, size_t value_len, int index);
+
+#endif
@@ -2,6 +2,7 @@
 #define HTTP_H
 
 #include <stddef.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #ifndef PATH_MAX
@@ -14,13 +15,18 @@ typedef enum {
     HTTP_METHOD_UNSUPPORTED
 } http_method_t;
 
+// Longest accepted Host header value.
+#define HTTP_HOST_MAX 256
+
 typedef struct {
     http_method_t method;
     char target[PATH_MAX];
+    char host[HTTP_HOST_MAX];  // Lowercase, no port/trailing dot; "" if absent
+    int accept_gzip;           // Accept-Encoding allows gzip
 } http_request_t;
 
 // Returns 0 on success.
-// Returns 400 for bad request syntax/version.
+// Returns 400 for bad request syntax/version or a malformed Host header.
 // Returns 405 for unsupported method.
 int parse_http_request(const char *raw, size_t raw_len, http_request_t *out);
 
@@ -28,6 +34,12 @@ const char *http_reason_phrase(int status_code);
 const char *guess_mime_type(const char *path);
 void format_http_date(char *dst, size_t dst_sz);
 
+// Longest ETag value produced by format_etag (with quotes).
+#define HTTP_ETAG_MAX 48
+
+// Strong validator from file identity and version: "mtime-size".
+void format_etag(const struct stat *st, char *dst, size_t dst_sz);
+
 // Returns number of bytes written, or -1 on truncation/error.
 int build_response_headers(char *dst,
                            size_t cap,
@@ -36,4 +48,12 @@ int build_response_headers(char *dst,
                            off_t content_length,
                            int include_allow_header);
 
+// Status line and common headers, then fields (complete "Name: value\r\n"
+// lines, e.g. from a bundle), then the blank line. Returns length or -1.
+int build_headers_with_fields(char *dst, size_t cap, int status_code, const char *fields, size_t fields_len);
+
+// Insert "name: value" before the blank line ending the len header bytes
+// in dst. Returns the new length, or -1 if it does not fit.
+int append_response_header(char *dst, size_t cap, int len, const char *name, const char *value);
+
 #endif
@@ -0,0 +1,38 @@
+#ifndef LISTEN_H
+#define LISTEN_H
+
+#include "server.h"
+
+#include <sys/socket.h>
+
+// One listening socket served by the event loop.
+typedef struct {
+    int fd;
+    int family;                // AF_INET, AF_INET6 or AF_UNIX
+    int tls;                   // "tls:" listener: connections start with a handshake
+    char name[LISTEN_SPEC_MAX]; // For logs: "ip:port", "[ip6]:port", "unix:/path"
+} listener_t;
+
+// Parse "ip:port", "[ip6]:port" or "unix:/path" (any of them optionally
+// prefixed "tls:") into a socket address.
+// Returns 0 on success, -1 if spec is malformed.
+int listen_spec_parse(const char *spec, struct sockaddr_storage *ss, socklen_t *len);
+
+// Bind and listen on every address in cfg->listen.
+// Returns the number opened, or -1 (nothing left open) on failure.
+int listeners_open(const server_config_t *cfg, listener_t *out);
+
+// 1 if spec carries the "tls:" prefix.
+int listen_spec_is_tls(const char *spec);
+
+// Take over sockets listed in a comma-separated fd list (hot reload);
+// an entry "tls:<fd>" is a TLS listener.
+// Returns the number taken, or 0 if the list is empty or invalid.
+int listeners_inherit(const char *fd_list, listener_t *out);
+
+// Socket options from cfg; TCP-only options are skipped for AF_UNIX.
+void listener_apply_options(const listener_t *l, const server_config_t *cfg);
+
+void listeners_close(listener_t *ls, int n);
+
+#endif
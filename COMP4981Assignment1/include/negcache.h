@@ -0,0 +1,41 @@
+#ifndef NEGCACHE_H
+#define NEGCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-site answer to "is nothing at this URL path?" without touching the
+// filesystem: recent 404s (bounded, each with an expiry) plus, optionally,
+// a Bloom filter of every name below the document root. Only meaningful
+// while the root is watched: every change must be reported through
+// neg_cache_changed. Paths are normalized URL paths (path_normalize).
+// Event loop thread only.
+typedef struct neg_cache neg_cache_t;
+
+// Remember up to entries 404s (0 = none); filter: keep the name filter
+// (built by neg_cache_build). NULL on failure.
+neg_cache_t *neg_cache_create(size_t entries, int filter);
+
+void neg_cache_destroy(neg_cache_t *nc);
+
+// Forget every 404 and, with the filter on, rebuild it by walking
+// doc_root. Call once the root is watched, so nothing created during the
+// walk goes unreported. Returns the names in the filter, or -1 if it is
+// off (not wanted, or the walk failed).
+long neg_cache_build(neg_cache_t *nc, const char *doc_root);
+
+// Forget every 404 (settings that decide what is a 404 changed).
+void neg_cache_forget(neg_cache_t *nc);
+
+// path below doc_root was created, changed or removed (NULL: events were
+// lost, so rebuild): 404s are forgotten and whatever now exists at path
+// (everything below it, for a directory) enters the filter.
+void neg_cache_changed(neg_cache_t *nc, const char *doc_root, const char *path);
+
+// 1 if path (len bytes) is known not to exist at now_ms, else 0.
+int neg_cache_missing(const neg_cache_t *nc, const char *path, size_t len, uint64_t now_ms);
+
+// Remember that path answered 404, until expires_ms.
+void neg_cache_insert(neg_cache_t *nc, const char *path, size_t len, uint64_t expires_ms);
+
+#endif
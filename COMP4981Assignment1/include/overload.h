@@ -0,0 +1,26 @@
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Load shedding decision for the event loop. Each iteration reports how
+// long its work took and how many file lookups are waiting; while the
+// smoothed iteration time or the queue is over its limit, new requests
+// should be refused. Shedding stops once both are back under half their
+// limit. Event loop thread only.
+typedef struct {
+    int lag_limit_ms;        // 0 = ignore loop lag
+    int queue_limit;         // 0 = ignore the lookup queue
+    double lag_ms;           // moving average of iteration time
+    size_t queued;           // last reported queue depth
+    int shedding;
+} overload_t;
+
+// Set limits (0 disables a signal); current state is kept.
+void overload_configure(overload_t *o, int lag_limit_ms, int queue_limit);
+
+// Record one loop iteration. Returns 1 if shedding started or stopped.
+int overload_update(overload_t *o, uint64_t busy_ms, size_t queued);
+
+#endif
@@ -2,17 +2,55 @@
 #define PATH_H
 
 #include <stddef.h>
+#include <sys/stat.h>
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
 
+// Decode and normalize the path part of url (len bytes at most, stopping
+// at '?' or '#') into out: percent-escapes decoded, "//" collapsed, "."
+// and ".." removed. This is the path every lookup below opens, so it is
+// also the key for per-path answers (negcache.h).
+// Returns 0, 400 (not absolute, bad escape, NUL, too long) or 403
+// (backslash, or ".." above the root).
+int path_normalize(const char *url, size_t len, char *out, size_t cap);
+
+// With allow_dir, a directory without index.html resolves to the
+// directory itself (for listings) instead of failing.
 // Returns:
-//   0   success (out_path filled with canonical file path)
+//   0   success (out_path filled with canonical file or directory path)
 // 400   bad URL/path format
 // 403   forbidden (traversal or outside doc root)
 // 404   not found
 // 500   other filesystem/server error
-int resolve_path(const char *doc_root, const char *url_target, char *out_path, size_t out_sz);
+int resolve_path(const char *doc_root, const char *url_target, int allow_dir, char *out_path, size_t out_sz);
+
+// Open the file behind the O_PATH descriptor f (already checked to be a
+// regular file or directory with metadata st, found at path) for reading.
+// Returns the new fd, or -1 with errno set.
+int path_reopen(int f, const char *path, const struct stat *st);
+
+// O_PATH descriptor of doc_root for resolve_path_at, or -1 where openat2
+// is not available. It keeps naming the directory it was opened on.
+int path_root_open(const char *doc_root);
+
+// resolve_path with openat2(RESOLVE_BENEATH) relative to root_fd, so the
+// kernel keeps the lookup (symlinks included) inside the root, then
+// fstat; only a regular file (or allowed directory) is then reopened for
+// reading. The file comes back open in *fd (for reading with want_fd,
+// else O_PATH) with its metadata in *st; out_path is doc_root
+// plus the normalized URL path, or the canonical path when a symlink was
+// followed (one more open). Same statuses as resolve_path, or -1 if
+// openat2 is unavailable (fall back to resolve_path).
+int resolve_path_at(int root_fd,
+                    const char *doc_root,
+                    const char *url_target,
+                    int allow_dir,
+                    int want_fd,
+                    char *out_path,
+                    size_t out_sz,
+                    int *fd,
+                    struct stat *st);
 
 #endif
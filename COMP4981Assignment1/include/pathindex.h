@@ -0,0 +1,57 @@
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+// URL path -> resolved regular file (canonical path, metadata, MIME type
+// and ETag) for one document root, so repeat requests skip
+// realpath/stat/open. Entries are never revalidated here: the owner must
+// report every change under the root (path_index_invalidate), or not use
+// the index at all.
+// Written by the event loop thread only. Entries live in sharded hash
+// chains that fs pool workers read without locking (path_index_read);
+// removed entries are freed through rcu.h once no worker can see them.
+typedef struct path_index path_index_t;
+
+// Pointers are valid until the index next changes.
+typedef struct {
+    const char *path;        // canonical
+    struct stat st;
+    const char *mime;        // Content-Type
+    const char *etag;        // quoted ETag value
+} path_info_t;
+
+// Returns NULL on allocation failure.
+path_index_t *path_index_create(void);
+
+void path_index_destroy(path_index_t *pi);
+
+// Event loop side: look up url (length len, no query). Returns 0 and
+// fills out on a hit.
+int path_index_lookup(path_index_t *pi, const char *url, size_t len, path_info_t *out);
+
+// Worker side: copy the canonical path (into path, capacity cap) and
+// metadata remembered for url. The calling thread must be registered with
+// rcu_register_reader. Returns 0 on a hit, -1 otherwise.
+int path_index_read(const path_index_t *pi, const char *url, size_t len, char *path, size_t cap, struct stat *st);
+
+// Remember that url resolved to the regular file path under doc_root.
+// Only stored when the URL maps onto path literally (no symlinks, dot
+// segments or repeated slashes), so a change reported for path always
+// finds the entry again. Returns 0 if stored.
+int path_index_insert(path_index_t *pi,
+                      const char *doc_root,
+                      const char *url,
+                      size_t len,
+                      const char *path,
+                      const struct stat *st);
+
+// Forget entries made stale by a change to path (with is_dir, everything
+// below it too).
+void path_index_invalidate(path_index_t *pi, const char *doc_root, const char *path, int is_dir);
+
+// Forget every entry.
+void path_index_clear(path_index_t *pi);
+
+#endif
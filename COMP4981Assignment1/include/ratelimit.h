@@ -0,0 +1,45 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Per-source-address connection caps and token-bucket request limits.
+// Open-addressing table of compact entries; idle entries age out.
+// Event loop thread only.
+typedef struct rate_limiter rate_limiter_t;
+
+// Address key (IPv4 is stored IPv4-mapped).
+typedef struct {
+    unsigned char b[16];
+} rate_key_t;
+
+// capacity: tracked addresses (rounded up to a power of two).
+// max_conns: concurrent connections per address (0 = unlimited).
+// rate/burst: requests per second and bucket size (rate 0 = unlimited).
+// Returns NULL on allocation failure.
+rate_limiter_t *rate_limiter_create(size_t capacity, unsigned max_conns, double rate, double burst);
+void rate_limiter_destroy(rate_limiter_t *rl);
+
+// Change limits in place; tracked state is kept.
+void rate_limiter_configure(rate_limiter_t *rl, unsigned max_conns, double rate, double burst);
+
+// Build key from a peer address. Returns 0 on success, -1 if the family
+// is not rate limited (e.g. AF_UNIX).
+int rate_key_from_addr(const struct sockaddr *sa, rate_key_t *key);
+
+// Count a new connection. Returns 1 if admitted and counted, 0 if admitted
+// without tracking (table full), -1 if the address is over its cap.
+int rate_limiter_conn_open(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms);
+
+// Undo a counted rate_limiter_conn_open.
+void rate_limiter_conn_close(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms);
+
+// Take one request token. Returns 0 if allowed, -1 if rate limited.
+int rate_limiter_take(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms);
+
+// Drop idle entries. Cheap to call often; does a pass at most once a second.
+void rate_limiter_sweep(rate_limiter_t *rl, uint64_t now_ms);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef RCU_H
+#define RCU_H
+
+// Epoch-based reclamation for structures with one writer thread (the
+// event loop) and lock-free readers (fs pool workers). The writer unlinks
+// a node so new readers cannot reach it, then retires it; the node is
+// freed once every reader that might still see it has left its read-side
+// section.
+
+// Reader threads that may be registered at once.
+#define RCU_MAX_READERS 64
+
+// Claim a reader slot for the calling thread. Returns 0, or -1 when all
+// slots are taken (the thread must then not read shared structures).
+int rcu_register_reader(void);
+
+// Give the calling thread's slot back (outside any read-side section).
+void rcu_unregister_reader(void);
+
+// 1 if the calling thread holds a reader slot.
+int rcu_is_reader(void);
+
+// Read-side section: pointers loaded inside stay valid until unlock.
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+// Writer only: free p with fn once no reader can still reach it.
+void rcu_retire(void *p, void (*fn)(void *));
+
+// Writer only: free whatever retired nodes are now unreachable.
+void rcu_reclaim(void);
+
+#endif
@@ -8,14 +8,80 @@
 #define PATH_MAX 4096
 #endif
 
+// Listening addresses per process.
+#define MAX_LISTENERS 16
+// Longest listen address ("unix:" + socket path).
+#define LISTEN_SPEC_MAX 128
+// Name-based virtual hosts per process.
+#define MAX_VHOSTS 64
+// Longest "names=doc_root" virtual host entry.
+#define VHOST_SPEC_MAX 1024
+
 typedef struct {
-    char port[16];
-    char doc_root[PATH_MAX];   // canonical (realpath)
+    // Positional <ip> <port> first, then each --listen / "listen =" entry:
+    // "ip:port", "[ip6]:port" or "unix:/path", optionally prefixed "tls:".
+    char listen[MAX_LISTENERS][LISTEN_SPEC_MAX];
+    int num_listen;
+
+    // --vhost / "vhost =" entries: "name[,name...]=doc_root", root canonical.
+    char vhost[MAX_VHOSTS][VHOST_SPEC_MAX];
+    int num_vhosts;
+
+    char doc_root[PATH_MAX];   // canonical (realpath); unknown/missing Host
+    char bundle[PATH_MAX];     // --bundle file serving the default site ("" = none)
+    char tls_cert[PATH_MAX];   // PEM chain for "tls:" listeners
+    char tls_key[PATH_MAX];    // PEM private key for "tls:" listeners
+    char config_path[PATH_MAX]; // --config file ("" if none)
+
+    // Original command line (SIGHUP re-read, hot reload exec).
+    int argc;
+    char **argv;
+
+    // Tunables: --name on the CLI or "name = value" in the config file.
     size_t max_header_size;
     int backlog;
+    int max_clients;           // concurrent connections
+    int fs_threads;            // filesystem worker threads (0 = inline)
+    size_t chunk_size;         // file streaming chunk
+    size_t write_budget;       // bytes per connection per loop iteration (0 = unlimited)
+    int sndbuf;                // SO_SNDBUF for clients (0 = default)
+    int rcvbuf;                // SO_RCVBUF for clients (0 = default)
+    int tcp_nodelay;           // TCP_NODELAY on client sockets
+    int tcp_cork;              // cork streamed file responses
+    int defer_accept;          // TCP_DEFER_ACCEPT seconds (0 = off)
+    int fastopen;              // TCP_FASTOPEN queue length (0 = off)
+    int read_on_accept;        // try recv right after accept
+    int tls_tickets;           // issue TLS session tickets
+    int http2;                 // accept HTTP/2 (prior knowledge / ALPN h2)
+    int h2_max_streams;        // concurrent streams per HTTP/2 connection
+    size_t cache_budget;       // bytes of hot small files kept in memory (0 = off)
+    size_t cache_max_file;     // largest file eligible for the memory store
+    size_t rate_table_size;    // addresses tracked by the per-IP limiter
+    unsigned max_conns_per_ip; // concurrent connections per address (0 = off)
+    double rate_limit;         // requests/second per address (0 = off)
+    double rate_burst;         // token bucket size
+    int autoindex;             // list directories without index.html
+    size_t autoindex_cache;    // bytes of rendered listings kept per site
+    int watch;                 // invalidate caches from inotify events
+    size_t neg_cache;          // 404s remembered per site while watched (0 = off)
+    int neg_cache_ttl;         // seconds a remembered 404 is trusted
+    int neg_filter;            // filter of existing names per site, built at startup
+    int warmup;                // threads walking doc roots at startup (0 = off)
+    size_t warmup_preload;     // preload files up to this size at startup
+    int overload_lag;          // smoothed loop iteration ms that starts shedding (0 = off)
+    int overload_queue;        // queued fs lookups that start shedding (0 = off)
+    int retry_after;           // Retry-After seconds on 503
+    int client_timeout;        // seconds without progress (0 = never)
+    int drain_timeout;         // seconds to finish in-flight work on stop
 } server_config_t;
 
 int parse_arguments(int argc, char **argv, server_config_t *cfg);
-int run_server(const server_config_t *cfg);
+
+// Re-read config file and command line, updating only the settings that
+// are safe to change while running. Returns 0 on success (cfg untouched
+// on failure).
+int reload_arguments(server_config_t *cfg);
+
+int run_server(server_config_t *cfg);
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// TLS for "tls:" listeners (OpenSSL; built with HAVE_OPENSSL). After the
+// handshake, record encryption is handed to the kernel (kTLS) where it
+// supports the negotiated cipher, so responses are written to the socket
+// as plain bytes; otherwise they go through the library.
+// Event loop thread only.
+typedef struct tls_server tls_server_t;
+typedef struct tls_conn tls_conn_t;
+
+// Largest plaintext record.
+#define TLS_RECORD_MAX 16384
+
+// Load certificate chain and private key (PEM). tickets: issue session
+// tickets for resumption; a server-side session cache is always kept.
+// h2: select HTTP/2 when the client offers "h2" through ALPN.
+// Returns NULL (with a message on stderr) on failure.
+tls_server_t *tls_server_create(const char *cert_file, const char *key_file, int tickets, int h2);
+
+void tls_server_destroy(tls_server_t *ts);
+
+// Server side of a new connection on fd. NULL on failure.
+tls_conn_t *tls_conn_create(tls_server_t *ts, int fd);
+
+// Send close_notify (best effort, never blocks) and free.
+void tls_conn_destroy(tls_conn_t *tc);
+
+// Advance the handshake. Returns 1 when complete, 0 when it must wait
+// for *events (POLLIN/POLLOUT), -1 on failure.
+int tls_handshake(tls_conn_t *tc, short *events);
+
+// 1 if the kernel encrypts what is written to the socket (kTLS send).
+int tls_kernel_send(const tls_conn_t *tc);
+
+// 1 if the handshake selected HTTP/2 (ALPN "h2").
+int tls_alpn_h2(const tls_conn_t *tc);
+
+// Like recv/send: bytes moved, 0 on peer close (recv), or -1 with errno
+// EAGAIN when the connection must wait for tls_wait_events().
+ssize_t tls_recv(tls_conn_t *tc, void *buf, size_t len);
+
+// Encrypt and send the start of iov, up to one record (TLS_RECORD_MAX).
+// After EAGAIN, the next call must offer at least the same bytes again.
+ssize_t tls_sendv(tls_conn_t *tc, const struct iovec *iov, int cnt);
+
+// Poll events the last EAGAIN from tls_recv/tls_sendv is waiting for
+// (POLLOUT after a successful send).
+short tls_wait_events(const tls_conn_t *tc);
+
+#endif
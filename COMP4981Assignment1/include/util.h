@@ -1,6 +1,27 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/socket.h>
+
 int set_nonblocking(int fd);
+int set_cloexec(int fd);
+
+// accept() returning a non-blocking, close-on-exec socket (-1 + errno on failure).
+int accept_nonblocking(int listen_fd, struct sockaddr *addr, socklen_t *len);
+
+// Toggle TCP_CORK (-1 where unsupported).
+int set_tcp_cork(int fd, int on);
+
+// Parse a base-10 integer in [min, max]. Returns 0 on success, -1 otherwise.
+int parse_long(const char *s, long min, long max, long *out);
+
+// 64-bit FNV-1a hash of a byte range.
+uint64_t hash_bytes(const void *data, size_t len);
+
+// Milliseconds from a monotonic clock (for timeouts/rates, not dates).
+uint64_t monotonic_ms(void);
 
 #endif
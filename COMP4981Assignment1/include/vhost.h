@@ -0,0 +1,51 @@
+#ifndef VHOST_H
+#define VHOST_H
+
+#include "bundle.h"
+#include "dirindex.h"
+#include "errpage.h"
+#include "filecache.h"
+#include "negcache.h"
+#include "pathindex.h"
+#include "server.h"
+
+// One site: its document root plus the per-site caches built from it.
+typedef struct {
+    char doc_root[PATH_MAX];     // canonical
+    int root_fd;                 // O_PATH fd of doc_root for lookups (-1: by path)
+    file_cache_t *cache;         // hot small files (NULL if cache-budget is 0)
+    error_pages_t *pages;        // prebuilt error responses
+    dir_index_t *listings;       // rendered directory listings
+    path_index_t *paths;         // resolved URLs (only used while watched)
+    neg_cache_t *missing;        // known 404s (NULL if off; only used while watched)
+    bundle_t *bundle;            // packed assets replacing doc_root (or NULL)
+} vhost_t;
+
+// Host name -> site map. Event loop thread only.
+typedef struct vhost_table vhost_table_t;
+
+// Default site from cfg->doc_root plus one site per cfg->vhost entry.
+// Returns NULL on failure.
+vhost_table_t *vhost_table_create(const server_config_t *cfg);
+
+// Only once no connection references a site any more.
+void vhost_table_destroy(vhost_table_t *vt);
+
+// Site for a normalized Host value; unknown or empty hosts get the default.
+vhost_t *vhost_find(const vhost_table_t *vt, const char *host);
+
+vhost_t *vhost_default(const vhost_table_t *vt);
+
+// Apply cache limits from cfg to every site (creating caches that were off).
+void vhost_table_apply_limits(vhost_table_t *vt, const server_config_t *cfg);
+
+// Point the default site at the bundle file path ("" = serve doc_root),
+// reopening it if the file was replaced. On failure the current bundle
+// stays. Connections keep their own reference to the old one.
+void vhost_table_set_bundle(vhost_table_t *vt, const char *path);
+
+// Number of sites including the default, and access by index (0 = default).
+int vhost_count(const vhost_table_t *vt);
+const vhost_t *vhost_at(const vhost_table_t *vt, int i);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include "server.h"
+#include "vhost.h"
+
+// Startup warm-up: walk every site's document root on cfg->warmup
+// threads, record each regular file in the site's path index (when
+// use_index is set) and load files of at most cfg->warmup_preload bytes
+// into the site's memory store. Runs before serving; blocks until done.
+// Returns the number of files found, or -1 if the walk could not start.
+long warmup_sites(vhost_table_t *vt, const server_config_t *cfg, int use_index);
+
+#endif
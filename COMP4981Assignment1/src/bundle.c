@@ -0,0 +1,158 @@
+#include "bundle.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct bundle {
+    char path[PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+
+    const unsigned char *map;
+    size_t size;
+    const bundle_entry_t *table;
+    uint32_t count;
+    int refs;
+};
+
+// [off, off + len) lies inside the mapping.
+static int in_bounds(const bundle_t *b, uint64_t off, uint64_t len) {
+    return off <= b->size && len <= b->size - off;
+}
+
+// Every offset in the table points inside the file and paths are sorted.
+static int validate(const bundle_t *b) {
+    const bundle_header_t *h = (const bundle_header_t *)(const void *)b->map;
+    if (b->size < sizeof(*h) || memcmp(h->magic, BUNDLE_MAGIC, 8) != 0 ||
+        h->version != BUNDLE_VERSION || h->size != b->size) {
+        return -1;
+    }
+    if (h->table_off % 8 != 0 ||
+        h->count > (b->size - sizeof(*h)) / sizeof(bundle_entry_t) ||
+        !in_bounds(b, h->table_off, (uint64_t)h->count * sizeof(bundle_entry_t))) {
+        return -1;
+    }
+
+    const bundle_entry_t *t = (const bundle_entry_t *)(const void *)(b->map + h->table_off);
+    for (uint32_t i = 0; i < h->count; i++) {
+        const bundle_entry_t *e = &t[i];
+        if (e->path_len == 0 || !in_bounds(b, e->path_off, e->path_len) ||
+            !in_bounds(b, e->fields_off, e->fields_len) ||
+            !in_bounds(b, e->body_off, e->body_len) ||
+            !in_bounds(b, e->gz_fields_off, e->gz_fields_len) ||
+            !in_bounds(b, e->gz_body_off, e->gz_body_len)) {
+            return -1;
+        }
+        if (i > 0) {
+            const bundle_entry_t *p = &t[i - 1];
+            size_t n = p->path_len < e->path_len ? p->path_len : e->path_len;
+            int c = memcmp(b->map + p->path_off, b->map + e->path_off, n);
+            if (c > 0 || (c == 0 && p->path_len >= e->path_len)) return -1;
+        }
+    }
+    return 0;
+}
+
+bundle_t *bundle_open(const char *path) {
+    bundle_t *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    snprintf(b->path, sizeof(b->path), "%s", path);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        free(b);
+        return NULL;
+    }
+
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (m == MAP_FAILED) {
+        free(b);
+        return NULL;
+    }
+
+    b->map = m;
+    b->size = (size_t)st.st_size;
+    b->dev = st.st_dev;
+    b->ino = st.st_ino;
+    b->mtime = st.st_mtim;
+    b->refs = 1;
+
+    if (validate(b) != 0) {
+        munmap((void *)b->map, b->size);
+        free(b);
+        return NULL;
+    }
+
+    const bundle_header_t *h = (const bundle_header_t *)(const void *)b->map;
+    b->table = (const bundle_entry_t *)(const void *)(b->map + h->table_off);
+    b->count = h->count;
+    return b;
+}
+
+void bundle_ref(bundle_t *b) {
+    if (b) b->refs++;
+}
+
+void bundle_unref(bundle_t *b) {
+    if (!b || --b->refs > 0) return;
+
+    munmap((void *)b->map, b->size);
+    free(b);
+}
+
+int bundle_find(const bundle_t *b, const char *url, size_t len, int gzip, bundle_file_t *out) {
+    if (!b || !url) return -1;
+
+    // Binary search over the sorted path table.
+    size_t lo = 0;
+    size_t hi = b->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const bundle_entry_t *e = &b->table[mid];
+        size_t n = e->path_len < len ? e->path_len : len;
+        int c = memcmp(b->map + e->path_off, url, n);
+        if (c == 0) c = (e->path_len < len) ? -1 : (e->path_len > len) ? 1 : 0;
+
+        if (c < 0) {
+            lo = mid + 1;
+        } else if (c > 0) {
+            hi = mid;
+        } else {
+            int gz = gzip && e->gz_fields_len > 0;
+            out->fields = (const char *)b->map + (gz ? e->gz_fields_off : e->fields_off);
+            out->fields_len = (size_t)(gz ? e->gz_fields_len : e->fields_len);
+            out->body = (const char *)b->map + (gz ? e->gz_body_off : e->body_off);
+            out->body_len = (size_t)(gz ? e->gz_body_len : e->body_len);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int bundle_replaced(const bundle_t *b) {
+    struct stat st;
+    if (!b || stat(b->path, &st) != 0) return 0;
+
+    return st.st_dev != b->dev || st.st_ino != b->ino ||
+           st.st_mtim.tv_sec != b->mtime.tv_sec || st.st_mtim.tv_nsec != b->mtime.tv_nsec;
+}
+
+size_t bundle_count(const bundle_t *b) {
+    return b ? b->count : 0;
+}
+
+const char *bundle_path(const bundle_t *b) {
+    return b ? b->path : "";
+}
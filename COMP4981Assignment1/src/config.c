@@ -0,0 +1,587 @@
+#include "server.h"
+
+#include "listen.h"
+#include "util.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Hard cap for request header bytes.
+#define MAX_HEADER_LIMIT (1024 * 1024)
+// Longest accepted config file line.
+#define MAX_CONFIG_LINE 1024
+
+// Storage type of a tunable field in server_config_t.
+typedef enum { KIND_INT, KIND_UINT, KIND_SIZE, KIND_DOUBLE } tunable_kind_t;
+
+// One tunable: same name as --option and config file key.
+typedef struct {
+    const char *name;
+    tunable_kind_t kind;
+    size_t offset;           // Field offset in server_config_t
+    double min;
+    double max;
+    int reloadable;          // Safe to change on SIGHUP
+    const char *help;
+} tunable_t;
+
+#define FIELD(f) offsetof(server_config_t, f)
+
+static const tunable_t k_tunables[] = {
+    {"fs-threads", KIND_INT, FIELD(fs_threads), 0, 256, 0,
+     "resolve/open files on N worker threads (0 = inline)"},
+    {"max-clients", KIND_INT, FIELD(max_clients), 1, 1000000, 0,
+     "concurrent connections"},
+    {"backlog", KIND_INT, FIELD(backlog), 1, 65535, 0,
+     "listen() backlog"},
+    {"max-header-size", KIND_SIZE, FIELD(max_header_size), 256, MAX_HEADER_LIMIT, 1,
+     "request header limit in bytes"},
+    {"chunk-size", KIND_SIZE, FIELD(chunk_size), 512, 16 * 1024 * 1024, 1,
+     "file streaming chunk in bytes"},
+    {"write-budget", KIND_SIZE, FIELD(write_budget), 0, (double)LONG_MAX, 1,
+     "bytes one connection may send per loop iteration before others are served (0 = unlimited)"},
+    {"sndbuf", KIND_INT, FIELD(sndbuf), 0, INT_MAX, 1,
+     "SO_SNDBUF for client sockets (0 = kernel default)"},
+    {"rcvbuf", KIND_INT, FIELD(rcvbuf), 0, INT_MAX, 1,
+     "SO_RCVBUF for client sockets (0 = kernel default)"},
+    {"tcp-nodelay", KIND_INT, FIELD(tcp_nodelay), 0, 1, 1,
+     "send small writes immediately (TCP_NODELAY, 1 = on)"},
+    {"tcp-cork", KIND_INT, FIELD(tcp_cork), 0, 1, 1,
+     "cork streamed files so only full segments leave until the end"},
+    {"defer-accept", KIND_INT, FIELD(defer_accept), 0, 3600, 1,
+     "seconds to hold new connections in the kernel until data arrives (0 = off)"},
+    {"fastopen", KIND_INT, FIELD(fastopen), 0, 65535, 1,
+     "TCP Fast Open queue length (0 = off)"},
+    {"tls-tickets", KIND_INT, FIELD(tls_tickets), 0, 1, 0,
+     "issue TLS session tickets for resumption (1 = on)"},
+    {"http2", KIND_INT, FIELD(http2), 0, 1, 0,
+     "accept HTTP/2: prior knowledge on plain listeners, ALPN h2 on tls: ones (1 = on)"},
+    {"h2-max-streams", KIND_INT, FIELD(h2_max_streams), 1, 1024, 1,
+     "concurrent requests per HTTP/2 connection"},
+    {"read-on-accept", KIND_INT, FIELD(read_on_accept), 0, 1, 1,
+     "read the request right after accept instead of waiting for the next poll (1 = on)"},
+    {"cache-budget", KIND_SIZE, FIELD(cache_budget), 0, (double)LONG_MAX, 1,
+     "bytes of hot small files kept as in-memory copies per site (0 = off)"},
+    {"cache-max-file", KIND_SIZE, FIELD(cache_max_file), 1, (double)LONG_MAX, 1,
+     "largest file eligible for the memory store"},
+    // Former names, kept so existing command lines and config files still work.
+    {"mmap-budget", KIND_SIZE, FIELD(cache_budget), 0, (double)LONG_MAX, 1,
+     "old name of --cache-budget"},
+    {"mmap-max-file", KIND_SIZE, FIELD(cache_max_file), 1, (double)LONG_MAX, 1,
+     "old name of --cache-max-file"},
+    {"rate-table-size", KIND_SIZE, FIELD(rate_table_size), 64, 16 * 1024 * 1024, 0,
+     "source addresses tracked by the per-IP limiter"},
+    {"max-conns-per-ip", KIND_UINT, FIELD(max_conns_per_ip), 0, 1000000, 1,
+     "concurrent connections per source address (0 = off)"},
+    {"rate-limit", KIND_DOUBLE, FIELD(rate_limit), 0, 1e6, 1,
+     "requests per second per source address (0 = off)"},
+    {"rate-burst", KIND_DOUBLE, FIELD(rate_burst), 1, 1e6, 1,
+     "request burst allowed above the rate"},
+    {"autoindex", KIND_INT, FIELD(autoindex), 0, 1, 1,
+     "list directories that have no index.html (HTML, or JSON with ?format=json)"},
+    {"autoindex-cache", KIND_SIZE, FIELD(autoindex_cache), 0, (double)LONG_MAX, 1,
+     "bytes of rendered directory listings cached per site"},
+    {"watch", KIND_INT, FIELD(watch), 0, 1, 0,
+     "watch document roots for changes and skip per-request revalidation (1 = on)"},
+    {"neg-cache", KIND_SIZE, FIELD(neg_cache), 0, 16 * 1024 * 1024, 0,
+     "404 paths remembered per site and answered without a lookup while watching (0 = off)"},
+    {"neg-cache-ttl", KIND_INT, FIELD(neg_cache_ttl), 1, 86400, 1,
+     "seconds a remembered 404 is answered from memory"},
+    {"neg-filter", KIND_INT, FIELD(neg_filter), 0, 1, 0,
+     "answer paths with a name not found below the document root with 404 directly (1 = on)"},
+    {"warmup", KIND_INT, FIELD(warmup), 0, 256, 0,
+     "walk document roots on N threads at startup to index files (0 = off)"},
+    {"warmup-preload", KIND_SIZE, FIELD(warmup_preload), 0, (double)LONG_MAX, 0,
+     "during warm-up, load files up to this size into the memory store (0 = none)"},
+    {"overload-lag", KIND_INT, FIELD(overload_lag), 0, 60000, 1,
+     "answer new requests with 503 while a loop iteration takes this many ms on average (0 = off)"},
+    {"overload-queue", KIND_INT, FIELD(overload_queue), 0, 1000000, 1,
+     "answer new requests with 503 while this many file lookups wait for a worker (0 = off)"},
+    {"retry-after", KIND_INT, FIELD(retry_after), 0, 86400, 0,
+     "Retry-After seconds sent with 503"},
+    {"client-timeout", KIND_INT, FIELD(client_timeout), 0, 86400, 1,
+     "seconds without progress before a connection is closed (0 = never)"},
+    {"drain-timeout", KIND_INT, FIELD(drain_timeout), 0, 86400, 1,
+     "seconds to finish in-flight responses on shutdown"},
+};
+
+#define NUM_TUNABLES (sizeof(k_tunables) / sizeof(k_tunables[0]))
+
+// getopt_long values for options outside the tunables table.
+#define OPT_CONFIG 2000
+#define OPT_LISTEN 2001
+#define OPT_VHOST 2002
+// File-path options: getopt value OPT_PATH + index into k_paths.
+#define OPT_PATH 3000
+
+// Options naming a file (char[PATH_MAX] fields), outside the tunables.
+typedef struct {
+    const char *name;
+    size_t offset;
+    int reloadable;          // Safe to change on SIGHUP
+    const char *help;
+} path_option_t;
+
+static const path_option_t k_paths[] = {
+    {"bundle", FIELD(bundle), 1,
+     "serve the default site from a bundle made by mkbundle (swapped when replaced)"},
+    {"tls-cert", FIELD(tls_cert), 0,
+     "PEM certificate chain for tls: listeners"},
+    {"tls-key", FIELD(tls_key), 0,
+     "PEM private key for tls: listeners"},
+};
+
+#define NUM_PATHS (sizeof(k_paths) / sizeof(k_paths[0]))
+
+// Defaults for every setting.
+static void set_defaults(server_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->max_header_size = 8192;
+    cfg->backlog = 128;
+    cfg->max_clients = 1024;
+    cfg->fs_threads = 0;
+    cfg->chunk_size = 8192;
+    cfg->write_budget = 256u * 1024;
+    cfg->sndbuf = 0;
+    cfg->rcvbuf = 0;
+    cfg->tcp_nodelay = 1;
+    cfg->tcp_cork = 0;
+    cfg->defer_accept = 0;
+    cfg->fastopen = 0;
+    cfg->read_on_accept = 0;
+    cfg->tls_tickets = 1;
+    cfg->http2 = 1;
+    cfg->h2_max_streams = 100;
+    cfg->cache_budget = 32u * 1024 * 1024;
+    cfg->cache_max_file = 64u * 1024;
+    cfg->rate_table_size = 8192;
+    cfg->max_conns_per_ip = 0;
+    cfg->rate_limit = 0.0;
+    cfg->rate_burst = 20.0;
+    cfg->autoindex = 0;
+    cfg->autoindex_cache = 4u * 1024 * 1024;
+    cfg->watch = 1;
+    cfg->neg_cache = 4096;
+    cfg->neg_cache_ttl = 5;
+    cfg->neg_filter = 0;
+    cfg->warmup = 0;
+    cfg->warmup_preload = 0;
+    cfg->overload_lag = 0;
+    cfg->overload_queue = 0;
+    cfg->retry_after = 1;
+    cfg->client_timeout = 60;
+    cfg->drain_timeout = 10;
+}
+
+// Validate numeric TCP port.
+static int parse_port_number(const char *port_str) {
+    long v;
+    if (parse_long(port_str, 1, 65535, &v) != 0) return -1;
+    return (int)v;
+}
+
+// Validate literal IPv4/IPv6 string.
+static int is_valid_ip_literal(const char *ip) {
+    struct in_addr a4;
+    struct in6_addr a6;
+
+    if (!ip || *ip == '\0') return 0;
+    if (inet_pton(AF_INET, ip, &a4) == 1) return 1;
+    if (inet_pton(AF_INET6, ip, &a6) == 1) return 1;
+    return 0;
+}
+
+// Validate and append one listen address.
+static int add_listen(server_config_t *cfg, const char *spec) {
+    struct sockaddr_storage ss;
+    socklen_t len;
+
+    if (strlen(spec) >= LISTEN_SPEC_MAX || listen_spec_parse(spec, &ss, &len) != 0) {
+        fprintf(stderr, "Invalid listen address: %s\n", spec);
+        return -1;
+    }
+    if (cfg->num_listen >= MAX_LISTENERS) {
+        fprintf(stderr, "Too many listen addresses (max %d)\n", MAX_LISTENERS);
+        return -1;
+    }
+    snprintf(cfg->listen[cfg->num_listen++], LISTEN_SPEC_MAX, "%s", spec);
+    return 0;
+}
+
+// Canonicalize a document root; it must be an existing directory.
+static int canonical_dir(const char *dir, char *out) {
+    if (!realpath(dir, out)) {
+        fprintf(stderr, "realpath(%s): %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(out, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Document root is not a directory: %s\n", out);
+        return -1;
+    }
+    return 0;
+}
+
+// Validate and append "name[,name...]=dir", storing dir canonicalized.
+static int add_vhost(server_config_t *cfg, const char *spec) {
+    const char *eq = strchr(spec, '=');
+    size_t names_len = eq ? (size_t)(eq - spec) : 0;
+    if (names_len == 0 || eq[1] == '\0') {
+        fprintf(stderr, "Invalid vhost (want name[,name...]=doc_root): %s\n", spec);
+        return -1;
+    }
+    if (cfg->num_vhosts >= MAX_VHOSTS) {
+        fprintf(stderr, "Too many virtual hosts (max %d)\n", MAX_VHOSTS);
+        return -1;
+    }
+
+    char root[PATH_MAX];
+    if (canonical_dir(eq + 1, root) != 0) return -1;
+
+    int n = snprintf(cfg->vhost[cfg->num_vhosts], VHOST_SPEC_MAX, "%.*s=%s", (int)names_len, spec, root);
+    if (n < 0 || n >= VHOST_SPEC_MAX) {
+        fprintf(stderr, "vhost entry too long: %s\n", spec);
+        return -1;
+    }
+    cfg->num_vhosts++;
+    return 0;
+}
+
+// Parse byte count with optional K/M/G suffix.
+static int parse_size(const char *s, double *out) {
+    if (!s || *s == '\0' || *s == '-') return -1;
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno != 0 || end == s) return -1;
+
+    double mult = 1.0;
+    if (*end == 'K' || *end == 'k') mult = 1024.0;
+    else if (*end == 'M' || *end == 'm') mult = 1024.0 * 1024.0;
+    else if (*end == 'G' || *end == 'g') mult = 1024.0 * 1024.0 * 1024.0;
+    if (mult > 1.0) end++;
+    if (*end != '\0') return -1;
+
+    *out = (double)v * mult;
+    return 0;
+}
+
+// Parse value per tunable kind and store it into cfg.
+static int set_tunable(server_config_t *cfg, const tunable_t *t, const char *value) {
+    double v;
+    if (t->kind == KIND_SIZE) {
+        if (parse_size(value, &v) != 0) return -1;
+    } else {
+        char *end = NULL;
+        errno = 0;
+        v = strtod(value, &end);
+        if (errno != 0 || !end || end == value || *end != '\0') return -1;
+    }
+    if (!(v >= t->min && v <= t->max)) return -1;
+
+    // Only now is v known to fit an int, so the conversion is defined
+    // (sizes are whole numbers already).
+    if ((t->kind == KIND_INT || t->kind == KIND_UINT) && v != (double)(long long)v) return -1;
+
+    char *field = (char *)cfg + t->offset;
+    switch (t->kind) {
+        case KIND_INT:
+            *(int *)field = (int)v;
+            break;
+        case KIND_UINT:
+            *(unsigned *)field = (unsigned)v;
+            break;
+        case KIND_SIZE:
+            *(size_t *)field = (size_t)v;
+            break;
+        case KIND_DOUBLE:
+            *(double *)field = v;
+            break;
+    }
+    return 0;
+}
+
+static const tunable_t *find_tunable(const char *name) {
+    for (size_t i = 0; i < NUM_TUNABLES; i++) {
+        if (strcmp(k_tunables[i].name, name) == 0) return &k_tunables[i];
+    }
+    return NULL;
+}
+
+static const path_option_t *find_path_option(const char *name) {
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+        if (strcmp(k_paths[i].name, name) == 0) return &k_paths[i];
+    }
+    return NULL;
+}
+
+// Trim leading/trailing whitespace in place.
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1])) s[--n] = '\0';
+    return s;
+}
+
+// Apply "key = value" lines from path. '#' starts a comment.
+static int load_config_file(server_config_t *cfg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char line[MAX_CONFIG_LINE];
+    int lineno = 0;
+    int rc = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *s = trim(line);
+        if (*s == '\0') continue;
+
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, lineno);
+            rc = -1;
+            break;
+        }
+        *eq = '\0';
+        char *key = trim(s);
+        char *value = trim(eq + 1);
+
+        const path_option_t *po = find_path_option(key);
+        if (po) {
+            snprintf((char *)cfg + po->offset, PATH_MAX, "%s", value);
+            continue;
+        }
+
+        if (strcmp(key, "listen") == 0 || strcmp(key, "vhost") == 0) {
+            int bad = (key[0] == 'l') ? add_listen(cfg, value) : add_vhost(cfg, value);
+            if (bad) {
+                fprintf(stderr, "%s:%d: bad %s entry\n", path, lineno, key);
+                rc = -1;
+                break;
+            }
+            continue;
+        }
+
+        const tunable_t *t = find_tunable(key);
+        if (!t) {
+            fprintf(stderr, "%s:%d: unknown setting '%s'\n", path, lineno, key);
+            rc = -1;
+            break;
+        }
+        if (set_tunable(cfg, t, value) != 0) {
+            fprintf(stderr, "%s:%d: invalid %s: %s\n", path, lineno, key, value);
+            rc = -1;
+            break;
+        }
+    }
+
+    fclose(f);
+    return rc;
+}
+
+// Print CLI usage.
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <ip> <port> <doc_root>\n", prog);
+    fprintf(stderr, "Options (also valid as 'name = value' in the config file):\n");
+    fprintf(stderr, "  --%-20s %s\n", "config FILE", "read settings from FILE (SIGHUP re-reads it)");
+    fprintf(stderr, "  --%-20s %s\n", "listen ADDR",
+            "also listen on ip:port, [ip6]:port or unix:/path, tls: prefix for HTTPS (repeatable) [restart]");
+    fprintf(stderr, "  --%-20s %s\n", "vhost NAMES=DIR",
+            "serve Host NAMES (comma-separated) from DIR (repeatable) [restart]");
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s FILE", k_paths[i].name);
+        fprintf(stderr, "  --%-20s %s%s\n", name, k_paths[i].help, k_paths[i].reloadable ? "" : " [restart]");
+    }
+    for (size_t i = 0; i < NUM_TUNABLES; i++) {
+        fprintf(stderr, "  --%-20s %s%s\n",
+                k_tunables[i].name,
+                k_tunables[i].help,
+                k_tunables[i].reloadable ? "" : " [restart]");
+    }
+}
+
+// Parse defaults, then config file, then command line (CLI wins).
+static int load_arguments(int argc, char **argv, server_config_t *cfg) {
+    set_defaults(cfg);
+
+    // Kept for SIGHUP re-reads and exec'ing a successor on hot reload.
+    cfg->argc = argc;
+    cfg->argv = argv;
+
+    struct option longopts[NUM_TUNABLES + 3 + NUM_PATHS + 1];
+    for (size_t i = 0; i < NUM_TUNABLES; i++) {
+        longopts[i].name = k_tunables[i].name;
+        longopts[i].has_arg = required_argument;
+        longopts[i].flag = NULL;
+        longopts[i].val = 1000 + (int)i;
+    }
+    longopts[NUM_TUNABLES].name = "config";
+    longopts[NUM_TUNABLES].has_arg = required_argument;
+    longopts[NUM_TUNABLES].flag = NULL;
+    longopts[NUM_TUNABLES].val = OPT_CONFIG;
+    longopts[NUM_TUNABLES + 1].name = "listen";
+    longopts[NUM_TUNABLES + 1].has_arg = required_argument;
+    longopts[NUM_TUNABLES + 1].flag = NULL;
+    longopts[NUM_TUNABLES + 1].val = OPT_LISTEN;
+    longopts[NUM_TUNABLES + 2].name = "vhost";
+    longopts[NUM_TUNABLES + 2].has_arg = required_argument;
+    longopts[NUM_TUNABLES + 2].flag = NULL;
+    longopts[NUM_TUNABLES + 2].val = OPT_VHOST;
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+        longopts[NUM_TUNABLES + 3 + i].name = k_paths[i].name;
+        longopts[NUM_TUNABLES + 3 + i].has_arg = required_argument;
+        longopts[NUM_TUNABLES + 3 + i].flag = NULL;
+        longopts[NUM_TUNABLES + 3 + i].val = OPT_PATH + (int)i;
+    }
+    memset(&longopts[NUM_TUNABLES + 3 + NUM_PATHS], 0, sizeof(longopts[0]));
+
+    // Collect options first so the file can be applied before them.
+    int *opt_idx = calloc((size_t)argc + 1, sizeof(*opt_idx));
+    char **opt_val = calloc((size_t)argc + 1, sizeof(*opt_val));
+    if (!opt_idx || !opt_val) {
+        free(opt_idx);
+        free(opt_val);
+        return -1;
+    }
+
+    // Restart scanning (also on SIGHUP re-reads).
+#ifdef __GLIBC__
+    optind = 0;
+#else
+    optind = 1;
+#endif
+
+    int nopts = 0;
+    int opt;
+    int rc = 0;
+    while ((opt = getopt_long(argc, argv, "", longopts, NULL)) != -1) {
+        if (opt == OPT_CONFIG) {
+            snprintf(cfg->config_path, sizeof(cfg->config_path), "%s", optarg);
+        } else if (opt == OPT_LISTEN || opt == OPT_VHOST ||
+                   (opt >= OPT_PATH && opt < OPT_PATH + (int)NUM_PATHS) ||
+                   (opt >= 1000 && opt < 1000 + (int)NUM_TUNABLES)) {
+            // Negative indexes mark the options outside the table:
+            // -1 listen, -2 vhost, -3 - i path option i.
+            opt_idx[nopts] = (opt == OPT_LISTEN) ? -1
+                           : (opt == OPT_VHOST) ? -2
+                           : (opt >= OPT_PATH) ? -3 - (opt - OPT_PATH)
+                           : opt - 1000;
+            opt_val[nopts] = optarg;
+            nopts++;
+        } else {
+            print_usage(argv[0]);
+            rc = -1;
+            break;
+        }
+    }
+
+    if (rc == 0 && cfg->config_path[0] != '\0') {
+        rc = load_config_file(cfg, cfg->config_path);
+    }
+
+    for (int i = 0; rc == 0 && i < nopts; i++) {
+        if (opt_idx[i] <= -3) {
+            snprintf((char *)cfg + k_paths[-3 - opt_idx[i]].offset, PATH_MAX, "%s", opt_val[i]);
+            continue;
+        }
+        if (opt_idx[i] < 0) {
+            rc = (opt_idx[i] == -1) ? add_listen(cfg, opt_val[i]) : add_vhost(cfg, opt_val[i]);
+            continue;
+        }
+        const tunable_t *t = &k_tunables[opt_idx[i]];
+        if (set_tunable(cfg, t, opt_val[i]) != 0) {
+            fprintf(stderr, "Invalid --%s: %s\n", t->name, opt_val[i]);
+            rc = -1;
+        }
+    }
+
+    free(opt_idx);
+    free(opt_val);
+    return rc;
+}
+
+// Parse CLI args: [options] <ip> <port> <doc_root>.
+int parse_arguments(int argc, char **argv, server_config_t *cfg) {
+    if (!cfg) return -1;
+
+    if (load_arguments(argc, argv, cfg) != 0) {
+        return -1;
+    }
+
+    // Expect exactly 3 positional args.
+    if (argc - optind != 3) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    char **pos = argv + optind;
+
+    // Validate bind IP and port.
+    if (!is_valid_ip_literal(pos[0])) {
+        fprintf(stderr, "Invalid IP: %s\n", pos[0]);
+        return -1;
+    }
+    if (parse_port_number(pos[1]) < 0) {
+        fprintf(stderr, "Invalid port: %s\n", pos[1]);
+        return -1;
+    }
+
+    // Positional address is the first listener, ahead of --listen extras.
+    if (cfg->num_listen >= MAX_LISTENERS) {
+        fprintf(stderr, "Too many listen addresses (max %d)\n", MAX_LISTENERS);
+        return -1;
+    }
+    memmove(cfg->listen[1], cfg->listen[0], (size_t)cfg->num_listen * sizeof(cfg->listen[0]));
+    snprintf(cfg->listen[0], LISTEN_SPEC_MAX, strchr(pos[0], ':') ? "[%s]:%s" : "%s:%s", pos[0], pos[1]);
+    cfg->num_listen++;
+
+    // Canonicalize and validate document root.
+    if (canonical_dir(pos[2], cfg->doc_root) != 0) return -1;
+
+    return 0;
+}
+
+// Re-read config file and CLI; copy only settings safe to change live.
+int reload_arguments(server_config_t *cfg) {
+    if (!cfg) return -1;
+
+    server_config_t fresh;
+    if (load_arguments(cfg->argc, cfg->argv, &fresh) != 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < NUM_TUNABLES; i++) {
+        const tunable_t *t = &k_tunables[i];
+        if (!t->reloadable) continue;
+
+        size_t sz = (t->kind == KIND_INT) ? sizeof(int)
+                  : (t->kind == KIND_UINT) ? sizeof(unsigned)
+                  : (t->kind == KIND_SIZE) ? sizeof(size_t)
+                  : sizeof(double);
+        memcpy((char *)cfg + t->offset, (const char *)&fresh + t->offset, sz);
+    }
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+        if (!k_paths[i].reloadable) continue;
+        memcpy((char *)cfg + k_paths[i].offset, (const char *)&fresh + k_paths[i].offset, PATH_MAX);
+    }
+
+    return 0;
+}
@@ -0,0 +1,529 @@
+#include "dirindex.h"
+
+#include "util.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Hash buckets for URL lookup.
+#define DI_BUCKETS 256
+
+struct dir_listing {
+    char *key;               // url_dir, then '\n' + format tag
+    uint64_t hash;
+    char *dir_path;          // canonical directory path
+
+    // Identity/version of the directory this was rendered from.
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+
+    char *data;
+    size_t len;
+    int refs;                // Connections currently sending it
+    int detached;            // Out of the cache; freed on last release
+
+    dir_listing_t *hnext;
+    dir_listing_t *lru_prev; // Most recent at head
+    dir_listing_t *lru_next;
+};
+
+struct dir_index {
+    size_t budget;
+    size_t bytes;
+    dir_listing_t *buckets[DI_BUCKETS];
+    dir_listing_t *lru_head;
+    dir_listing_t *lru_tail;
+};
+
+// Growable output buffer; on allocation failure it stays failed.
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int failed;
+} outbuf_t;
+
+static void out_append(outbuf_t *o, const char *s, size_t n) {
+    if (o->failed) return;
+    if (o->len + n + 1 > o->cap) {
+        size_t cap = o->cap ? o->cap : 4096;
+        while (cap < o->len + n + 1) cap *= 2;
+        char *p = realloc(o->buf, cap);
+        if (!p) {
+            o->failed = 1;
+            return;
+        }
+        o->buf = p;
+        o->cap = cap;
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+    o->buf[o->len] = '\0';
+}
+
+static void out_str(outbuf_t *o, const char *s) {
+    out_append(o, s, strlen(s));
+}
+
+// Text with HTML special characters escaped.
+static void out_html(outbuf_t *o, const char *s) {
+    for (; *s; s++) {
+        switch (*s) {
+            case '&': out_str(o, "&amp;"); break;
+            case '<': out_str(o, "&lt;"); break;
+            case '>': out_str(o, "&gt;"); break;
+            case '"': out_str(o, "&quot;"); break;
+            case '\'': out_str(o, "&#39;"); break;
+            default: out_append(o, s, 1); break;
+        }
+    }
+}
+
+// Percent-encode s for an href; with keep_slash, '/' separators stay.
+static void out_url_keep(outbuf_t *o, const char *s, int keep_slash) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '~' || (c == '/' && keep_slash)) {
+            out_append(o, s, 1);
+        } else {
+            char e[3] = {'%', hex[c >> 4], hex[c & 15]};
+            out_append(o, e, 3);
+        }
+    }
+}
+
+// Path segment percent-encoded for use in an href.
+static void out_url(outbuf_t *o, const char *s) {
+    out_url_keep(o, s, 0);
+}
+
+// Decoded URL path, percent-encoded again segment by segment.
+static void out_url_path(outbuf_t *o, const char *s) {
+    out_url_keep(o, s, 1);
+}
+
+// JSON string body (without quotes).
+static void out_json(outbuf_t *o, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            char e[2] = {'\\', (char)c};
+            out_append(o, e, 2);
+        } else if (c < 0x20) {
+            char e[8];
+            snprintf(e, sizeof(e), "\\u%04x", c);
+            out_str(o, e);
+        } else {
+            out_append(o, s, 1);
+        }
+    }
+}
+
+// One directory entry to render.
+typedef struct {
+    char *name;
+    int is_dir;
+    off_t size;
+    time_t mtime;
+} entry_t;
+
+// Directories first, then byte order of names.
+static int entry_cmp(const void *a, const void *b) {
+    const entry_t *x = (const entry_t *)a;
+    const entry_t *y = (const entry_t *)b;
+    if (x->is_dir != y->is_dir) return y->is_dir - x->is_dir;
+    return strcmp(x->name, y->name);
+}
+
+// Read entries of dir_fd (hidden names skipped). Returns count or -1.
+static long read_entries(int dir_fd, entry_t **out) {
+    int fd = dup(dir_fd);
+    if (fd < 0) return -1;
+
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return -1;
+    }
+
+    entry_t *v = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+    struct dirent *de;
+    long rc = 0;
+
+    rewinddir(d);
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+
+        // Follow symlinks; entries that cannot be stat'ed are left out.
+        struct stat st;
+        if (fstatat(dirfd(d), de->d_name, &st, 0) != 0) continue;
+        if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) continue;
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            entry_t *p = realloc(v, cap * sizeof(*v));
+            if (!p) {
+                rc = -1;
+                break;
+            }
+            v = p;
+        }
+        v[n].name = strdup(de->d_name);
+        if (!v[n].name) {
+            rc = -1;
+            break;
+        }
+        v[n].is_dir = S_ISDIR(st.st_mode);
+        v[n].size = st.st_size;
+        v[n].mtime = st.st_mtim.tv_sec;
+        n++;
+    }
+    closedir(d);
+
+    if (rc < 0) {
+        for (size_t i = 0; i < n; i++) free(v[i].name);
+        free(v);
+        return -1;
+    }
+
+    if (n > 1) qsort(v, n, sizeof(*v), entry_cmp);
+    *out = v;
+    return (long)n;
+}
+
+struct dir_entries {
+    entry_t *v;
+    size_t n;
+};
+
+dir_entries_t *dir_entries_read(int dir_fd) {
+    if (dir_fd < 0) return NULL;
+
+    dir_entries_t *e = malloc(sizeof(*e));
+    if (!e) return NULL;
+    long n = read_entries(dir_fd, &e->v);
+    if (n < 0) {
+        free(e);
+        return NULL;
+    }
+    e->n = (size_t)n;
+    return e;
+}
+
+dir_entries_t *dir_entries_copy(const dir_entries_t *e) {
+    if (!e) return NULL;
+
+    dir_entries_t *c = malloc(sizeof(*c));
+    if (!c) return NULL;
+    c->n = 0;
+    c->v = e->n ? malloc(e->n * sizeof(*c->v)) : NULL;
+    if (e->n && !c->v) {
+        free(c);
+        return NULL;
+    }
+    for (; c->n < e->n; c->n++) {
+        c->v[c->n] = e->v[c->n];
+        c->v[c->n].name = strdup(e->v[c->n].name);
+        if (!c->v[c->n].name) {
+            dir_entries_free(c);
+            return NULL;
+        }
+    }
+    return c;
+}
+
+void dir_entries_free(dir_entries_t *e) {
+    if (!e) return;
+
+    for (size_t i = 0; i < e->n; i++) free(e->v[i].name);
+    free(e->v);
+    free(e);
+}
+
+static void render_html(outbuf_t *o, const char *url_dir, const entry_t *v, size_t n) {
+    char num[32];
+    char when[32];
+
+    out_str(o, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Index of ");
+    out_html(o, url_dir);
+    out_str(o, "</title></head>\n<body><h1>Index of ");
+    out_html(o, url_dir);
+    out_str(o, "</h1>\n<table>\n<tr><th>Name</th><th>Size</th><th>Modified</th></tr>\n");
+
+    // Parent link: drop the last segment rather than linking "..".
+    if (strcmp(url_dir, "/") != 0) {
+        size_t k = strlen(url_dir) - 1;
+        while (k > 0 && url_dir[k - 1] != '/') k--;
+        out_str(o, "<tr><td><a href=\"");
+        char *parent = strndup(url_dir, k);
+        if (parent) out_url_path(o, parent);
+        free(parent);
+        out_str(o, "\">../</a></td><td></td><td></td></tr>\n");
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        struct tm tm;
+        gmtime_r(&v[i].mtime, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm);
+
+        out_str(o, "<tr><td><a href=\"");
+        out_url_path(o, url_dir);
+        out_url(o, v[i].name);
+        if (v[i].is_dir) out_str(o, "/");
+        out_str(o, "\">");
+        out_html(o, v[i].name);
+        if (v[i].is_dir) out_str(o, "/");
+        out_str(o, "</a></td><td>");
+        if (v[i].is_dir) {
+            out_str(o, "-");
+        } else {
+            snprintf(num, sizeof(num), "%lld", (long long)v[i].size);
+            out_str(o, num);
+        }
+        out_str(o, "</td><td>");
+        out_str(o, when);
+        out_str(o, "</td></tr>\n");
+    }
+
+    out_str(o, "</table>\n</body></html>\n");
+}
+
+static void render_json(outbuf_t *o, const char *url_dir, const entry_t *v, size_t n) {
+    char num[32];
+    char when[32];
+
+    out_str(o, "{\"path\":\"");
+    out_json(o, url_dir);
+    out_str(o, "\",\"entries\":[");
+
+    for (size_t i = 0; i < n; i++) {
+        struct tm tm;
+        gmtime_r(&v[i].mtime, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+        out_str(o, i ? ",{\"name\":\"" : "{\"name\":\"");
+        out_json(o, v[i].name);
+        out_str(o, v[i].is_dir ? "\",\"type\":\"dir\"" : "\",\"type\":\"file\"");
+        snprintf(num, sizeof(num), ",\"size\":%lld", (long long)(v[i].is_dir ? 0 : v[i].size));
+        out_str(o, num);
+        out_str(o, ",\"mtime\":\"");
+        out_str(o, when);
+        out_str(o, "\"}");
+    }
+
+    out_str(o, "]}\n");
+}
+
+dir_index_t *dir_index_create(size_t budget) {
+    dir_index_t *di = calloc(1, sizeof(*di));
+    if (!di) return NULL;
+    di->budget = budget;
+    return di;
+}
+
+static void lru_unlink(dir_index_t *di, dir_listing_t *l) {
+    if (l->lru_prev) l->lru_prev->lru_next = l->lru_next;
+    else di->lru_head = l->lru_next;
+    if (l->lru_next) l->lru_next->lru_prev = l->lru_prev;
+    else di->lru_tail = l->lru_prev;
+    l->lru_prev = NULL;
+    l->lru_next = NULL;
+}
+
+static void lru_push_front(dir_index_t *di, dir_listing_t *l) {
+    l->lru_prev = NULL;
+    l->lru_next = di->lru_head;
+    if (di->lru_head) di->lru_head->lru_prev = l;
+    di->lru_head = l;
+    if (!di->lru_tail) di->lru_tail = l;
+}
+
+static void free_listing(dir_listing_t *l) {
+    free(l->key);
+    free(l->dir_path);
+    free(l->data);
+    free(l);
+}
+
+// Remove from hash and LRU; free now or when the last sender releases it.
+static void retire(dir_index_t *di, dir_listing_t *l) {
+    dir_listing_t **pp = &di->buckets[l->hash % DI_BUCKETS];
+    while (*pp && *pp != l) pp = &(*pp)->hnext;
+    if (*pp) *pp = l->hnext;
+
+    lru_unlink(di, l);
+    di->bytes -= l->len;
+
+    if (l->refs == 0) free_listing(l);
+    else l->detached = 1;
+}
+
+// Evict idle listings from the cold end until need more bytes fit.
+static void make_room(dir_index_t *di, size_t need) {
+    dir_listing_t *l = di->lru_tail;
+    while (l && di->bytes + need > di->budget) {
+        dir_listing_t *prev = l->lru_prev;
+        if (l->refs == 0) retire(di, l);
+        l = prev;
+    }
+}
+
+void dir_index_set_budget(dir_index_t *di, size_t budget) {
+    if (!di) return;
+    di->budget = budget;
+    make_room(di, 0);
+}
+
+dir_listing_t *dir_index_acquire(dir_index_t *di,
+                                 const char *url_dir,
+                                 const char *dir_path,
+                                 const struct stat *st,
+                                 int dir_fd,
+                                 dir_entries_t *entries,
+                                 int json) {
+    if (!di || !url_dir || !dir_path || !st || (dir_fd < 0 && !entries)) {
+        dir_entries_free(entries);
+        return NULL;
+    }
+
+    // Key: URL plus format tag (URLs never contain a raw newline).
+    size_t ulen = strlen(url_dir);
+    char *key = malloc(ulen + 3);
+    if (!key) {
+        dir_entries_free(entries);
+        return NULL;
+    }
+    memcpy(key, url_dir, ulen);
+    key[ulen] = '\n';
+    key[ulen + 1] = json ? 'j' : 'h';
+    key[ulen + 2] = '\0';
+    uint64_t h = hash_bytes(key, ulen + 2);
+
+    for (dir_listing_t *l = di->buckets[h % DI_BUCKETS]; l; l = l->hnext) {
+        if (l->hash != h || strcmp(l->key, key) != 0) continue;
+
+        // Entries added/removed/renamed since rendering: render again.
+        if (l->dev != st->st_dev || l->ino != st->st_ino ||
+            l->mtime.tv_sec != st->st_mtim.tv_sec || l->mtime.tv_nsec != st->st_mtim.tv_nsec) {
+            retire(di, l);
+            break;
+        }
+
+        free(key);
+        dir_entries_free(entries);
+        lru_unlink(di, l);
+        lru_push_front(di, l);
+        l->refs++;
+        return l;
+    }
+
+    if (!entries) entries = dir_entries_read(dir_fd);
+    if (!entries) {
+        free(key);
+        return NULL;
+    }
+
+    outbuf_t o = {0};
+    if (json) render_json(&o, url_dir, entries->v, entries->n);
+    else render_html(&o, url_dir, entries->v, entries->n);
+    dir_entries_free(entries);
+
+    dir_listing_t *l = calloc(1, sizeof(*l));
+    char *dp = strdup(dir_path);
+    if (!l || !dp || o.failed) {
+        free(l);
+        free(dp);
+        free(o.buf);
+        free(key);
+        return NULL;
+    }
+
+    l->key = key;
+    l->hash = h;
+    l->dir_path = dp;
+    l->dev = st->st_dev;
+    l->ino = st->st_ino;
+    l->mtime = st->st_mtim;
+    l->data = o.buf;
+    l->len = o.len;
+    l->refs = 1;
+
+    // Too big to keep (or caching off): owned by this one response.
+    make_room(di, l->len);
+    if (di->bytes + l->len > di->budget) {
+        l->detached = 1;
+        return l;
+    }
+
+    l->hnext = di->buckets[h % DI_BUCKETS];
+    di->buckets[h % DI_BUCKETS] = l;
+    lru_push_front(di, l);
+    di->bytes += l->len;
+    return l;
+}
+
+void dir_index_invalidate(dir_index_t *di, const char *path, int is_dir) {
+    if (!di || !path) return;
+
+    // A listing shows its entries' sizes and times, so a change to any
+    // entry (or to the directory itself) makes it stale.
+    size_t n = strlen(path);
+    const char *slash = strrchr(path, '/');
+    size_t parent = slash ? (size_t)(slash - path) : 0;
+
+    dir_listing_t *l = di->lru_head;
+    while (l) {
+        dir_listing_t *next = l->lru_next;
+        const char *d = l->dir_path;
+        int hit = (strncmp(d, path, n) == 0 && (d[n] == '\0' || (is_dir && d[n] == '/'))) ||
+                  (parent > 0 && strlen(d) == parent && strncmp(d, path, parent) == 0);
+        if (hit) retire(di, l);
+        l = next;
+    }
+}
+
+void dir_index_clear(dir_index_t *di) {
+    if (!di) return;
+
+    while (di->lru_head) retire(di, di->lru_head);
+}
+
+void dir_index_release(dir_index_t *di, dir_listing_t *l) {
+    if (!di || !l) return;
+
+    l->refs--;
+    if (l->refs == 0 && l->detached) free_listing(l);
+}
+
+const char *dir_listing_data(const dir_listing_t *l) {
+    return l->data ? l->data : "";
+}
+
+size_t dir_listing_size(const dir_listing_t *l) {
+    return l->len;
+}
+
+void dir_index_destroy(dir_index_t *di) {
+    if (!di) return;
+
+    for (size_t i = 0; i < DI_BUCKETS; i++) {
+        dir_listing_t *l = di->buckets[i];
+        while (l) {
+            dir_listing_t *next = l->hnext;
+            free_listing(l);
+            l = next;
+        }
+    }
+    free(di);
+}
@@ -0,0 +1,178 @@
+#include "errpage.h"
+
+#include "http.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Largest custom error page accepted from doc_root.
+#define MAX_CUSTOM_PAGE (64 * 1024)
+// Header block size limit for one prebuilt response.
+#define MAX_PAGE_HEADER 512
+
+// Statuses with a prebuilt response.
+static const int k_statuses[] = {400, 403, 404, 405, 429, 500, 503};
+#define NUM_PAGES (sizeof(k_statuses) / sizeof(k_statuses[0]))
+
+typedef struct {
+    char *buf;               // headers immediately followed by body
+    size_t hdr_len;
+    size_t total_len;
+    size_t date_off;         // offset of the Date value inside buf
+} error_page_t;
+
+struct error_pages {
+    error_page_t pages[NUM_PAGES];
+    time_t date_sec;         // Second the Date values were written for
+};
+
+static int page_index(int status) {
+    for (size_t i = 0; i < NUM_PAGES; i++) {
+        if (k_statuses[i] == status) return (int)i;
+    }
+    return -1;
+}
+
+// Read <doc_root>/<status>.html into a new buffer, if present.
+static char *load_custom_page(const char *doc_root, int status, size_t *len) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%d.html", doc_root, status) >= (int)sizeof(path)) {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > MAX_CUSTOM_PAGE) {
+        close(fd);
+        return NULL;
+    }
+
+    char *body = malloc((size_t)st.st_size + 1);
+    size_t got = 0;
+    while (body && got < (size_t)st.st_size) {
+        ssize_t r = read(fd, body + got, (size_t)st.st_size - got);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    close(fd);
+
+    if (body && got != (size_t)st.st_size) {
+        free(body);
+        return NULL;
+    }
+
+    *len = got;
+    return body;
+}
+
+// Build one status response into page.
+static int build_page(error_page_t *page, int status, const char *doc_root, int retry_after) {
+    char generated[256];
+    size_t body_len = 0;
+    char *custom = doc_root ? load_custom_page(doc_root, status, &body_len) : NULL;
+    const char *body = custom;
+
+    if (!custom) {
+        int n = snprintf(generated, sizeof(generated),
+                         "<html><body><h1>%d %s</h1></body></html>\n",
+                         status, http_reason_phrase(status));
+        if (n < 0 || (size_t)n >= sizeof(generated)) return -1;
+        body = generated;
+        body_len = (size_t)n;
+    }
+
+    char hdr[MAX_PAGE_HEADER];
+    int h = build_response_headers(hdr, sizeof(hdr), status,
+                                   "text/html; charset=utf-8",
+                                   (off_t)body_len,
+                                   status == 405);
+
+    // Load shedding tells clients when to come back.
+    if (h > 0 && status == 503) {
+        char secs[16];
+        snprintf(secs, sizeof(secs), "%d", retry_after);
+        h = append_response_header(hdr, sizeof(hdr), h, "Retry-After", secs);
+    }
+    const char *date = (h > 0) ? strstr(hdr, "\r\nDate: ") : NULL;
+    if (!date) {
+        free(custom);
+        return -1;
+    }
+
+    page->buf = malloc((size_t)h + body_len);
+    if (!page->buf) {
+        free(custom);
+        return -1;
+    }
+
+    memcpy(page->buf, hdr, (size_t)h);
+    memcpy(page->buf + h, body, body_len);
+    page->hdr_len = (size_t)h;
+    page->total_len = (size_t)h + body_len;
+    page->date_off = (size_t)(date - hdr) + strlen("\r\nDate: ");
+
+    free(custom);
+    return 0;
+}
+
+error_pages_t *error_pages_create(const char *doc_root, int retry_after) {
+    error_pages_t *ep = calloc(1, sizeof(*ep));
+    if (!ep) return NULL;
+
+    for (size_t i = 0; i < NUM_PAGES; i++) {
+        if (build_page(&ep->pages[i], k_statuses[i], doc_root, retry_after) != 0) {
+            error_pages_destroy(ep);
+            return NULL;
+        }
+    }
+
+    ep->date_sec = time(NULL);
+    return ep;
+}
+
+void error_pages_destroy(error_pages_t *ep) {
+    if (!ep) return;
+    for (size_t i = 0; i < NUM_PAGES; i++) free(ep->pages[i].buf);
+    free(ep);
+}
+
+// Rewrite the fixed-width Date value when the second changes. Responses
+// copy the header part out, so no sender ever reads these bytes.
+static void refresh_dates(error_pages_t *ep) {
+    time_t now = time(NULL);
+    if (now == ep->date_sec) return;
+    ep->date_sec = now;
+
+    char date[64];
+    format_http_date(date, sizeof(date));
+    size_t n = strlen(date);
+
+    for (size_t i = 0; i < NUM_PAGES; i++) {
+        // IMF-fixdate is always 29 bytes, so the layout never shifts.
+        memcpy(ep->pages[i].buf + ep->pages[i].date_off, date, n);
+    }
+}
+
+int error_page_get(error_pages_t *ep, int status, int is_head, char *hdr, size_t cap, const char **body,
+                   size_t *body_len) {
+    if (!ep) return -1;
+
+    int idx = page_index(status);
+    if (idx < 0) idx = page_index(500);
+
+    const error_page_t *page = &ep->pages[idx];
+    if (page->hdr_len > cap) return -1;
+    refresh_dates(ep);
+
+    memcpy(hdr, page->buf, page->hdr_len);
+    *body = page->buf + page->hdr_len;
+    *body_len = is_head ? 0 : page->total_len - page->hdr_len;
+    return (int)page->hdr_len;
+}
@@ -0,0 +1,310 @@
+#include "filecache.h"
+
+#include "util.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Hash buckets for path lookup.
+#define FC_BUCKETS 1024
+// Upper bound on tracked paths (loaded or merely counted).
+#define FC_MAX_ENTRIES 4096
+// Requests needed before a file is considered hot and gets loaded.
+#define FC_HOT_HITS 2
+
+struct fc_entry {
+    char *path;
+    uint64_t hash;
+
+    // Identity/version of the file this entry describes.
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+
+    void *data;              // private copy of the contents; NULL until hot
+    unsigned hits;
+    int refs;                // Connections currently sending from data
+    int detached;            // Out of the table; freed on last release
+
+    fc_entry_t *hnext;       // Bucket chain
+    fc_entry_t *lru_prev;    // LRU list, most recent at head
+    fc_entry_t *lru_next;
+};
+
+struct file_cache {
+    size_t budget;
+    size_t max_file;
+    size_t loaded_bytes;
+    size_t count;
+
+    fc_entry_t *buckets[FC_BUCKETS];
+    fc_entry_t *lru_head;
+    fc_entry_t *lru_tail;
+};
+
+file_cache_t *file_cache_create(size_t budget, size_t max_file) {
+    file_cache_t *fc = calloc(1, sizeof(*fc));
+    if (!fc) return NULL;
+
+    fc->budget = budget;
+    fc->max_file = max_file;
+    return fc;
+}
+
+// Same inode, size and mtime as when the entry was recorded.
+static int same_version(const fc_entry_t *e, const struct stat *st) {
+    return e->dev == st->st_dev &&
+           e->ino == st->st_ino &&
+           e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec &&
+           e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void lru_unlink(file_cache_t *fc, fc_entry_t *e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else fc->lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else fc->lru_tail = e->lru_prev;
+    e->lru_prev = NULL;
+    e->lru_next = NULL;
+}
+
+static void lru_push_front(file_cache_t *fc, fc_entry_t *e) {
+    e->lru_prev = NULL;
+    e->lru_next = fc->lru_head;
+    if (fc->lru_head) fc->lru_head->lru_prev = e;
+    fc->lru_head = e;
+    if (!fc->lru_tail) fc->lru_tail = e;
+}
+
+// Release the copy and memory of an entry that is no longer reachable.
+static void free_entry(file_cache_t *fc, fc_entry_t *e) {
+    if (e->data) {
+        free(e->data);
+        fc->loaded_bytes -= (size_t)e->size;
+    }
+    free(e->path);
+    free(e);
+}
+
+// Remove entry from hash and LRU; free now or when its last user releases it.
+static void retire_entry(file_cache_t *fc, fc_entry_t *e) {
+    fc_entry_t **pp = &fc->buckets[e->hash % FC_BUCKETS];
+    while (*pp && *pp != e) pp = &(*pp)->hnext;
+    if (*pp) *pp = e->hnext;
+
+    lru_unlink(fc, e);
+    fc->count--;
+
+    if (e->refs == 0) free_entry(fc, e);
+    else e->detached = 1;
+}
+
+// Evict idle entries from the cold end until need bytes fit the budget
+// (need == 0 only trims the entry count). Returns 0 if it fits.
+static int make_room(file_cache_t *fc, size_t need) {
+    fc_entry_t *e = fc->lru_tail;
+
+    while (e && (fc->loaded_bytes + need > fc->budget || fc->count >= FC_MAX_ENTRIES)) {
+        fc_entry_t *prev = e->lru_prev;
+        if (e->refs == 0) retire_entry(fc, e);
+        e = prev;
+    }
+
+    return (fc->loaded_bytes + need <= fc->budget) ? 0 : -1;
+}
+
+void file_cache_set_limits(file_cache_t *fc, size_t budget, size_t max_file) {
+    if (!fc) return;
+
+    fc->budget = budget;
+    fc->max_file = max_file;
+    (void)make_room(fc, 0);
+}
+
+static fc_entry_t *find_entry(file_cache_t *fc, const char *path, uint64_t h) {
+    for (fc_entry_t *e = fc->buckets[h % FC_BUCKETS]; e; e = e->hnext) {
+        if (e->hash == h && strcmp(e->path, path) == 0) return e;
+    }
+    return NULL;
+}
+
+static fc_entry_t *insert_entry(file_cache_t *fc, const char *path, uint64_t h, const struct stat *st) {
+    if (fc->count >= FC_MAX_ENTRIES) (void)make_room(fc, 0);
+
+    fc_entry_t *e = calloc(1, sizeof(*e));
+    if (!e) return NULL;
+
+    size_t n = strlen(path);
+    e->path = malloc(n + 1);
+    if (!e->path) {
+        free(e);
+        return NULL;
+    }
+    memcpy(e->path, path, n + 1);
+
+    e->hash = h;
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim;
+
+    e->hnext = fc->buckets[h % FC_BUCKETS];
+    fc->buckets[h % FC_BUCKETS] = e;
+    lru_push_front(fc, e);
+    fc->count++;
+    return e;
+}
+
+void *file_cache_load(int fd, const struct stat *st) {
+    if (st->st_size <= 0) return NULL;
+
+    size_t size = (size_t)st->st_size;
+    char *buf = malloc(size);
+    if (!buf) return NULL;
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t r = pread(fd, buf + got, size - got, (off_t)got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            free(buf);
+            return NULL;
+        }
+        got += (size_t)r;
+    }
+    return buf;
+}
+
+fc_entry_t *file_cache_acquire(file_cache_t *fc, const char *path, const struct stat *st, int fd) {
+    if (!fc || !path || !st || fd < 0) return NULL;
+
+    // Only non-empty regular files below the size threshold.
+    if (!S_ISREG(st->st_mode) || st->st_size <= 0 || (size_t)st->st_size > fc->max_file) {
+        return NULL;
+    }
+
+    uint64_t h = hash_bytes(path, strlen(path));
+    fc_entry_t *e = find_entry(fc, path, h);
+
+    // File changed on disk: old copy lives on for in-flight senders only.
+    if (e && !same_version(e, st)) {
+        retire_entry(fc, e);
+        e = NULL;
+    }
+
+    if (!e) {
+        e = insert_entry(fc, path, h, st);
+        if (!e) return NULL;
+    } else {
+        lru_unlink(fc, e);
+        lru_push_front(fc, e);
+    }
+
+    e->hits++;
+    if (!e->data && e->hits < FC_HOT_HITS) return NULL;
+
+    // Pin first so eviction below never picks this entry.
+    e->refs++;
+
+    if (!e->data) {
+        void *m = NULL;
+        if (make_room(fc, (size_t)e->size) == 0) m = file_cache_load(fd, st);
+        if (!m) {
+            e->refs--;
+            return NULL;
+        }
+
+        e->data = m;
+        fc->loaded_bytes += (size_t)e->size;
+    }
+
+    return e;
+}
+
+fc_entry_t *file_cache_acquire_loaded(file_cache_t *fc, const char *path, const struct stat *st) {
+    if (!fc || !path || !st) return NULL;
+
+    fc_entry_t *e = find_entry(fc, path, hash_bytes(path, strlen(path)));
+    if (!e || !e->data || !same_version(e, st)) return NULL;
+
+    lru_unlink(fc, e);
+    lru_push_front(fc, e);
+    e->hits++;
+    e->refs++;
+    return e;
+}
+
+int file_cache_adopt(file_cache_t *fc, const char *path, const struct stat *st, void *data) {
+    if (!fc || !path || !st || !data || st->st_size <= 0) return -1;
+    if ((size_t)st->st_size > fc->max_file) return -1;
+
+    uint64_t h = hash_bytes(path, strlen(path));
+    if (find_entry(fc, path, h)) return -1;
+    if (make_room(fc, (size_t)st->st_size) != 0) return -1;
+
+    fc_entry_t *e = insert_entry(fc, path, h, st);
+    if (!e) return -1;
+
+    e->data = data;
+    e->hits = FC_HOT_HITS;
+    fc->loaded_bytes += (size_t)st->st_size;
+    return 0;
+}
+
+void file_cache_invalidate(file_cache_t *fc, const char *path, int is_dir) {
+    if (!fc || !path) return;
+
+    size_t n = strlen(path);
+    fc_entry_t *e = find_entry(fc, path, hash_bytes(path, n));
+    if (e) retire_entry(fc, e);
+    if (!is_dir) return;
+
+    // Directory renamed/removed: everything below it.
+    e = fc->lru_head;
+    while (e) {
+        fc_entry_t *next = e->lru_next;
+        if (strncmp(e->path, path, n) == 0 && e->path[n] == '/') retire_entry(fc, e);
+        e = next;
+    }
+}
+
+void file_cache_clear(file_cache_t *fc) {
+    if (!fc) return;
+
+    while (fc->lru_head) retire_entry(fc, fc->lru_head);
+}
+
+void file_cache_release(file_cache_t *fc, fc_entry_t *e) {
+    if (!fc || !e) return;
+
+    e->refs--;
+    if (e->refs == 0 && e->detached) free_entry(fc, e);
+}
+
+const void *fc_entry_data(const fc_entry_t *e) {
+    return e->data;
+}
+
+size_t fc_entry_size(const fc_entry_t *e) {
+    return (size_t)e->size;
+}
+
+void file_cache_destroy(file_cache_t *fc) {
+    if (!fc) return;
+
+    for (size_t i = 0; i < FC_BUCKETS; i++) {
+        fc_entry_t *e = fc->buckets[i];
+        while (e) {
+            fc_entry_t *next = e->hnext;
+            free_entry(fc, e);
+            e = next;
+        }
+    }
+    free(fc);
+}
@@ -0,0 +1,518 @@
+// O_PATH is a GNU extension.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "fspool.h"
+
+#include "path.h"
+#include "rcu.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// In-flight lookups are found by key in this many hash chains.
+#define FLIGHT_BUCKETS 256
+
+// Testing aid: milliseconds every worker waits before each lookup, so a
+// test can act like a slow disk and have requests arrive while one runs.
+#define ENV_LOOKUP_DELAY "HTTPD_LOOKUP_DELAY_MS"
+
+// Another submitter of the same lookup, answered from its result.
+typedef struct fs_waiter {
+    int tag;
+    unsigned gen;
+    struct fs_waiter *next;
+} fs_waiter_t;
+
+// One queued lookup plus its result.
+typedef struct fs_job {
+    int tag;
+    unsigned gen;
+    const char *doc_root;
+    int root_fd;
+    const path_index_t *paths;
+    char target[PATH_MAX];
+    int flags;
+    fs_result_t res;
+    struct fs_job *next;
+
+    // Coalescing: normalized path (key_len 0 = not shared) and the
+    // flight chain it is on until a worker finishes it.
+    char key[PATH_MAX];
+    size_t key_len;
+    uint64_t key_hash;
+    int in_flight;
+    struct fs_job *flight_next;
+    fs_waiter_t *waiters;
+} fs_job_t;
+
+struct fs_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Pending jobs (FIFO).
+    fs_job_t *todo_head;
+    fs_job_t *todo_tail;
+
+    // Finished jobs waiting for the event loop (FIFO).
+    fs_job_t *done_head;
+    fs_job_t *done_tail;
+
+    size_t queued;           // jobs in the todo list
+    unsigned long run;       // lookups queued for a worker
+    unsigned long joined;    // submits that joined one instead
+
+    // Queued or running jobs that new submits may join.
+    fs_job_t *flights[FLIGHT_BUCKETS];
+
+    int stopping;
+    long delay_ms;           // ENV_LOOKUP_DELAY (0 = none)
+    int notify_pipe[2];      // [0] polled by loop, [1] written by workers
+
+    int nthreads;
+    pthread_t *threads;
+};
+
+// Map filesystem errno to HTTP status.
+static int status_from_errno(void) {
+    if (errno == ENOENT || errno == ENOTDIR) return 404;
+    // ENXIO/EAGAIN: a FIFO, socket or device that is not a file to serve.
+    if (errno == EACCES || errno == ENXIO || errno == EAGAIN) return 403;
+    return 500;
+}
+
+// Resolve, stat, and optionally open the requested file.
+static void open_target(const char *doc_root, int root_fd, const char *url_target, int flags, fs_result_t *out) {
+    out->fd = -1;
+    out->path[0] = '\0';
+
+    // Kernel-contained lookup relative to the root: open + fstat.
+    int fd = -1;
+    out->status = resolve_path_at(root_fd, doc_root, url_target, (flags & FS_ALLOW_DIR) != 0,
+                                  (flags & FS_WANT_FD) != 0, out->path, sizeof(out->path), &fd, &out->st);
+    if (out->status == 0) {
+        // HEAD only needs metadata, except that listings are rendered from the fd.
+        if (!(flags & FS_WANT_FD) && S_ISDIR(out->st.st_mode)) {
+            out->fd = openat(fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (out->fd < 0) out->status = status_from_errno();
+        } else if (flags & FS_WANT_FD) {
+            out->fd = fd;
+            fd = -1;
+        }
+        if (fd >= 0) close(fd);
+        return;
+    }
+    if (out->status > 0) {
+        if (out->status != 400 && out->status != 403 && out->status != 404) out->status = 500;
+        return;
+    }
+
+    // Resolve URL target under doc root safely.
+    out->status = resolve_path(doc_root, url_target, (flags & FS_ALLOW_DIR) != 0, out->path, sizeof(out->path));
+    if (out->status != 0) {
+        if (out->status != 400 && out->status != 403 && out->status != 404) out->status = 500;
+        return;
+    }
+
+    // HEAD only needs metadata, except that listings are rendered from the fd.
+    if (!(flags & FS_WANT_FD)) {
+        if (stat(out->path, &out->st) != 0) {
+            out->status = status_from_errno();
+            return;
+        }
+        if (!S_ISDIR(out->st.st_mode)) return;
+    }
+
+    // GET: open once and take metadata from the fd itself. Non-blocking,
+    // in case something other than a file was swapped in since the check.
+    out->fd = open(out->path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (out->fd < 0) {
+        out->status = status_from_errno();
+        return;
+    }
+    if (fstat(out->fd, &out->st) != 0) {
+        out->status = 500;
+    } else if (!S_ISREG(out->st.st_mode) && !(S_ISDIR(out->st.st_mode) && (flags & FS_ALLOW_DIR))) {
+        out->status = 403;
+    }
+    if (out->status != 0) {
+        close(out->fd);
+        out->fd = -1;
+    }
+}
+
+void fs_lookup(const char *doc_root, int root_fd, const char *url_target, int flags, fs_result_t *out) {
+    out->entries = NULL;
+    open_target(doc_root, root_fd, url_target, flags, out);
+
+    // Listings are rendered from these, so the event loop need not readdir.
+    if (out->status == 0 && (flags & FS_READ_DIR) && S_ISDIR(out->st.st_mode)) {
+        out->entries = dir_entries_read(out->fd);
+        if (!out->entries) {
+            out->status = 500;
+            close(out->fd);
+            out->fd = -1;
+        }
+    }
+}
+
+// Resolve through the path index: open the canonical path it remembers
+// and keep the result only if it is still the same regular file.
+// Returns 0 with out filled, -1 to fall back to fs_lookup.
+static int lookup_indexed(const path_index_t *paths, const char *url_target, int flags, fs_result_t *out) {
+    struct stat st;
+    size_t len = strcspn(url_target, "?#");
+    if (!(flags & FS_WANT_FD) ||
+        path_index_read(paths, url_target, len, out->path, sizeof(out->path), &st) != 0) {
+        return -1;
+    }
+
+    // Check what is there before opening it for reading (see path.h).
+    int f = open(out->path, O_PATH | O_CLOEXEC | O_NOFOLLOW);
+    if (f < 0) return -1;
+    if (fstat(f, &out->st) != 0 || !S_ISREG(out->st.st_mode) ||
+        out->st.st_dev != st.st_dev || out->st.st_ino != st.st_ino) {
+        close(f);
+        return -1;
+    }
+    out->fd = path_reopen(f, out->path, &out->st);
+    close(f);
+    if (out->fd < 0) return -1;
+    out->status = 0;
+    return 0;
+}
+
+// Under pool->lock: the in-flight job a submit for the same site,
+// flags and key can join, or NULL.
+static fs_job_t *find_flight(fs_pool_t *pool, const fs_job_t *job) {
+    fs_job_t *f = pool->flights[job->key_hash % FLIGHT_BUCKETS];
+    for (; f; f = f->flight_next) {
+        if (f->key_hash == job->key_hash && f->doc_root == job->doc_root && f->flags == job->flags &&
+            f->key_len == job->key_len && memcmp(f->key, job->key, job->key_len) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+// Under pool->lock: stop offering job to new submits.
+static void end_flight(fs_pool_t *pool, fs_job_t *job) {
+    if (!job->in_flight) return;
+
+    fs_job_t **pp = &pool->flights[job->key_hash % FLIGHT_BUCKETS];
+    while (*pp != job) pp = &(*pp)->flight_next;
+    *pp = job->flight_next;
+    job->in_flight = 0;
+}
+
+static void free_job(fs_job_t *job) {
+    while (job->waiters) {
+        fs_waiter_t *next = job->waiters->next;
+        free(job->waiters);
+        job->waiters = next;
+    }
+    free(job);
+}
+
+// Worker thread: pop jobs, run lookups, post completions.
+static void *worker_main(void *arg) {
+    fs_pool_t *pool = (fs_pool_t *)arg;
+
+    // Without a reader slot the path index is simply not consulted.
+    (void)rcu_register_reader();
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->todo_head && !pool->stopping) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (pool->stopping) break;
+
+        fs_job_t *job = pool->todo_head;
+        pool->todo_head = job->next;
+        if (!pool->todo_head) pool->todo_tail = NULL;
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        // Blocking filesystem work happens without the lock held.
+        if (pool->delay_ms > 0) {
+            struct timespec ts = {pool->delay_ms / 1000, (pool->delay_ms % 1000) * 1000000L};
+            nanosleep(&ts, NULL);
+        }
+        if (!job->paths || lookup_indexed(job->paths, job->target, job->flags, &job->res) != 0) {
+            fs_lookup(job->doc_root, job->root_fd, job->target, job->flags, &job->res);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        end_flight(pool, job);
+        job->next = NULL;
+        int was_empty = (pool->done_head == NULL);
+        if (pool->done_tail) pool->done_tail->next = job;
+        else pool->done_head = job;
+        pool->done_tail = job;
+
+        // One wakeup byte per batch is enough; EAGAIN means already signaled.
+        if (was_empty) {
+            char b = 1;
+            ssize_t w = write(pool->notify_pipe[1], &b, 1);
+            (void)w;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    rcu_unregister_reader();
+    return NULL;
+}
+
+// Start worker pool.
+fs_pool_t *fs_pool_create(int nthreads) {
+    if (nthreads <= 0) return NULL;
+
+    fs_pool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    pool->notify_pipe[0] = -1;
+    pool->notify_pipe[1] = -1;
+
+    if (pipe(pool->notify_pipe) != 0 ||
+        set_nonblocking(pool->notify_pipe[0]) != 0 ||
+        set_nonblocking(pool->notify_pipe[1]) != 0 ||
+        set_cloexec(pool->notify_pipe[0]) != 0 ||
+        set_cloexec(pool->notify_pipe[1]) != 0) {
+        if (pool->notify_pipe[0] >= 0) close(pool->notify_pipe[0]);
+        if (pool->notify_pipe[1] >= 0) close(pool->notify_pipe[1]);
+        free(pool);
+        return NULL;
+    }
+
+    pool->threads = calloc((size_t)nthreads, sizeof(*pool->threads));
+    if (!pool->threads) {
+        close(pool->notify_pipe[0]);
+        close(pool->notify_pipe[1]);
+        free(pool);
+        return NULL;
+    }
+
+    const char *delay = getenv(ENV_LOOKUP_DELAY);
+    if (delay && parse_long(delay, 0, 60000, &pool->delay_ms) != 0) pool->delay_ms = 0;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            break;
+        }
+        pool->nthreads++;
+    }
+
+    // Partial start is still usable; zero threads is not.
+    if (pool->nthreads == 0) {
+        fs_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+int fs_pool_notify_fd(const fs_pool_t *pool) {
+    return pool ? pool->notify_pipe[0] : -1;
+}
+
+// Queue a lookup for a worker.
+int fs_pool_submit(fs_pool_t *pool,
+                   int tag,
+                   unsigned gen,
+                   const char *doc_root,
+                   int root_fd,
+                   const path_index_t *paths,
+                   const char *url_target,
+                   int flags) {
+    if (!pool || !doc_root || !url_target) return -1;
+
+    fs_job_t *job = malloc(sizeof(*job));
+    if (!job) return -1;
+
+    // Same file, however the URL spelled it: normalized path as the key.
+    job->key_len = 0;
+    if (path_normalize(url_target, strlen(url_target), job->key, sizeof(job->key)) == 0) {
+        job->key_len = strlen(job->key);
+        job->key_hash = hash_bytes(job->key, job->key_len);
+    }
+    job->in_flight = 0;
+    job->flight_next = NULL;
+    job->waiters = NULL;
+
+    job->tag = tag;
+    job->gen = gen;
+    job->doc_root = doc_root;
+    job->root_fd = root_fd;
+    job->paths = paths;
+    snprintf(job->target, sizeof(job->target), "%s", url_target);
+    job->flags = flags;
+    job->res.fd = -1;
+    job->res.entries = NULL;
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    // The same lookup is already queued or running: wait for its result.
+    fs_job_t *flight = job->key_len ? find_flight(pool, job) : NULL;
+    if (flight) {
+        fs_waiter_t *w = malloc(sizeof(*w));
+        if (w) {
+            w->tag = tag;
+            w->gen = gen;
+            w->next = flight->waiters;
+            flight->waiters = w;
+            pool->joined++;
+            pthread_mutex_unlock(&pool->lock);
+            free(job);
+            return 0;
+        }
+    }
+    if (job->key_len) {
+        fs_job_t **b = &pool->flights[job->key_hash % FLIGHT_BUCKETS];
+        job->flight_next = *b;
+        *b = job;
+        job->in_flight = 1;
+    }
+
+    if (pool->todo_tail) pool->todo_tail->next = job;
+    else pool->todo_head = job;
+    pool->todo_tail = job;
+    pool->queued++;
+    pool->run++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+size_t fs_pool_queued(fs_pool_t *pool) {
+    if (!pool) return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    size_t n = pool->queued;
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
+
+void fs_pool_counts(fs_pool_t *pool, unsigned long *run, unsigned long *joined) {
+    *run = 0;
+    *joined = 0;
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    *run = pool->run;
+    *joined = pool->joined;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Drain wakeup bytes.
+void fs_pool_ack(fs_pool_t *pool) {
+    char buf[64];
+    while (read(pool->notify_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+void fs_pool_end_flights(fs_pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < FLIGHT_BUCKETS; i++) {
+        while (pool->flights[i]) end_flight(pool, pool->flights[i]);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Pop one completion: a waiter of the head job gets a copy (with its own
+// descriptor), the submitter itself gets the job's result last.
+int fs_pool_next_done(fs_pool_t *pool, int *tag, unsigned *gen, fs_result_t *out) {
+    // Only this thread removes jobs, and waiters are only added to jobs
+    // still in flight, so the head job can be read without the lock.
+    pthread_mutex_lock(&pool->lock);
+    fs_job_t *job = pool->done_head;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!job) return 0;
+
+    if (job->waiters) {
+        fs_waiter_t *w = job->waiters;
+        job->waiters = w->next;
+        *tag = w->tag;
+        *gen = w->gen;
+        free(w);
+
+        // Files are read at explicit offsets, so a duplicate is enough.
+        memcpy(out, &job->res, sizeof(*out));
+        if (job->res.fd >= 0) {
+            out->fd = fcntl(job->res.fd, F_DUPFD_CLOEXEC, 0);
+            if (out->fd < 0) out->status = 500;
+        }
+        if (job->res.entries) {
+            out->entries = dir_entries_copy(job->res.entries);
+            if (!out->entries) out->status = 500;
+        }
+        if (out->status != 0 && job->res.status == 0) {
+            if (out->fd >= 0) close(out->fd);
+            dir_entries_free(out->entries);
+            out->fd = -1;
+            out->entries = NULL;
+        }
+        return 1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->done_head = job->next;
+    if (!pool->done_head) pool->done_tail = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    *tag = job->tag;
+    *gen = job->gen;
+    memcpy(out, &job->res, sizeof(*out));
+    free(job);
+    return 1;
+}
+
+// Stop workers and free everything still queued.
+void fs_pool_destroy(fs_pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    while (pool->todo_head) {
+        fs_job_t *next = pool->todo_head->next;
+        free_job(pool->todo_head);
+        pool->todo_head = next;
+    }
+    while (pool->done_head) {
+        fs_job_t *next = pool->done_head->next;
+        if (pool->done_head->res.fd >= 0) close(pool->done_head->res.fd);
+        dir_entries_free(pool->done_head->res.entries);
+        free_job(pool->done_head);
+        pool->done_head = next;
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    close(pool->notify_pipe[0]);
+    close(pool->notify_pipe[1]);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,226 @@
+#include "fswatch.h"
+
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Watched roots kept for rescans after a queue overflow.
+#define FW_MAX_ROOTS 64
+
+// Changes that can make a cached path, stat or cached copy stale.
+#define FW_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                 IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+struct fs_watch {
+    int fd;
+    int healthy;
+
+    // Directory path per watch descriptor (wds are small and increasing).
+    char **dirs;
+    size_t ndirs;
+
+    char *roots[FW_MAX_ROOTS];
+    int nroots;
+};
+
+fs_watch_t *fs_watch_create(void) {
+    fs_watch_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    w->healthy = 1;
+    return w;
+}
+
+void fs_watch_destroy(fs_watch_t *w) {
+    if (!w) return;
+
+    close(w->fd);
+    for (size_t i = 0; i < w->ndirs; i++) free(w->dirs[i]);
+    for (int i = 0; i < w->nroots; i++) free(w->roots[i]);
+    free(w->dirs);
+    free(w);
+}
+
+// Remember path for wd. Returns 0 on success.
+static int set_dir(fs_watch_t *w, int wd, const char *path) {
+    if ((size_t)wd >= w->ndirs) {
+        size_t n = w->ndirs ? w->ndirs : 64;
+        while (n <= (size_t)wd) n *= 2;
+        char **p = realloc(w->dirs, n * sizeof(*p));
+        if (!p) return -1;
+        memset(p + w->ndirs, 0, (n - w->ndirs) * sizeof(*p));
+        w->dirs = p;
+        w->ndirs = n;
+    }
+
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    free(w->dirs[wd]);
+    w->dirs[wd] = copy;
+    return 0;
+}
+
+// Watch dir and everything below it (symlinks are not followed).
+static int add_dir(fs_watch_t *w, const char *dir) {
+    int wd = inotify_add_watch(w->fd, dir, FW_MASK);
+    if (wd < 0) {
+        // Gone again before we got to it: nothing left to watch.
+        if (errno == ENOENT || errno == ENOTDIR) return 0;
+        fprintf(stderr, "inotify watch on %s failed: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    if (set_dir(w, wd, dir) != 0) return -1;
+
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+
+    int rc = 0;
+    struct dirent *de;
+    while (rc == 0 && (de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        char sub[PATH_MAX];
+        if (snprintf(sub, sizeof(sub), "%s/%s", dir, de->d_name) >= (int)sizeof(sub)) continue;
+
+        struct stat st;
+        if (lstat(sub, &st) == 0 && S_ISDIR(st.st_mode)) rc = add_dir(w, sub);
+    }
+    closedir(d);
+    return rc;
+}
+
+int fs_watch_add_tree(fs_watch_t *w, const char *root) {
+    if (w->nroots < FW_MAX_ROOTS) {
+        w->roots[w->nroots] = strdup(root);
+        if (w->roots[w->nroots]) w->nroots++;
+    } else {
+        w->healthy = 0;
+    }
+
+    if (add_dir(w, root) != 0) w->healthy = 0;
+    return w->healthy ? 0 : -1;
+}
+
+// Forget watches at or below a directory that moved away.
+static void drop_tree(fs_watch_t *w, const char *dir) {
+    size_t n = strlen(dir);
+    for (size_t i = 0; i < w->ndirs; i++) {
+        const char *p = w->dirs[i];
+        if (p && strncmp(p, dir, n) == 0 && (p[n] == '\0' || p[n] == '/')) {
+            inotify_rm_watch(w->fd, (int)i);
+            free(w->dirs[i]);
+            w->dirs[i] = NULL;
+        }
+    }
+}
+
+int fs_watch_fd(const fs_watch_t *w) {
+    return w ? w->fd : -1;
+}
+
+int fs_watch_healthy(const fs_watch_t *w) {
+    return (w && w->healthy) ? 0 : -1;
+}
+
+void fs_watch_dispatch(fs_watch_t *w, fs_watch_cb cb, void *arg) {
+    _Alignas(struct inotify_event) char buf[16384];
+
+    for (;;) {
+        ssize_t n = read(w->fd, buf, sizeof(buf));
+        if (n <= 0) return;
+
+        for (char *p = buf; p < buf + n;) {
+            struct inotify_event *ev = (struct inotify_event *)(void *)p;
+            p += sizeof(*ev) + ev->len;
+
+            // Events were lost: rescan (new directories may be unwatched)
+            // and have every cache dropped.
+            if (ev->mask & IN_Q_OVERFLOW) {
+                w->healthy = 1;
+                for (int i = 0; i < w->nroots; i++) {
+                    if (add_dir(w, w->roots[i]) != 0) w->healthy = 0;
+                }
+                cb(NULL, 1, arg);
+                continue;
+            }
+
+            if (ev->wd < 0 || (size_t)ev->wd >= w->ndirs || !w->dirs[ev->wd]) continue;
+            const char *dir = w->dirs[ev->wd];
+
+            // Watch removed by the kernel (directory deleted or unmounted).
+            if (ev->mask & IN_IGNORED) {
+                free(w->dirs[ev->wd]);
+                w->dirs[ev->wd] = NULL;
+                continue;
+            }
+
+            char path[PATH_MAX];
+            int is_dir = (ev->mask & IN_ISDIR) != 0;
+            if (ev->len > 0 && ev->name[0] != '\0') {
+                if (snprintf(path, sizeof(path), "%s/%s", dir, ev->name) >= (int)sizeof(path)) continue;
+            } else {
+                snprintf(path, sizeof(path), "%s", dir);
+                is_dir = 1;
+            }
+
+            if (is_dir && (ev->mask & IN_MOVED_FROM)) drop_tree(w, path);
+
+            // New directory: watch it, then report it so anything cached
+            // from it before the watch existed is dropped too.
+            if (is_dir && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                if (add_dir(w, path) != 0) w->healthy = 0;
+            }
+
+            cb(path, is_dir, arg);
+        }
+    }
+}
+
+#else
+
+// No inotify: callers keep validating cached entries on every request.
+fs_watch_t *fs_watch_create(void) {
+    return NULL;
+}
+
+void fs_watch_destroy(fs_watch_t *w) {
+    (void)w;
+}
+
+int fs_watch_add_tree(fs_watch_t *w, const char *root) {
+    (void)w;
+    (void)root;
+    return -1;
+}
+
+int fs_watch_fd(const fs_watch_t *w) {
+    (void)w;
+    return -1;
+}
+
+void fs_watch_dispatch(fs_watch_t *w, fs_watch_cb cb, void *arg) {
+    (void)w;
+    (void)cb;
+    (void)arg;
+}
+
+int fs_watch_healthy(const fs_watch_t *w) {
+    (void)w;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,986 @@
+#include "h2.h"
+
+#include "hpack.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char k_preface[H2_PREFACE_LEN + 1] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// Frame types and flags.
+enum {
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9
+};
+
+enum {
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20
+};
+
+// Error codes (RST_STREAM / GOAWAY).
+enum {
+    ERR_NO_ERROR = 0x0,
+    ERR_PROTOCOL = 0x1,
+    ERR_INTERNAL = 0x2,
+    ERR_FLOW_CONTROL = 0x3,
+    ERR_FRAME_SIZE = 0x6,
+    ERR_REFUSED_STREAM = 0x7,
+    ERR_COMPRESSION = 0x9,
+    ERR_ENHANCE_YOUR_CALM = 0xb
+};
+
+// Settings identifiers.
+enum {
+    SET_HEADER_TABLE_SIZE = 0x1,
+    SET_ENABLE_PUSH = 0x2,
+    SET_MAX_CONCURRENT_STREAMS = 0x3,
+    SET_INITIAL_WINDOW_SIZE = 0x4,
+    SET_MAX_FRAME_SIZE = 0x5
+};
+
+#define FRAME_HEADER_LEN 9
+#define DEFAULT_WINDOW 65535
+#define WINDOW_MAX 0x7fffffffL
+
+// Largest header block (HEADERS + CONTINUATION) accepted.
+#define MAX_HEADER_BLOCK 65536
+
+// Stop adding DATA once this much output is queued.
+#define OUT_TARGET (4 * H2_FRAME_MAX)
+
+// Stop taking input while this much output waits for the peer.
+#define OUT_PAUSE (4 * OUT_TARGET)
+
+// Answers to the peer's frames (acks, window updates, resets) allowed to
+// wait unsent at once; a peer that sends more without reading is
+// flooding (PING/SETTINGS floods).
+#define MAX_PENDING_CONTROL 1000
+
+typedef enum { STREAM_FREE = 0, STREAM_PENDING, STREAM_SENDING } stream_state_t;
+
+typedef struct {
+    stream_state_t state;
+    uint32_t id;
+    int peer_done;           // client sent END_STREAM
+    int handed_out;          // h2_next_request returned it
+
+    // PENDING: the request head, until the server answers.
+    char *head;
+    size_t head_len;
+
+    // SENDING: the response body still to go.
+    void *resp;
+    uint64_t remaining;
+    long window;             // peer's flow-control window for this stream
+} h2_stream_t;
+
+// Request head assembled while a header block decodes.
+typedef struct {
+    int bad;                 // malformed request
+    int regular;             // a regular field was seen (pseudo must lead)
+    int has_host;
+    char method[16];
+    char *path;
+    size_t path_len;
+    char *authority;
+    size_t authority_len;
+    int scheme;
+    char *fields;            // "name: value\r\n" lines
+    size_t fields_len;
+    size_t fields_cap;
+} request_build_t;
+
+struct h2_conn {
+    const h2_body_ops_t *ops;
+    h2_stream_t *streams;
+    int max_streams;
+    int rr;                  // stream served first in the next DATA round
+
+    hpack_table_t *dec;      // fields the client indexed
+    hpack_table_t *enc;      // fields we indexed
+
+    // Received bytes not yet forming a whole frame.
+    unsigned char *in;
+    size_t in_len;
+    size_t in_cap;
+    int preface_seen;
+    int settings_seen;
+
+    // Header block split over HEADERS + CONTINUATION.
+    unsigned char *block;
+    size_t block_len;
+    uint32_t block_stream;
+    int block_end_stream;
+    int in_block;
+
+    // Frames waiting to be sent: out[out_off..out_len).
+    unsigned char *out;
+    size_t out_off;
+    size_t out_len;
+    size_t out_cap;
+    uint64_t sent_total;     // output bytes consumed so far
+
+    // Control frames queued since all earlier ones were sent, and the
+    // sent_total at which the last of them is out.
+    int ctl_pending;
+    uint64_t ctl_end;
+
+    long conn_window;        // peer's connection-level window
+    long initial_window;     // peer's SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t last_id;        // highest stream the client opened
+
+    int goaway;              // GOAWAY sent: no new streams
+    int peer_goaway;         // GOAWAY received
+    int dead;                // connection error: input ignored
+};
+
+int h2_is_preface(const void *buf, size_t len) {
+    if (len > H2_PREFACE_LEN) len = H2_PREFACE_LEN;
+    return memcmp(buf, k_preface, len) == 0;
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Room for need more output bytes. Returns NULL if memory runs out.
+static unsigned char *out_reserve(h2_conn_t *h, size_t need) {
+    if (h->out_off > 0 && h->out_len + need > h->out_cap) {
+        memmove(h->out, h->out + h->out_off, h->out_len - h->out_off);
+        h->out_len -= h->out_off;
+        h->out_off = 0;
+    }
+    if (h->out_len + need > h->out_cap) {
+        size_t cap = h->out_cap ? h->out_cap : OUT_TARGET;
+        while (cap < h->out_len + need) cap *= 2;
+        unsigned char *p = realloc(h->out, cap);
+        if (!p) return NULL;
+        h->out = p;
+        h->out_cap = cap;
+    }
+    return h->out + h->out_len;
+}
+
+// Queue a frame header for a len-byte payload the caller writes next
+// (within the returned reservation). NULL: out of memory, connection dead.
+static unsigned char *frame_begin(h2_conn_t *h, size_t len, int type, int flags, uint32_t id) {
+    unsigned char *p = out_reserve(h, FRAME_HEADER_LEN + len);
+    if (!p) {
+        h->dead = 1;
+        return NULL;
+    }
+    p[0] = (unsigned char)(len >> 16);
+    p[1] = (unsigned char)(len >> 8);
+    p[2] = (unsigned char)len;
+    p[3] = (unsigned char)type;
+    p[4] = (unsigned char)flags;
+    put32(p + 5, id & 0x7fffffffu);
+    h->out_len += FRAME_HEADER_LEN + len;
+    return p + FRAME_HEADER_LEN;
+}
+
+static void fail(h2_conn_t *h, uint32_t code);
+
+// frame_begin for a frame answering the peer. Fails the connection
+// instead once too many such frames wait unsent.
+static unsigned char *control_begin(h2_conn_t *h, size_t len, int type, int flags, uint32_t id) {
+    if (h->dead) return NULL;
+    if (h->ctl_pending >= MAX_PENDING_CONTROL) {
+        fail(h, ERR_ENHANCE_YOUR_CALM);
+        return NULL;
+    }
+    unsigned char *p = frame_begin(h, len, type, flags, id);
+    if (p) {
+        h->ctl_pending++;
+        h->ctl_end = h->sent_total + (h->out_len - h->out_off);
+    }
+    return p;
+}
+
+static void send_rst(h2_conn_t *h, uint32_t id, uint32_t code) {
+    unsigned char *p = control_begin(h, 4, FRAME_RST_STREAM, 0, id);
+    if (p) put32(p, code);
+}
+
+static void send_window_update(h2_conn_t *h, uint32_t id, uint32_t inc) {
+    unsigned char *p = control_begin(h, 4, FRAME_WINDOW_UPDATE, 0, id);
+    if (p) put32(p, inc);
+}
+
+// Connection error: say why and stop reading.
+static void fail(h2_conn_t *h, uint32_t code) {
+    if (h->dead) return;
+    unsigned char *p = frame_begin(h, 8, FRAME_GOAWAY, 0, 0);
+    if (p) {
+        put32(p, h->last_id);
+        put32(p + 4, code);
+    }
+    h->goaway = 1;
+    h->dead = 1;
+}
+
+h2_conn_t *h2_conn_create(const h2_body_ops_t *ops, int max_streams) {
+    h2_conn_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+
+    h->ops = ops;
+    h->max_streams = max_streams;
+    h->streams = calloc((size_t)max_streams, sizeof(*h->streams));
+    h->dec = hpack_table_create();
+    h->enc = hpack_table_create();
+    h->conn_window = DEFAULT_WINDOW;
+    h->initial_window = DEFAULT_WINDOW;
+    if (!h->streams || !h->dec || !h->enc) {
+        h2_conn_destroy(h);
+        return NULL;
+    }
+
+    // Our SETTINGS: the stream limit; everything else stays default.
+    unsigned char *p = frame_begin(h, 6, FRAME_SETTINGS, 0, 0);
+    if (!p) {
+        h2_conn_destroy(h);
+        return NULL;
+    }
+    p[0] = 0;
+    p[1] = SET_MAX_CONCURRENT_STREAMS;
+    put32(p + 2, (uint32_t)max_streams);
+    return h;
+}
+
+// Release a stream's request or response.
+static void stream_close(h2_conn_t *h, h2_stream_t *s) {
+    if (s->state == STREAM_SENDING) h->ops->close(s->resp);
+    free(s->head);
+    memset(s, 0, sizeof(*s));
+}
+
+void h2_conn_destroy(h2_conn_t *h) {
+    if (!h) return;
+    for (int i = 0; h->streams && i < h->max_streams; i++) stream_close(h, &h->streams[i]);
+    free(h->streams);
+    hpack_table_destroy(h->dec);
+    hpack_table_destroy(h->enc);
+    free(h->in);
+    free(h->block);
+    free(h->out);
+    free(h);
+}
+
+static h2_stream_t *find_stream(h2_conn_t *h, uint32_t id) {
+    for (int i = 0; i < h->max_streams; i++) {
+        if (h->streams[i].state != STREAM_FREE && h->streams[i].id == id) return &h->streams[i];
+    }
+    return NULL;
+}
+
+// Response fully sent: the client may still be sending, tell it to stop.
+static void stream_finish(h2_conn_t *h, h2_stream_t *s) {
+    if (!s->peer_done) send_rst(h, s->id, ERR_NO_ERROR);
+    stream_close(h, s);
+}
+
+// Append to a growing buffer. Returns 0, or -1 on allocation failure.
+static int append(char **buf, size_t *len, size_t *cap, const char *s, size_t n) {
+    if (*len + n > *cap) {
+        size_t c = *cap ? *cap : 256;
+        while (c < *len + n) c *= 2;
+        char *p = realloc(*buf, c);
+        if (!p) return -1;
+        *buf = p;
+        *cap = c;
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    return 0;
+}
+
+static int has_byte(const char *s, size_t n, int (*pred)(unsigned char)) {
+    for (size_t i = 0; i < n; i++) {
+        if (pred((unsigned char)s[i])) return 1;
+    }
+    return 0;
+}
+
+// Not allowed in a field name: uppercase, separators, controls.
+static int bad_name_byte(unsigned char c) {
+    return c <= ' ' || c >= 0x7f || (c >= 'A' && c <= 'Z') || c == ':';
+}
+
+// Not allowed in a value (they would split the HTTP/1.1 head).
+static int bad_value_byte(unsigned char c) {
+    return c == '\0' || c == '\r' || c == '\n';
+}
+
+// Not allowed in :method or :path (they sit in the request line).
+static int bad_token_byte(unsigned char c) {
+    return c <= ' ' || c >= 0x7f;
+}
+
+static int name_is(const char *name, size_t nl, const char *lit) {
+    return strlen(lit) == nl && memcmp(name, lit, nl) == 0;
+}
+
+// Keep a copy of a pseudo-header value; a repeat is malformed.
+static void set_pseudo(request_build_t *r, char **dst, size_t *dst_len, const char *v, size_t vl) {
+    if (*dst) {
+        r->bad = 1;
+        return;
+    }
+    *dst = malloc(vl + 1);
+    if (!*dst) {
+        r->bad = 1;
+        return;
+    }
+    memcpy(*dst, v, vl);
+    (*dst)[vl] = '\0';
+    *dst_len = vl;
+}
+
+// One request field (RFC 9113 8.2/8.3 checks).
+static void on_request_field(void *arg, const char *name, size_t nl, const char *value, size_t vl) {
+    request_build_t *r = arg;
+    if (r->bad) return;
+
+    if (has_byte(value, vl, bad_value_byte)) {
+        r->bad = 1;
+        return;
+    }
+
+    if (nl > 0 && name[0] == ':') {
+        if (r->regular) {
+            r->bad = 1;
+        } else if (name_is(name, nl, ":method")) {
+            if (r->method[0] || vl == 0 || vl >= sizeof(r->method) || has_byte(value, vl, bad_token_byte)) {
+                r->bad = 1;
+                return;
+            }
+            memcpy(r->method, value, vl);
+            r->method[vl] = '\0';
+        } else if (name_is(name, nl, ":path")) {
+            if (vl == 0 || has_byte(value, vl, bad_token_byte)) r->bad = 1;
+            else set_pseudo(r, &r->path, &r->path_len, value, vl);
+        } else if (name_is(name, nl, ":authority")) {
+            set_pseudo(r, &r->authority, &r->authority_len, value, vl);
+        } else if (name_is(name, nl, ":scheme")) {
+            if (r->scheme++) r->bad = 1;
+        } else {
+            r->bad = 1;
+        }
+        return;
+    }
+
+    r->regular = 1;
+    if (nl == 0 || has_byte(name, nl, bad_name_byte)) {
+        r->bad = 1;
+        return;
+    }
+
+    // Connection-specific fields have no place in HTTP/2.
+    if (name_is(name, nl, "connection") || name_is(name, nl, "keep-alive") ||
+        name_is(name, nl, "proxy-connection") || name_is(name, nl, "transfer-encoding") ||
+        name_is(name, nl, "upgrade") ||
+        (name_is(name, nl, "te") && !(vl == 8 && memcmp(value, "trailers", 8) == 0))) {
+        r->bad = 1;
+        return;
+    }
+    if (name_is(name, nl, "host")) r->has_host = 1;
+
+    if (append(&r->fields, &r->fields_len, &r->fields_cap, name, nl) != 0 ||
+        append(&r->fields, &r->fields_len, &r->fields_cap, ": ", 2) != 0 ||
+        append(&r->fields, &r->fields_len, &r->fields_cap, value, vl) != 0 ||
+        append(&r->fields, &r->fields_len, &r->fields_cap, "\r\n", 2) != 0) {
+        r->bad = 1;
+    }
+}
+
+// Fields of blocks we do not act on (trailers, refused streams).
+static void on_ignored_field(void *arg, const char *name, size_t nl, const char *value, size_t vl) {
+    (void)arg;
+    (void)name;
+    (void)nl;
+    (void)value;
+    (void)vl;
+}
+
+// "METHOD path HTTP/1.1", host from :authority, the fields, blank line.
+static char *build_head(request_build_t *r, size_t *len) {
+    char *head = NULL;
+    size_t hl = 0, cap = 0;
+    int ok = append(&head, &hl, &cap, r->method, strlen(r->method)) == 0 &&
+             append(&head, &hl, &cap, " ", 1) == 0 &&
+             append(&head, &hl, &cap, r->path, r->path_len) == 0 &&
+             append(&head, &hl, &cap, " HTTP/1.1\r\n", 11) == 0;
+    if (ok && r->authority && !r->has_host) {
+        ok = append(&head, &hl, &cap, "host: ", 6) == 0 &&
+             append(&head, &hl, &cap, r->authority, r->authority_len) == 0 &&
+             append(&head, &hl, &cap, "\r\n", 2) == 0;
+    }
+    if (ok && r->fields_len) ok = append(&head, &hl, &cap, r->fields, r->fields_len) == 0;
+    if (ok) ok = append(&head, &hl, &cap, "\r\n", 3) == 0; // with a NUL, not counted
+    if (!ok) {
+        free(head);
+        return NULL;
+    }
+    *len = hl - 1;
+    return head;
+}
+
+// A whole header block arrived for stream id.
+static void on_header_block(h2_conn_t *h, uint32_t id, int end_stream) {
+    h2_stream_t *s = find_stream(h, id);
+    int is_new = (id > h->last_id);
+
+    // Trailers, or a stream we already closed: decode to stay in sync.
+    if (!is_new) {
+        if (hpack_decode(h->dec, h->block, h->block_len, on_ignored_field, NULL) != 0) {
+            fail(h, ERR_COMPRESSION);
+            return;
+        }
+        if (s && end_stream) s->peer_done = 1;
+        return;
+    }
+    if ((id & 1) == 0) {
+        fail(h, ERR_PROTOCOL);
+        return;
+    }
+    h->last_id = id;
+
+    request_build_t r;
+    memset(&r, 0, sizeof(r));
+    if (hpack_decode(h->dec, h->block, h->block_len, on_request_field, &r) != 0) {
+        fail(h, ERR_COMPRESSION);
+    } else if (h->goaway || h->peer_goaway) {
+        // Past our GOAWAY: not processed.
+    } else if (r.bad || !r.method[0] || !r.path || !r.scheme) {
+        send_rst(h, id, ERR_PROTOCOL);
+    } else {
+        h2_stream_t *slot = NULL;
+        for (int i = 0; i < h->max_streams && !slot; i++) {
+            if (h->streams[i].state == STREAM_FREE) slot = &h->streams[i];
+        }
+        size_t head_len = 0;
+        char *head = slot ? build_head(&r, &head_len) : NULL;
+        if (!head) {
+            send_rst(h, id, ERR_REFUSED_STREAM);
+        } else {
+            slot->state = STREAM_PENDING;
+            slot->id = id;
+            slot->peer_done = end_stream;
+            slot->head = head;
+            slot->head_len = head_len;
+            slot->window = h->initial_window;
+        }
+    }
+    free(r.path);
+    free(r.authority);
+    free(r.fields);
+}
+
+// Collect a header block fragment; act on it once END_HEADERS is seen.
+static void header_fragment(h2_conn_t *h, const unsigned char *p, size_t n, int end_headers) {
+    if (h->block_len + n > MAX_HEADER_BLOCK) {
+        fail(h, ERR_ENHANCE_YOUR_CALM);
+        return;
+    }
+    if (!h->block) {
+        h->block = malloc(MAX_HEADER_BLOCK);
+        if (!h->block) {
+            fail(h, ERR_INTERNAL);
+            return;
+        }
+    }
+    memcpy(h->block + h->block_len, p, n);
+    h->block_len += n;
+
+    h->in_block = !end_headers;
+    if (end_headers) {
+        on_header_block(h, h->block_stream, h->block_end_stream);
+        h->block_len = 0;
+    }
+}
+
+// Strip PADDED padding. Returns 0, or -1 if the frame is malformed.
+static int unpad(int flags, const unsigned char **p, size_t *len) {
+    if (!(flags & FLAG_PADDED)) return 0;
+    if (*len < 1) return -1;
+    size_t pad = (*p)[0];
+    if (pad >= *len) return -1;
+    (*p)++;
+    *len -= 1 + pad;
+    return 0;
+}
+
+static void on_settings(h2_conn_t *h, int flags, const unsigned char *p, size_t len) {
+    if (flags & FLAG_ACK) {
+        if (len != 0) fail(h, ERR_FRAME_SIZE);
+        return;
+    }
+    if (len % 6 != 0) {
+        fail(h, ERR_FRAME_SIZE);
+        return;
+    }
+
+    for (size_t i = 0; i < len; i += 6) {
+        unsigned id = ((unsigned)p[i] << 8) | p[i + 1];
+        uint32_t v = get32(p + i + 2);
+        switch (id) {
+        case SET_HEADER_TABLE_SIZE:
+            hpack_set_max_size(h->enc, v);
+            break;
+        case SET_ENABLE_PUSH:
+            if (v > 1) {
+                fail(h, ERR_PROTOCOL);
+                return;
+            }
+            break;
+        case SET_INITIAL_WINDOW_SIZE:
+            if (v > WINDOW_MAX) {
+                fail(h, ERR_FLOW_CONTROL);
+                return;
+            }
+            // Applies to every open stream, as a delta.
+            for (int k = 0; k < h->max_streams; k++) {
+                h2_stream_t *s = &h->streams[k];
+                if (s->state == STREAM_FREE) continue;
+                s->window += (long)v - h->initial_window;
+                if (s->window > WINDOW_MAX) {
+                    fail(h, ERR_FLOW_CONTROL);
+                    return;
+                }
+            }
+            h->initial_window = (long)v;
+            break;
+        case SET_MAX_FRAME_SIZE:
+            if (v < H2_FRAME_MAX || v > 0xffffff) {
+                fail(h, ERR_PROTOCOL);
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    (void)control_begin(h, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+}
+
+static void on_window_update(h2_conn_t *h, uint32_t id, const unsigned char *p, size_t len) {
+    if (len != 4) {
+        fail(h, ERR_FRAME_SIZE);
+        return;
+    }
+    long inc = (long)(get32(p) & 0x7fffffffu);
+
+    if (id == 0) {
+        if (inc == 0 || h->conn_window + inc > WINDOW_MAX) {
+            fail(h, inc == 0 ? ERR_PROTOCOL : ERR_FLOW_CONTROL);
+            return;
+        }
+        h->conn_window += inc;
+        return;
+    }
+
+    if (id > h->last_id) {
+        fail(h, ERR_PROTOCOL);
+        return;
+    }
+    h2_stream_t *s = find_stream(h, id);
+    if (!s) return;
+    if (inc == 0 || s->window + inc > WINDOW_MAX) {
+        send_rst(h, id, inc == 0 ? ERR_PROTOCOL : ERR_FLOW_CONTROL);
+        stream_close(h, s);
+        return;
+    }
+    s->window += inc;
+}
+
+// One complete frame.
+static void on_frame(h2_conn_t *h, int type, int flags, uint32_t id, const unsigned char *p, size_t len) {
+    // The client's first frame must be SETTINGS.
+    if (!h->settings_seen) {
+        if (type != FRAME_SETTINGS || (flags & FLAG_ACK)) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        h->settings_seen = 1;
+    }
+
+    // Nothing may come between HEADERS and its CONTINUATIONs.
+    if (h->in_block != (type == FRAME_CONTINUATION) || (h->in_block && id != h->block_stream)) {
+        fail(h, ERR_PROTOCOL);
+        return;
+    }
+
+    switch (type) {
+    case FRAME_DATA: {
+        if (id == 0 || id > h->last_id) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        // Bodies are not used; hand the window straight back.
+        size_t credit = len;
+        if (unpad(flags, &p, &len) != 0) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        h2_stream_t *s = find_stream(h, id);
+        if (credit > 0) {
+            send_window_update(h, 0, (uint32_t)credit);
+            if (s && !(flags & FLAG_END_STREAM)) send_window_update(h, id, (uint32_t)credit);
+        }
+        if (s && (flags & FLAG_END_STREAM)) s->peer_done = 1;
+        return;
+    }
+    case FRAME_HEADERS:
+        if (id == 0) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        if (unpad(flags, &p, &len) != 0 || ((flags & FLAG_PRIORITY) && len < 5)) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        if (flags & FLAG_PRIORITY) {
+            p += 5;
+            len -= 5;
+        }
+        h->block_stream = id;
+        h->block_end_stream = (flags & FLAG_END_STREAM) != 0;
+        header_fragment(h, p, len, (flags & FLAG_END_HEADERS) != 0);
+        return;
+    case FRAME_CONTINUATION:
+        header_fragment(h, p, len, (flags & FLAG_END_HEADERS) != 0);
+        return;
+    case FRAME_PRIORITY:
+        if (id == 0) fail(h, ERR_PROTOCOL);
+        else if (len != 5) fail(h, ERR_FRAME_SIZE);
+        return;
+    case FRAME_RST_STREAM: {
+        if (id == 0 || id > h->last_id) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        if (len != 4) {
+            fail(h, ERR_FRAME_SIZE);
+            return;
+        }
+        h2_stream_t *s = find_stream(h, id);
+        if (s) stream_close(h, s);
+        return;
+    }
+    case FRAME_SETTINGS:
+        if (id != 0) fail(h, ERR_PROTOCOL);
+        else on_settings(h, flags, p, len);
+        return;
+    case FRAME_PUSH_PROMISE:
+        fail(h, ERR_PROTOCOL);
+        return;
+    case FRAME_PING:
+        if (id != 0) {
+            fail(h, ERR_PROTOCOL);
+        } else if (len != 8) {
+            fail(h, ERR_FRAME_SIZE);
+        } else if (!(flags & FLAG_ACK)) {
+            unsigned char *q = control_begin(h, 8, FRAME_PING, FLAG_ACK, 0);
+            if (q) memcpy(q, p, 8);
+        }
+        return;
+    case FRAME_GOAWAY:
+        if (id != 0) fail(h, ERR_PROTOCOL);
+        else h->peer_goaway = 1;
+        return;
+    case FRAME_WINDOW_UPDATE:
+        on_window_update(h, id, p, len);
+        return;
+    default:
+        return; // Unknown types are ignored.
+    }
+}
+
+void h2_feed(h2_conn_t *h, const void *data, size_t len) {
+    if (h->dead || len == 0) return;
+
+    // Frames are parsed straight from data; only a partial one is copied.
+    const unsigned char *p = data;
+    size_t n = len;
+    if (h->in_len > 0) {
+        if (h->in_len + len > h->in_cap) {
+            unsigned char *q = realloc(h->in, h->in_len + len);
+            if (!q) {
+                fail(h, ERR_INTERNAL);
+                return;
+            }
+            h->in = q;
+            h->in_cap = h->in_len + len;
+        }
+        memcpy(h->in + h->in_len, data, len);
+        h->in_len += len;
+        p = h->in;
+        n = h->in_len;
+    }
+
+    size_t pos = 0;
+    if (!h->preface_seen) {
+        if (!h2_is_preface(p, n)) {
+            fail(h, ERR_PROTOCOL);
+            return;
+        }
+        // Partial preface: keep it all and wait for the rest.
+        if (n >= H2_PREFACE_LEN) {
+            h->preface_seen = 1;
+            pos = H2_PREFACE_LEN;
+        }
+    }
+
+    while (pos + FRAME_HEADER_LEN <= n && !h->dead) {
+        size_t flen = ((size_t)p[pos] << 16) | ((size_t)p[pos + 1] << 8) | p[pos + 2];
+        if (flen > H2_FRAME_MAX) {
+            fail(h, ERR_FRAME_SIZE);
+            return;
+        }
+        if (pos + FRAME_HEADER_LEN + flen > n) break;
+
+        int type = p[pos + 3];
+        int flags = p[pos + 4];
+        uint32_t id = get32(p + pos + 5) & 0x7fffffffu;
+        on_frame(h, type, flags, id, p + pos + FRAME_HEADER_LEN, flen);
+        pos += FRAME_HEADER_LEN + flen;
+    }
+    if (h->dead) return;
+
+    // Keep the unparsed tail.
+    size_t rest = n - pos;
+    if (rest > 0 && p != h->in) {
+        if (rest > h->in_cap) {
+            unsigned char *q = realloc(h->in, rest);
+            if (!q) {
+                fail(h, ERR_INTERNAL);
+                return;
+            }
+            h->in = q;
+            h->in_cap = rest;
+        }
+        memcpy(h->in, p + pos, rest);
+    } else if (rest > 0) {
+        memmove(h->in, h->in + pos, rest);
+    }
+    h->in_len = rest;
+}
+
+uint32_t h2_next_request(h2_conn_t *h, const char **head, size_t *len) {
+    h2_stream_t *oldest = NULL;
+    for (int i = 0; i < h->max_streams; i++) {
+        h2_stream_t *s = &h->streams[i];
+        if (s->state == STREAM_PENDING && !s->handed_out && (!oldest || s->id < oldest->id)) oldest = s;
+    }
+    if (!oldest) return 0;
+
+    // Handed out once; the stream waits for h2_respond / h2_reset.
+    oldest->handed_out = 1;
+    *head = oldest->head;
+    *len = oldest->head_len;
+    return oldest->id;
+}
+
+// Headers that only describe the HTTP/1.1 connection.
+static int hop_by_hop(const char *name, size_t nl) {
+    return name_is(name, nl, "connection") || name_is(name, nl, "keep-alive") ||
+           name_is(name, nl, "proxy-connection") || name_is(name, nl, "transfer-encoding") ||
+           name_is(name, nl, "upgrade");
+}
+
+// Values that differ per response are not worth a table entry.
+static int worth_indexing(const char *name, size_t nl) {
+    return !name_is(name, nl, "content-length") && !name_is(name, nl, "etag") &&
+           !name_is(name, nl, "last-modified");
+}
+
+// HPACK-encode an HTTP/1.1 response head. Returns the block length or -1.
+static int encode_response_head(h2_conn_t *h, const char *head, size_t len, unsigned char *dst, size_t cap) {
+    const char *eol = memchr(head, '\n', len);
+    if (len < 12 || memcmp(head, "HTTP/1.", 7) != 0 || !eol) return -1;
+
+    size_t n = 0;
+    int w = hpack_encode(h->enc, dst, cap, ":status", 7, head + 9, 3, 1);
+    if (w < 0) return -1;
+    n += (size_t)w;
+
+    const char *p = eol + 1;
+    const char *end = head + len;
+    while (p < end) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        size_t ll = e ? (size_t)(e - p) : (size_t)(end - p);
+        const char *next = e ? e + 1 : end;
+        if (ll > 0 && p[ll - 1] == '\r') ll--;
+        if (ll == 0) break;
+
+        const char *colon = memchr(p, ':', ll);
+        if (colon) {
+            char name[64];
+            size_t nl = (size_t)(colon - p);
+            const char *v = colon + 1;
+            const char *ve = p + ll;
+            while (v < ve && (*v == ' ' || *v == '\t')) v++;
+            if (nl == 0 || nl >= sizeof(name)) return -1;
+            for (size_t i = 0; i < nl; i++) {
+                name[i] = (p[i] >= 'A' && p[i] <= 'Z') ? (char)(p[i] - 'A' + 'a') : p[i];
+            }
+            if (!hop_by_hop(name, nl)) {
+                w = hpack_encode(h->enc, dst + n, cap - n, name, nl, v, (size_t)(ve - v), worth_indexing(name, nl));
+                if (w < 0) return -1;
+                n += (size_t)w;
+            }
+        }
+        p = next;
+    }
+    return (int)n;
+}
+
+int h2_respond(h2_conn_t *h, uint32_t id, void *resp, const char *head, size_t head_len, uint64_t body_len) {
+    h2_stream_t *s = find_stream(h, id);
+    if (!s || s->state != STREAM_PENDING) {
+        h->ops->close(resp);
+        return -1;
+    }
+    free(s->head);
+    s->head = NULL;
+
+    // A header block never outgrows the text it came from by much.
+    size_t cap = head_len + 64;
+    unsigned char *block = malloc(cap);
+    int blen = block ? encode_response_head(h, head, head_len, block, cap) : -1;
+    if (blen < 0) {
+        // The encoder table may be ahead of the peer now: give up on the connection.
+        free(block);
+        h->ops->close(resp);
+        stream_close(h, s);
+        fail(h, ERR_INTERNAL);
+        return -1;
+    }
+
+    // HEADERS, then CONTINUATION for blocks over one frame.
+    size_t off = 0;
+    int type = FRAME_HEADERS;
+    do {
+        size_t chunk = (size_t)blen - off;
+        if (chunk > H2_FRAME_MAX) chunk = H2_FRAME_MAX;
+        int flags = (off + chunk == (size_t)blen) ? FLAG_END_HEADERS : 0;
+        if (type == FRAME_HEADERS && body_len == 0) flags |= FLAG_END_STREAM;
+        unsigned char *p = frame_begin(h, chunk, type, flags, id);
+        if (!p) break;
+        memcpy(p, block + off, chunk);
+        off += chunk;
+        type = FRAME_CONTINUATION;
+    } while (off < (size_t)blen);
+    free(block);
+
+    s->state = STREAM_SENDING;
+    s->resp = resp;
+    s->remaining = body_len;
+    if (body_len == 0) stream_finish(h, s);
+    return 0;
+}
+
+void h2_reset(h2_conn_t *h, uint32_t id) {
+    h2_stream_t *s = find_stream(h, id);
+    if (!s) return;
+    send_rst(h, id, ERR_INTERNAL);
+    stream_close(h, s);
+}
+
+// One DATA frame from each stream the windows allow. Returns 1 if any.
+static int data_round(h2_conn_t *h) {
+    int produced = 0;
+
+    for (int k = 0; k < h->max_streams && h->conn_window > 0 && !h->dead; k++) {
+        h2_stream_t *s = &h->streams[(h->rr + k) % h->max_streams];
+        if (s->state != STREAM_SENDING || s->remaining == 0 || s->window <= 0) continue;
+
+        size_t want = H2_FRAME_MAX;
+        if ((uint64_t)want > s->remaining) want = (size_t)s->remaining;
+        if ((long)want > s->window) want = (size_t)s->window;
+        if ((long)want > h->conn_window) want = (size_t)h->conn_window;
+
+        unsigned char *p = out_reserve(h, FRAME_HEADER_LEN + want);
+        if (!p) {
+            h->dead = 1;
+            return 0;
+        }
+        ssize_t got = h->ops->read(s->resp, p + FRAME_HEADER_LEN, want);
+        if (got <= 0 || (size_t)got > want) {
+            send_rst(h, s->id, ERR_INTERNAL);
+            stream_close(h, s);
+            continue;
+        }
+
+        // Header written after the read: a short read makes a short frame.
+        int last = ((uint64_t)got == s->remaining);
+        (void)frame_begin(h, (size_t)got, FRAME_DATA, last ? FLAG_END_STREAM : 0, s->id);
+        s->remaining -= (uint64_t)got;
+        s->window -= got;
+        h->conn_window -= got;
+        produced = 1;
+        if (last) stream_finish(h, s);
+    }
+    h->rr = (h->rr + 1) % h->max_streams;
+    return produced;
+}
+
+size_t h2_output(h2_conn_t *h, const void **data) {
+    while (!h->dead && h->out_len - h->out_off < OUT_TARGET && data_round(h)) {
+    }
+    *data = h->out + h->out_off;
+    return h->out_len - h->out_off;
+}
+
+void h2_consume(h2_conn_t *h, size_t n) {
+    h->sent_total += n;
+    if (h->sent_total >= h->ctl_end) h->ctl_pending = 0;
+    h->out_off += n;
+    if (h->out_off >= h->out_len) {
+        h->out_off = 0;
+        h->out_len = 0;
+    }
+}
+
+int h2_input_paused(const h2_conn_t *h) {
+    return h->out_len - h->out_off >= OUT_PAUSE;
+}
+
+void h2_shutdown(h2_conn_t *h) {
+    if (h->goaway || h->dead) return;
+    unsigned char *p = frame_begin(h, 8, FRAME_GOAWAY, 0, 0);
+    if (p) {
+        put32(p, h->last_id);
+        put32(p + 4, ERR_NO_ERROR);
+    }
+    h->goaway = 1;
+}
+
+int h2_finished(const h2_conn_t *h) {
+    if (h->out_len > h->out_off) return 0;
+    if (h->dead) return 1;
+    if (!h->goaway && !h->peer_goaway) return 0;
+    for (int i = 0; i < h->max_streams; i++) {
+        if (h->streams[i].state != STREAM_FREE) return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,375 @@
+#include "hpack.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Every entry costs at least 32 bytes, which bounds the entry count.
+#define HPACK_ENTRY_OVERHEAD 32
+#define HPACK_MAX_ENTRIES (HPACK_TABLE_SIZE / HPACK_ENTRY_OVERHEAD)
+
+// Integers beyond this are not valid lengths or indexes here.
+#define HPACK_INT_MAX (1u << 28)
+
+typedef struct {
+    char *data;              // name, then value
+    size_t name_len;
+    size_t value_len;
+} hpack_entry_t;
+
+struct hpack_table {
+    hpack_entry_t e[HPACK_MAX_ENTRIES];
+    size_t newest;           // slot of dynamic index 1
+    size_t count;
+    size_t size;             // RFC 7541 size of all entries
+    size_t max;              // current maximum size
+
+    // Encoder: size changes not yet signalled (smallest, then final).
+    int update;
+    size_t update_min;
+
+    // Decoder: decoded strings of the field being processed.
+    char *scratch;
+    size_t scratch_cap;
+};
+
+typedef struct {
+    const char *name;
+    const char *value;
+} hpack_static_t;
+
+// RFC 7541 Appendix A; index 1 is the first entry.
+static const hpack_static_t k_static[] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""}, {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""},
+    {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""},
+    {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""},
+    {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""},
+    {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+    {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+    {"www-authenticate", ""},
+};
+
+#define NUM_STATIC (sizeof(k_static) / sizeof(k_static[0]))
+
+// The Huffman code (Appendix B) is canonical: codes of one length are
+// consecutive and ordered by symbol, so these two tables decode it.
+
+// Number of codes of each bit length (1..30).
+static const unsigned char k_huff_count[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+    0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+
+// Symbols in code order (256 = EOS).
+static const unsigned short k_huff_sym[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+    52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+    110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+    119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+    43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+    179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+    163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+    158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+    144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+    212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+    2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+    256,
+};
+
+hpack_table_t *hpack_table_create(void) {
+    hpack_table_t *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->max = HPACK_TABLE_SIZE;
+    return t;
+}
+
+void hpack_table_destroy(hpack_table_t *t) {
+    if (!t) return;
+    for (size_t i = 0; i < t->count; i++) {
+        free(t->e[(t->newest + HPACK_MAX_ENTRIES - i) % HPACK_MAX_ENTRIES].data);
+    }
+    free(t->scratch);
+    free(t);
+}
+
+// Drop oldest entries until extra more bytes fit under max.
+static void evict(hpack_table_t *t, size_t extra) {
+    while (t->count > 0 && t->size + extra > t->max) {
+        hpack_entry_t *old = &t->e[(t->newest + HPACK_MAX_ENTRIES - (t->count - 1)) % HPACK_MAX_ENTRIES];
+        t->size -= HPACK_ENTRY_OVERHEAD + old->name_len + old->value_len;
+        free(old->data);
+        old->data = NULL;
+        t->count--;
+    }
+}
+
+// Insert as dynamic index 1. An entry larger than the table empties it.
+static void add_entry(hpack_table_t *t, const char *name, size_t nl, const char *value, size_t vl) {
+    size_t need = HPACK_ENTRY_OVERHEAD + nl + vl;
+    if (need > t->max) {
+        evict(t, t->max + 1);
+        return;
+    }
+
+    // Copy first: name may point into an entry that is about to go.
+    char *data = malloc(nl + vl + 1);
+    if (!data) {
+        // Keep both sides in step by forgetting everything instead.
+        evict(t, t->max + 1);
+        return;
+    }
+    memcpy(data, name, nl);
+    memcpy(data + nl, value, vl);
+
+    evict(t, need);
+    t->newest = (t->newest + 1) % HPACK_MAX_ENTRIES;
+    t->e[t->newest].data = data;
+    t->e[t->newest].name_len = nl;
+    t->e[t->newest].value_len = vl;
+    t->count++;
+    t->size += need;
+}
+
+// Entry at combined index (static first). Returns 0, or -1 if out of range.
+static int lookup(const hpack_table_t *t, size_t idx, const char **name, size_t *nl,
+                  const char **value, size_t *vl) {
+    if (idx == 0) return -1;
+    if (idx <= NUM_STATIC) {
+        *name = k_static[idx - 1].name;
+        *nl = strlen(*name);
+        *value = k_static[idx - 1].value;
+        *vl = strlen(*value);
+        return 0;
+    }
+    idx -= NUM_STATIC;
+    if (idx > t->count) return -1;
+    const hpack_entry_t *e = &t->e[(t->newest + HPACK_MAX_ENTRIES - (idx - 1)) % HPACK_MAX_ENTRIES];
+    *name = e->data;
+    *nl = e->name_len;
+    *value = e->data + e->name_len;
+    *vl = e->value_len;
+    return 0;
+}
+
+// Integer with an N-bit prefix (RFC 7541 5.1).
+static int decode_int(const unsigned char **p, const unsigned char *end, int prefix, size_t *out) {
+    if (*p >= end) return -1;
+
+    size_t max = ((size_t)1 << prefix) - 1;
+    size_t v = *(*p)++ & max;
+    if (v < max) {
+        *out = v;
+        return 0;
+    }
+
+    for (unsigned shift = 0; *p < end && shift <= 28; shift += 7) {
+        unsigned char b = *(*p)++;
+        v += (size_t)(b & 0x7f) << shift;
+        if (v > HPACK_INT_MAX) return -1;
+        if (!(b & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Huffman-decode len bytes into out. Returns the decoded length or -1.
+static long huff_decode(const unsigned char *in, size_t len, char *out) {
+    unsigned code = 0, first = 0, index = 0, bits = 0;
+    long n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 7; b >= 0; b--) {
+            code = (code << 1) | ((in[i] >> b) & 1u);
+            bits++;
+            unsigned count = k_huff_count[bits];
+            if (code - first < count) {
+                unsigned sym = k_huff_sym[index + code - first];
+                if (sym == 256) return -1; // EOS inside a string
+                out[n++] = (char)sym;
+                code = first = index = bits = 0;
+                continue;
+            }
+            if (bits == 30) return -1;
+            index += count;
+            first = (first + count) << 1;
+        }
+    }
+
+    // Padding: under a byte of ones (a prefix of EOS).
+    if (bits > 7 || code != (1u << bits) - 1) return -1;
+    return n;
+}
+
+// String literal (RFC 7541 5.2), decoded into the scratch buffer at *off.
+static int decode_string(hpack_table_t *t, const unsigned char **p, const unsigned char *end,
+                         size_t *off, const char **s, size_t *len) {
+    if (*p >= end) return -1;
+
+    int huff = (**p & 0x80) != 0;
+    size_t n;
+    if (decode_int(p, end, 7, &n) != 0 || n > (size_t)(end - *p)) return -1;
+
+    char *dst = t->scratch + *off;
+    if (huff) {
+        long d = huff_decode(*p, n, dst);
+        if (d < 0) return -1;
+        *len = (size_t)d;
+    } else {
+        memcpy(dst, *p, n);
+        *len = n;
+    }
+    *s = dst;
+    *off += *len;
+    *p += n;
+    return 0;
+}
+
+int hpack_decode(hpack_table_t *t, const unsigned char *in, size_t len, hpack_field_fn fn, void *arg) {
+    // Huffman expands at most 8/5, so twice the block holds any field.
+    size_t need = len * 2 + 1;
+    if (t->scratch_cap < need) {
+        char *s = realloc(t->scratch, need);
+        if (!s) return -1;
+        t->scratch = s;
+        t->scratch_cap = need;
+    }
+
+    const unsigned char *p = in;
+    const unsigned char *end = in + len;
+    int fields = 0;
+
+    while (p < end) {
+        unsigned char b = *p;
+        const char *name, *value;
+        size_t nl, vl, idx;
+        size_t off = 0;
+
+        // Indexed field.
+        if (b & 0x80) {
+            if (decode_int(&p, end, 7, &idx) != 0 || lookup(t, idx, &name, &nl, &value, &vl) != 0) return -1;
+            fn(arg, name, nl, value, vl);
+            fields++;
+            continue;
+        }
+
+        // Table size update: only ahead of the first field.
+        if ((b & 0xe0) == 0x20) {
+            if (fields > 0 || decode_int(&p, end, 5, &idx) != 0 || idx > HPACK_TABLE_SIZE) return -1;
+            t->max = idx;
+            evict(t, 0);
+            continue;
+        }
+
+        // Literal: with incremental indexing, without, or never indexed.
+        int incremental = (b & 0xc0) == 0x40;
+        if (decode_int(&p, end, incremental ? 6 : 4, &idx) != 0) return -1;
+        if (idx > 0) {
+            if (lookup(t, idx, &name, &nl, &value, &vl) != 0) return -1;
+        } else if (decode_string(t, &p, end, &off, &name, &nl) != 0) {
+            return -1;
+        }
+        if (decode_string(t, &p, end, &off, &value, &vl) != 0) return -1;
+
+        fn(arg, name, nl, value, vl);
+        fields++;
+        if (incremental) add_entry(t, name, nl, value, vl);
+    }
+    return 0;
+}
+
+void hpack_set_max_size(hpack_table_t *t, size_t size) {
+    if (size > HPACK_TABLE_SIZE) size = HPACK_TABLE_SIZE;
+    if (size == t->max) return;
+
+    if (!t->update || size < t->update_min) t->update_min = size;
+    t->update = 1;
+    t->max = size;
+    evict(t, 0);
+}
+
+// Integer with an N-bit prefix; high holds the pattern bits above it.
+static int encode_int(unsigned char *dst, size_t cap, size_t *n, int prefix, unsigned char high, size_t v) {
+    size_t max = ((size_t)1 << prefix) - 1;
+    if (*n >= cap) return -1;
+    if (v < max) {
+        dst[(*n)++] = (unsigned char)(high | v);
+        return 0;
+    }
+    dst[(*n)++] = (unsigned char)(high | max);
+    v -= max;
+    while (v >= 0x80) {
+        if (*n >= cap) return -1;
+        dst[(*n)++] = (unsigned char)(0x80 | (v & 0x7f));
+        v >>= 7;
+    }
+    if (*n >= cap) return -1;
+    dst[(*n)++] = (unsigned char)v;
+    return 0;
+}
+
+// Raw (not Huffman) string literal.
+static int encode_string(unsigned char *dst, size_t cap, size_t *n, const char *s, size_t len) {
+    if (encode_int(dst, cap, n, 7, 0, len) != 0 || cap - *n < len) return -1;
+    memcpy(dst + *n, s, len);
+    *n += len;
+    return 0;
+}
+
+// Index of an exact match (0 if none); *name_idx gets a name-only match.
+static size_t find(const hpack_table_t *t, const char *name, size_t nl, const char *value, size_t vl,
+                   size_t *name_idx) {
+    *name_idx = 0;
+    for (size_t i = 0; i < NUM_STATIC; i++) {
+        if (strlen(k_static[i].name) != nl || memcmp(k_static[i].name, name, nl) != 0) continue;
+        if (strlen(k_static[i].value) == vl && memcmp(k_static[i].value, value, vl) == 0) return i + 1;
+        if (!*name_idx) *name_idx = i + 1;
+    }
+    for (size_t i = 0; i < t->count; i++) {
+        const hpack_entry_t *e = &t->e[(t->newest + HPACK_MAX_ENTRIES - i) % HPACK_MAX_ENTRIES];
+        if (e->name_len != nl || memcmp(e->data, name, nl) != 0) continue;
+        if (e->value_len == vl && memcmp(e->data + nl, value, vl) == 0) return NUM_STATIC + i + 1;
+        if (!*name_idx) *name_idx = NUM_STATIC + i + 1;
+    }
+    return 0;
+}
+
+int hpack_encode(hpack_table_t *t, unsigned char *dst, size_t cap,
+                 const char *name, size_t name_len, const char *value, size_t value_len, int index) {
+    size_t n = 0;
+
+    // Pending table size changes lead the block.
+    if (t->update) {
+        if (t->update_min < t->max && encode_int(dst, cap, &n, 5, 0x20, t->update_min) != 0) return -1;
+        if (encode_int(dst, cap, &n, 5, 0x20, t->max) != 0) return -1;
+    }
+
+    size_t name_idx;
+    size_t idx = find(t, name, name_len, value, value_len, &name_idx);
+    if (idx) {
+        if (encode_int(dst, cap, &n, 7, 0x80, idx) != 0) return -1;
+    } else {
+        int rc = index ? encode_int(dst, cap, &n, 6, 0x40, name_idx) : encode_int(dst, cap, &n, 4, 0, name_idx);
+        if (rc != 0) return -1;
+        if (!name_idx && encode_string(dst, cap, &n, name, name_len) != 0) return -1;
+        if (encode_string(dst, cap, &n, value, value_len) != 0) return -1;
+        if (index) add_entry(t, name, name_len, value, value_len);
+    }
+
+    t->update = 0;
+    return (int)n;
+}
@@ -16,6 +16,105 @@ static int find_request_line_end(const char *raw, size_t raw_len) {
     return -1;
 }
 
+// Normalize a Host value into host: lowercase, port and trailing dot
+// removed. Returns 0, or 400 if it is not a plausible host name/literal.
+static int normalize_host(const char *v, size_t n, char *host, size_t cap) {
+    // Strip port: after ']' for IPv6 literals, else after the only ':'.
+    const char *end = v + n;
+    const char *colon = NULL;
+    if (n > 0 && v[0] == '[') {
+        const char *rb = memchr(v, ']', n);
+        if (!rb) return 400;
+        if (rb + 1 < end) {
+            if (rb[1] != ':') return 400;
+            colon = rb + 1;
+        }
+    } else {
+        colon = memchr(v, ':', n);
+    }
+    if (colon) {
+        for (const char *p = colon + 1; p < end; p++) {
+            if (!isdigit((unsigned char)*p)) return 400;
+        }
+        end = colon;
+    }
+    if (end > v && end[-1] == '.') end--;
+
+    size_t len = (size_t)(end - v);
+    if (len == 0 || len >= cap) return 400;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)v[i];
+        if (!isalnum(c) && c != '-' && c != '.' && c != '_' &&
+            c != '[' && c != ']' && c != ':') {
+            return 400;
+        }
+        host[i] = (char)tolower(c);
+    }
+    host[len] = '\0';
+    return 0;
+}
+
+// 1 if an Accept-Encoding value lists gzip without q=0.
+static int accepts_gzip(const char *v, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        // One comma-separated item: name[;q=...]
+        size_t start = i;
+        while (i < n && v[i] != ',') i++;
+        size_t item_end = i++;
+
+        while (start < item_end && (v[start] == ' ' || v[start] == '\t')) start++;
+        size_t name_end = start;
+        while (name_end < item_end && v[name_end] != ';' && v[name_end] != ' ' && v[name_end] != '\t') name_end++;
+        if (name_end - start != 4 || strncasecmp(v + start, "gzip", 4) != 0) continue;
+
+        // Rejected only by an explicit zero weight.
+        size_t q = name_end;
+        while (q < item_end && (v[q] == ';' || v[q] == ' ' || v[q] == '\t')) q++;
+        if (item_end - q < 2 || strncasecmp(v + q, "q=", 2) != 0) return 1;
+        for (q += 2; q < item_end; q++) {
+            if (v[q] >= '1' && v[q] <= '9') return 1;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+// Scan the lines after the request line for the headers we use.
+// Host: absent is fine (""); duplicates or bad values give 400.
+static int parse_headers(const char *raw, size_t raw_len, size_t pos, http_request_t *out) {
+    char *host = out->host;
+    size_t cap = sizeof(out->host);
+    int seen = 0;
+    host[0] = '\0';
+    out->accept_gzip = 0;
+
+    while (pos < raw_len) {
+        const char *line = raw + pos;
+        const char *eol = memchr(line, '\n', raw_len - pos);
+        size_t len = eol ? (size_t)(eol - line) : raw_len - pos;
+        pos += len + 1;
+        if (len > 0 && line[len - 1] == '\r') len--;
+        if (len == 0) break; // End of headers.
+
+        if (len >= 16 && strncasecmp(line, "accept-encoding:", 16) == 0) {
+            if (accepts_gzip(line + 16, len - 16)) out->accept_gzip = 1;
+            continue;
+        }
+
+        if (len < 5 || strncasecmp(line, "host:", 5) != 0) continue;
+        if (seen++) return 400;
+
+        const char *v = line + 5;
+        const char *e = line + len;
+        while (v < e && (*v == ' ' || *v == '\t')) v++;
+        while (e > v && (e[-1] == ' ' || e[-1] == '\t')) e--;
+        if (normalize_host(v, (size_t)(e - v), host, cap) != 0) return 400;
+    }
+    return 0;
+}
+
 // Parse HTTP request line and fill method/target
 int parse_http_request(const char *raw, size_t raw_len, http_request_t *out) {
     // Basic input validation
@@ -62,6 +161,11 @@ int parse_http_request(const char *raw, size_t raw_len, http_request_t *out) {
         }
     }
 
+    // Virtual host selection and content negotiation.
+    if (parse_headers(raw, raw_len, (size_t)line_end + 2, out) != 0) {
+        return 400;
+    }
+
     // Map supported methods
     if (strcasecmp(method, "GET") == 0) {
         out->method = HTTP_METHOD_GET;
@@ -95,6 +199,10 @@ const char *http_reason_phrase(int status_code) {
             return "Not Found";
         case 405:
             return "Method Not Allowed";
+        case 429:
+            return "Too Many Requests";
+        case 503:
+            return "Service Unavailable";
         case 500:
         default:
             return "Internal Server Error";
@@ -182,3 +290,56 @@ int build_response_headers(char *dst,
 
     return n;
 }
+
+// Build status line and common headers followed by prebuilt header lines
+int build_headers_with_fields(char *dst, size_t cap, int status_code, const char *fields, size_t fields_len) {
+    if (!dst || !fields) {
+        return -1;
+    }
+
+    char date[128];
+    format_http_date(date, sizeof(date));
+
+    int n = snprintf(
+        dst,
+        cap,
+        "HTTP/1.1 %d %s\r\n"
+        "Date: %s\r\n"
+        "Server: comp4981-httpd/1.0\r\n"
+        "Connection: close\r\n",
+        status_code,
+        http_reason_phrase(status_code),
+        date);
+
+    if (n < 0 || (size_t)n + fields_len + 2 >= cap) {
+        return -1;
+    }
+
+    memcpy(dst + n, fields, fields_len);
+    memcpy(dst + (size_t)n + fields_len, "\r\n", 3);
+    return n + (int)fields_len + 2;
+}
+
+// ETag from mtime (with nanoseconds) and size
+void format_etag(const struct stat *st, char *dst, size_t dst_sz) {
+    snprintf(dst, dst_sz, "\"%llx.%lx-%llx\"",
+             (unsigned long long)st->st_mtim.tv_sec,
+             (unsigned long)st->st_mtim.tv_nsec,
+             (unsigned long long)st->st_size);
+}
+
+// Add one header line to already built response headers
+int append_response_header(char *dst, size_t cap, int len, const char *name, const char *value) {
+    if (!dst || !name || !value || len < 2) {
+        return -1;
+    }
+
+    // Overwrite the final "\r\n" and put it back after the new line.
+    size_t need = strlen(name) + 2 + strlen(value) + 4;
+    if ((size_t)len - 2 + need >= cap) {
+        return -1;
+    }
+
+    int n = snprintf(dst + len - 2, cap - (size_t)(len - 2), "%s: %s\r\n\r\n", name, value);
+    return len - 2 + n;
+}
@@ -0,0 +1,283 @@
+#include "listen.h"
+
+#include "util.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define UNIX_PREFIX "unix:"
+#define TLS_PREFIX "tls:"
+
+// Parse "ip:port" or "[ip6]:port" into an IPv4/IPv6 address.
+static int parse_inet_spec(const char *spec, struct sockaddr_storage *ss, socklen_t *len) {
+    char host[INET6_ADDRSTRLEN];
+    const char *port;
+
+    if (spec[0] == '[') {
+        const char *close = strchr(spec, ']');
+        if (!close || close[1] != ':') return -1;
+        size_t n = (size_t)(close - spec - 1);
+        if (n == 0 || n >= sizeof(host)) return -1;
+        memcpy(host, spec + 1, n);
+        host[n] = '\0';
+        port = close + 2;
+    } else {
+        const char *colon = strchr(spec, ':');
+        if (!colon || strchr(colon + 1, ':')) return -1; // bare IPv6 needs brackets
+        size_t n = (size_t)(colon - spec);
+        if (n == 0 || n >= sizeof(host)) return -1;
+        memcpy(host, spec, n);
+        host[n] = '\0';
+        port = colon + 1;
+    }
+
+    long p;
+    if (parse_long(port, 1, 65535, &p) != 0) return -1;
+
+    memset(ss, 0, sizeof(*ss));
+    if (spec[0] == '[') {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)ss;
+        if (inet_pton(AF_INET6, host, &in6->sin6_addr) != 1) return -1;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons((uint16_t)p);
+        *len = sizeof(*in6);
+    } else {
+        struct sockaddr_in *in4 = (struct sockaddr_in *)ss;
+        if (inet_pton(AF_INET, host, &in4->sin_addr) != 1) return -1;
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons((uint16_t)p);
+        *len = sizeof(*in4);
+    }
+    return 0;
+}
+
+int listen_spec_is_tls(const char *spec) {
+    return spec && strncmp(spec, TLS_PREFIX, strlen(TLS_PREFIX)) == 0;
+}
+
+int listen_spec_parse(const char *spec, struct sockaddr_storage *ss, socklen_t *len) {
+    if (!spec || !ss || !len) return -1;
+    if (listen_spec_is_tls(spec)) spec += strlen(TLS_PREFIX);
+
+    if (strncmp(spec, UNIX_PREFIX, strlen(UNIX_PREFIX)) != 0) {
+        return parse_inet_spec(spec, ss, len);
+    }
+
+    const char *path = spec + strlen(UNIX_PREFIX);
+    struct sockaddr_un *sun = (struct sockaddr_un *)ss;
+    size_t n = strlen(path);
+    if (n == 0 || n >= sizeof(sun->sun_path)) return -1;
+
+    memset(ss, 0, sizeof(*ss));
+    sun->sun_family = AF_UNIX;
+    memcpy(sun->sun_path, path, n + 1);
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + n + 1);
+    return 0;
+}
+
+// Port of an IPv4/IPv6 address (0 otherwise).
+static unsigned addr_port(const struct sockaddr_storage *ss) {
+    if (ss->ss_family == AF_INET) return ntohs(((const struct sockaddr_in *)ss)->sin_port);
+    if (ss->ss_family == AF_INET6) return ntohs(((const struct sockaddr_in6 *)ss)->sin6_port);
+    return 0;
+}
+
+// "[::]:port" takes IPv4 too unless an IPv4 listener on that port is configured.
+static int wants_v6only(const server_config_t *cfg, const struct sockaddr_in6 *in6) {
+    if (!IN6_IS_ADDR_UNSPECIFIED(&in6->sin6_addr)) return 1;
+
+    for (int i = 0; i < cfg->num_listen; i++) {
+        struct sockaddr_storage other;
+        socklen_t len;
+        if (listen_spec_parse(cfg->listen[i], &other, &len) != 0) continue;
+        if (other.ss_family == AF_INET && addr_port(&other) == ntohs(in6->sin6_port)) return 1;
+    }
+    return 0;
+}
+
+// Remove a socket file left behind by a dead server; refuse a live one.
+static int clear_stale_unix(const struct sockaddr_un *sun, socklen_t len) {
+    struct stat st;
+    if (lstat(sun->sun_path, &st) != 0) return (errno == ENOENT) ? 0 : -1;
+    if (!S_ISSOCK(st.st_mode)) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int live = (connect(fd, (const struct sockaddr *)sun, len) == 0 || errno != ECONNREFUSED);
+    close(fd);
+
+    if (live) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+    return unlink(sun->sun_path);
+}
+
+// Create, bind, listen, and set one non-blocking listening socket.
+static int open_one(const server_config_t *cfg, const char *spec, listener_t *out) {
+    struct sockaddr_storage ss;
+    socklen_t len;
+    if (listen_spec_parse(spec, &ss, &len) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(ss.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (ss.ss_family == AF_UNIX) {
+        if (clear_stale_unix((const struct sockaddr_un *)&ss, len) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        // Allow quick restart after close.
+        int yes = 1;
+        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    }
+
+    if (ss.ss_family == AF_INET6) {
+        int v6only = wants_v6only(cfg, (const struct sockaddr_in6 *)&ss);
+        (void)setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+    }
+
+    // Close-on-exec: only a hot-reload successor inherits it, explicitly.
+    if (bind(fd, (struct sockaddr *)&ss, len) != 0 ||
+        listen(fd, cfg->backlog) != 0 ||
+        set_nonblocking(fd) != 0 ||
+        set_cloexec(fd) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    out->fd = fd;
+    out->family = ss.ss_family;
+    out->tls = listen_spec_is_tls(spec);
+    snprintf(out->name, sizeof(out->name), "%s", spec);
+    return 0;
+}
+
+int listeners_open(const server_config_t *cfg, listener_t *out) {
+    int n = 0;
+    for (int i = 0; i < cfg->num_listen && n < MAX_LISTENERS; i++) {
+        if (open_one(cfg, cfg->listen[i], &out[n]) != 0) {
+            fprintf(stderr, "listen %s: %s\n", cfg->listen[i], strerror(errno));
+            listeners_close(out, n);
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+// Readable name of a bound socket, as accepted by listen_spec_parse.
+static void format_local_name(int fd, int family, int tls, char *dst, size_t cap) {
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    char host[INET6_ADDRSTRLEN] = "?";
+
+    if (tls && cap > strlen(TLS_PREFIX)) {
+        memcpy(dst, TLS_PREFIX, strlen(TLS_PREFIX));
+        dst += strlen(TLS_PREFIX);
+        cap -= strlen(TLS_PREFIX);
+    }
+
+    if (getsockname(fd, (struct sockaddr *)&ss, &len) != 0) {
+        snprintf(dst, cap, "fd %d", fd);
+    } else if (family == AF_UNIX) {
+        const struct sockaddr_un *sun = (const struct sockaddr_un *)&ss;
+        snprintf(dst, cap, UNIX_PREFIX "%.*s", (int)sizeof(sun->sun_path), sun->sun_path);
+    } else if (family == AF_INET6) {
+        inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&ss)->sin6_addr, host, sizeof(host));
+        snprintf(dst, cap, "[%s]:%u", host, addr_port(&ss));
+    } else {
+        inet_ntop(AF_INET, &((struct sockaddr_in *)&ss)->sin_addr, host, sizeof(host));
+        snprintf(dst, cap, "%s:%u", host, addr_port(&ss));
+    }
+}
+
+int listeners_inherit(const char *fd_list, listener_t *out) {
+    if (!fd_list) return 0;
+
+    int n = 0;
+    const char *p = fd_list;
+    while (*p && n < MAX_LISTENERS) {
+        char num[16];
+        size_t k = strcspn(p, ",");
+
+        // "tls:<fd>" marks a TLS listener.
+        int tls = listen_spec_is_tls(p) && k > strlen(TLS_PREFIX);
+        size_t skip = tls ? strlen(TLS_PREFIX) : 0;
+        if (k - skip > 0 && k - skip < sizeof(num)) {
+            memcpy(num, p + skip, k - skip);
+            num[k - skip] = '\0';
+
+            // Must really be a listening stream socket.
+            long fd;
+            int type = 0, acc = 0;
+            struct sockaddr_storage ss;
+            socklen_t tl = sizeof(type), al = sizeof(acc), sl = sizeof(ss);
+            if (parse_long(num, 0, INT_MAX, &fd) == 0 &&
+                getsockopt((int)fd, SOL_SOCKET, SO_TYPE, &type, &tl) == 0 && type == SOCK_STREAM &&
+                getsockopt((int)fd, SOL_SOCKET, SO_ACCEPTCONN, &acc, &al) == 0 && acc &&
+                getsockname((int)fd, (struct sockaddr *)&ss, &sl) == 0 &&
+                set_nonblocking((int)fd) == 0 && set_cloexec((int)fd) == 0) {
+                out[n].fd = (int)fd;
+                out[n].family = ss.ss_family;
+                out[n].tls = tls;
+                format_local_name(out[n].fd, out[n].family, tls, out[n].name, sizeof(out[n].name));
+                n++;
+            }
+        }
+        p += k;
+        if (*p == ',') p++;
+    }
+    return n;
+}
+
+// Buffer sizes and TCP_NODELAY are inherited by accepted sockets,
+// saving a setsockopt() per connection.
+void listener_apply_options(const listener_t *l, const server_config_t *cfg) {
+    if (!l || l->fd < 0) return;
+
+    if (cfg->sndbuf > 0) {
+        (void)setsockopt(l->fd, SOL_SOCKET, SO_SNDBUF, &cfg->sndbuf, sizeof(cfg->sndbuf));
+    }
+    if (cfg->rcvbuf > 0) {
+        (void)setsockopt(l->fd, SOL_SOCKET, SO_RCVBUF, &cfg->rcvbuf, sizeof(cfg->rcvbuf));
+    }
+
+    if (l->family == AF_UNIX) return;
+
+    (void)setsockopt(l->fd, IPPROTO_TCP, TCP_NODELAY, &cfg->tcp_nodelay, sizeof(cfg->tcp_nodelay));
+
+#ifdef TCP_DEFER_ACCEPT
+    // Wake the loop only once the request has started arriving.
+    (void)setsockopt(l->fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &cfg->defer_accept, sizeof(cfg->defer_accept));
+#endif
+#ifdef TCP_FASTOPEN
+    // Request data in the SYN saves a round trip for repeat clients.
+    (void)setsockopt(l->fd, IPPROTO_TCP, TCP_FASTOPEN, &cfg->fastopen, sizeof(cfg->fastopen));
+#endif
+}
+
+void listeners_close(listener_t *ls, int n) {
+    for (int i = 0; i < n; i++) {
+        if (ls[i].fd >= 0) close(ls[i].fd);
+        ls[i].fd = -1;
+    }
+}
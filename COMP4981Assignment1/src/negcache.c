@@ -0,0 +1,303 @@
+#include "negcache.h"
+
+#include "path.h"
+#include "util.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// 404s live in sets of NC_WAYS slots; a full set replaces the entry
+// closest to expiry.
+#define NC_WAYS 4
+// Filter bits per name and probes per lookup (about 1% false "exists").
+#define NC_BITS_PER_NAME 10
+#define NC_PROBES 7
+// Smallest filter, in names; it is rebuilt once twice as many were added
+// as it was sized for.
+#define NC_MIN_NAMES 1024
+
+typedef struct {
+    uint64_t hash;
+    uint64_t expires_ms;
+    char *path;              // NULL = empty slot
+    size_t len;
+} nc_entry_t;
+
+struct neg_cache {
+    nc_entry_t *slots;       // NULL when no 404s are kept
+    size_t set_mask;         // number of sets - 1
+    size_t count;
+
+    int want_filter;
+    uint64_t *bits;          // NULL while the filter is off
+    size_t bit_mask;         // number of bits - 1
+    size_t names;            // names added since the filter was sized
+    size_t max_names;        // rebuild once names passes this
+};
+
+// Names collected by a walk (hashes only).
+typedef struct {
+    uint64_t *hashes;
+    size_t n;
+    size_t cap;
+    int failed;
+} nc_walk_t;
+
+neg_cache_t *neg_cache_create(size_t entries, int filter) {
+    neg_cache_t *nc = calloc(1, sizeof(*nc));
+    if (!nc) return NULL;
+
+    if (entries > 0) {
+        size_t sets = 1;
+        while (sets * NC_WAYS < entries) sets <<= 1;
+        nc->slots = calloc(sets * NC_WAYS, sizeof(*nc->slots));
+        if (!nc->slots) {
+            free(nc);
+            return NULL;
+        }
+        nc->set_mask = sets - 1;
+    }
+    nc->want_filter = filter;
+    return nc;
+}
+
+// Forget every 404.
+static void forget_all(neg_cache_t *nc) {
+    if (!nc->slots || nc->count == 0) return;
+
+    for (size_t i = 0; i < (nc->set_mask + 1) * NC_WAYS; i++) {
+        free(nc->slots[i].path);
+        nc->slots[i].path = NULL;
+    }
+    nc->count = 0;
+}
+
+void neg_cache_destroy(neg_cache_t *nc) {
+    if (!nc) return;
+
+    forget_all(nc);
+    free(nc->slots);
+    free(nc->bits);
+    free(nc);
+}
+
+static void filter_set(neg_cache_t *nc, uint64_t h) {
+    size_t a = (size_t)(uint32_t)h;
+    size_t b = (size_t)(h >> 32) | 1;
+    for (size_t i = 0; i < NC_PROBES; i++) {
+        size_t bit = (a + i * b) & nc->bit_mask;
+        nc->bits[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
+
+static int filter_has(const neg_cache_t *nc, uint64_t h) {
+    size_t a = (size_t)(uint32_t)h;
+    size_t b = (size_t)(h >> 32) | 1;
+    for (size_t i = 0; i < NC_PROBES; i++) {
+        size_t bit = (a + i * b) & nc->bit_mask;
+        if (!(nc->bits[bit / 64] & ((uint64_t)1 << (bit % 64)))) return 0;
+    }
+    return 1;
+}
+
+static void walk_push(nc_walk_t *w, const char *key, size_t len) {
+    if (w->n == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 1024;
+        uint64_t *p = realloc(w->hashes, cap * sizeof(*p));
+        if (!p) {
+            w->failed = 1;
+            return;
+        }
+        w->hashes = p;
+        w->cap = cap;
+    }
+    w->hashes[w->n++] = hash_bytes(key, len);
+}
+
+// Record the name at path (url: its part below the root) and, for a
+// directory, everything below it. A symlink is recorded as itself plus
+// "name/", which marks that names below it are not known.
+static void walk_tree(nc_walk_t *w, const char *path, const char *url) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return;
+
+    size_t len = strlen(url);
+    walk_push(w, url, len);
+    if (S_ISLNK(st.st_mode)) {
+        char marker[PATH_MAX];
+        if (len + 2 > sizeof(marker)) return;
+        memcpy(marker, url, len);
+        marker[len] = '/';
+        walk_push(w, marker, len + 1);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    DIR *d = opendir(path);
+    if (!d) return;
+
+    size_t url_off = (size_t)(url - path);
+    struct dirent *de;
+    while (!w->failed && (de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        char sub[PATH_MAX];
+        if (snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name) >= (int)sizeof(sub)) continue;
+        walk_tree(w, sub, sub + url_off);
+    }
+    closedir(d);
+}
+
+// Walk every name below doc_root (not the root itself).
+static void walk_root(nc_walk_t *w, const char *doc_root) {
+    DIR *d = opendir(doc_root);
+    if (!d) {
+        w->failed = 1;
+        return;
+    }
+
+    size_t root_len = strlen(doc_root);
+    struct dirent *de;
+    while (!w->failed && (de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        char sub[PATH_MAX];
+        if (snprintf(sub, sizeof(sub), "%s/%s", doc_root, de->d_name) >= (int)sizeof(sub)) continue;
+        walk_tree(w, sub, sub + root_len);
+    }
+    closedir(d);
+}
+
+long neg_cache_build(neg_cache_t *nc, const char *doc_root) {
+    if (!nc) return -1;
+
+    forget_all(nc);
+    free(nc->bits);
+    nc->bits = NULL;
+    if (!nc->want_filter) return -1;
+
+    nc_walk_t w = {NULL, 0, 0, 0};
+    walk_root(&w, doc_root);
+    if (w.failed) {
+        free(w.hashes);
+        return -1;
+    }
+
+    // Room for as many names again before a rebuild.
+    size_t max_names = w.n * 2 < NC_MIN_NAMES ? NC_MIN_NAMES : w.n * 2;
+    size_t nbits = 64;
+    while (nbits < max_names * NC_BITS_PER_NAME) nbits <<= 1;
+
+    nc->bits = calloc(nbits / 64, sizeof(*nc->bits));
+    if (nc->bits) {
+        nc->bit_mask = nbits - 1;
+        nc->names = w.n;
+        nc->max_names = max_names;
+        for (size_t i = 0; i < w.n; i++) filter_set(nc, w.hashes[i]);
+    }
+    free(w.hashes);
+    return nc->bits ? (long)w.n : -1;
+}
+
+void neg_cache_forget(neg_cache_t *nc) {
+    if (nc) forget_all(nc);
+}
+
+void neg_cache_changed(neg_cache_t *nc, const char *doc_root, const char *path) {
+    if (!nc) return;
+    if (!path) {
+        (void)neg_cache_build(nc, doc_root);
+        return;
+    }
+
+    size_t root_len = strlen(doc_root);
+    if (strncmp(path, doc_root, root_len) != 0 || (path[root_len] != '\0' && path[root_len] != '/')) return;
+
+    // Any change can turn a remembered 404 into a file (creations, renames,
+    // a symlink retargeted), and they are rare next to lookups.
+    forget_all(nc);
+
+    // Changes to the root itself add no name.
+    if (!nc->bits || path[root_len] == '\0') return;
+
+    // Whatever exists at path now (a directory with everything below it).
+    // Names that went away stay in the filter: it only answers "missing"
+    // for names it has never seen.
+    nc_walk_t w = {NULL, 0, 0, 0};
+    walk_tree(&w, path, path + root_len);
+
+    for (size_t i = 0; !w.failed && i < w.n; i++) {
+        if (filter_has(nc, w.hashes[i])) continue;
+        filter_set(nc, w.hashes[i]);
+        nc->names++;
+    }
+    free(w.hashes);
+    if (w.failed || nc->names > nc->max_names) (void)neg_cache_build(nc, doc_root);
+}
+
+// Filter: some component of path was never seen below the root. Stops
+// (answering "not known") at a component that is a symlink.
+static int filter_missing(const neg_cache_t *nc, const char *path, size_t len) {
+    for (size_t i = 1; i <= len; i++) {
+        if (i < len && path[i] != '/') continue;
+        if (path[i - 1] == '/') continue;
+
+        if (!filter_has(nc, hash_bytes(path, i))) return 1;
+        if (i < len && filter_has(nc, hash_bytes(path, i + 1))) return 0;
+    }
+    return 0;
+}
+
+int neg_cache_missing(const neg_cache_t *nc, const char *path, size_t len, uint64_t now_ms) {
+    if (!nc || len == 0) return 0;
+
+    if (nc->count > 0) {
+        uint64_t h = hash_bytes(path, len);
+        const nc_entry_t *set = &nc->slots[(h & nc->set_mask) * NC_WAYS];
+        for (int i = 0; i < NC_WAYS; i++) {
+            const nc_entry_t *e = &set[i];
+            if (e->path && e->hash == h && e->len == len && memcmp(e->path, path, len) == 0) {
+                if (e->expires_ms > now_ms) return 1;
+                break;
+            }
+        }
+    }
+    return nc->bits ? filter_missing(nc, path, len) : 0;
+}
+
+void neg_cache_insert(neg_cache_t *nc, const char *path, size_t len, uint64_t expires_ms) {
+    if (!nc || !nc->slots || len == 0) return;
+
+    uint64_t h = hash_bytes(path, len);
+    nc_entry_t *set = &nc->slots[(h & nc->set_mask) * NC_WAYS];
+    nc_entry_t *victim = &set[0];
+    for (int i = 0; i < NC_WAYS; i++) {
+        nc_entry_t *e = &set[i];
+        if (e->path && e->hash == h && e->len == len && memcmp(e->path, path, len) == 0) {
+            e->expires_ms = expires_ms;
+            return;
+        }
+        if (!e->path) {
+            victim = e;
+            break;
+        }
+        if (e->expires_ms < victim->expires_ms) victim = e;
+    }
+
+    char *copy = malloc(len);
+    if (!copy) return;
+    memcpy(copy, path, len);
+
+    if (victim->path) {
+        free(victim->path);
+    } else {
+        nc->count++;
+    }
+    victim->hash = h;
+    victim->expires_ms = expires_ms;
+    victim->path = copy;
+    victim->len = len;
+}
@@ -0,0 +1,28 @@
+#include "overload.h"
+
+// Weight of the newest iteration in the moving average.
+#define LAG_WEIGHT 0.25
+
+void overload_configure(overload_t *o, int lag_limit_ms, int queue_limit) {
+    o->lag_limit_ms = lag_limit_ms;
+    o->queue_limit = queue_limit;
+}
+
+// Over the limit (half the limit when already shedding, so the state does
+// not flap around the threshold).
+static int over(double value, int limit, int shedding) {
+    if (limit <= 0) return 0;
+    return shedding ? value >= limit / 2.0 : value > limit;
+}
+
+int overload_update(overload_t *o, uint64_t busy_ms, size_t queued) {
+    o->lag_ms += ((double)busy_ms - o->lag_ms) * LAG_WEIGHT;
+    o->queued = queued;
+
+    int now = over(o->lag_ms, o->lag_limit_ms, o->shedding) ||
+              over((double)queued, o->queue_limit, o->shedding);
+    if (now == o->shedding) return 0;
+
+    o->shedding = now;
+    return 1;
+}
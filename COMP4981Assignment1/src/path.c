@@ -1,34 +1,100 @@
+// O_PATH and syscall() are GNU extensions.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "path.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-// Basic checks for directory traversal attempts.
-static int contains_traversal(const char *p) {
-    if (!p) return 1;
-
-    // Reject backslashes to avoid weird platform confusion.
-    if (strchr(p, '\\')) return 1;
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#define HAVE_OPENAT2 1
+#endif
+#endif
 
-    // Common traversal patterns.
-    if (strcmp(p, "/..") == 0) return 1;
-    if (strncmp(p, "/../", 4) == 0) return 1;
-    if (strstr(p, "/../") != NULL) return 1;
-    if (strlen(p) >= 3 && strcmp(p + strlen(p) - 3, "/..") == 0) return 1;
+static int hex_digit(unsigned char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
 
-    // Basic encoded ".." patterns.
-    if (strstr(p, "%2e%2e") || strstr(p, "%2E%2E") || strstr(p, "%2e.") || strstr(p, ".%2e") || strstr(p, "%2E.")) {
-        return 1;
+// One segment of out (from seg to *n) is complete: drop it if it is "."
+// or empty, drop it with its parent if it is "..". Returns 0, or -1 if
+// ".." would climb above the root.
+static int end_segment(char *out, size_t seg, size_t *n) {
+    size_t len = *n - seg;
+    if (len == 1 && out[seg] == '.') {
+        *n = seg;
+    } else if (len == 2 && out[seg] == '.' && out[seg + 1] == '.') {
+        if (seg == 1) return -1;
+        size_t k = seg - 1; // the '/' before ".."
+        while (out[k - 1] != '/') k--;
+        *n = k;
     }
+    return 0;
+}
+
+// Turn the path part of url (up to '?', '#' or end, at most len bytes)
+// into a decoded, normalized path in one pass: percent-escapes decoded,
+// "//" collapsed, "." and ".." segments removed (RFC 3986 5.2.4). out
+// starts with '/'.
+// Returns 0, 400 (bad escape, NUL, too long) or 403 (backslash, or ".."
+// above the root).
+static int normalize_target(const char *url, size_t len, char *out, size_t cap) {
+    size_t n = 1;
+    size_t seg = 1; // start of the current segment in out
+    out[0] = '/';
+
+    const unsigned char *end = (const unsigned char *)url + len;
+    for (const unsigned char *p = (const unsigned char *)url + 1; p < end && *p != '\0' && *p != '?' && *p != '#';
+         p++) {
+        unsigned char c = *p;
+        if (c == '%') {
+            if (end - p < 3) return 400;
+            int hi = hex_digit(p[1]);
+            int lo = hi < 0 ? -1 : hex_digit(p[2]);
+            if (lo < 0) return 400;
+            c = (unsigned char)(hi << 4 | lo);
+            if (c == '\0') return 400;
+            p += 2;
+        }
+        if (c == '\\') return 403;
 
+        if (c == '/') {
+            if (end_segment(out, seg, &n) != 0) return 403;
+            if (out[n - 1] != '/') {
+                if (n >= cap - 1) return 400;
+                out[n++] = '/';
+            }
+            seg = n;
+            continue;
+        }
+        if (n >= cap - 1) return 400;
+        out[n++] = (char)c;
+    }
+    if (end_segment(out, seg, &n) != 0) return 403;
+    out[n] = '\0';
     return 0;
 }
 
+int path_normalize(const char *url, size_t len, char *out, size_t cap) {
+    if (!url || len == 0 || url[0] != '/' || cap < 2) return 400;
+    return normalize_target(url, len, out, cap);
+}
+
 // Ensure resolved path stays inside document root.
 static int starts_with_doc_root(const char *full, const char *doc_root) {
     size_t root_len = strlen(doc_root);
@@ -40,7 +106,7 @@ static int starts_with_doc_root(const char *full, const char *doc_root) {
 }
 
 // Convert URL target into a safe filesystem path under doc_root.
-int resolve_path(const char *doc_root, const char *url_target, char *out_path, size_t out_sz) {
+int resolve_path(const char *doc_root, const char *url_target, int allow_dir, char *out_path, size_t out_sz) {
     if (!doc_root || !url_target || !out_path || out_sz == 0) {
         return 500;
     }
@@ -50,22 +116,11 @@ int resolve_path(const char *doc_root, const char *url_target, char *out_path, s
         return 400;
     }
 
-    // Strip query string and fragment.
+    // Decode and normalize, dropping query string and fragment.
     char target[PATH_MAX];
-    size_t i = 0;
-    while (url_target[i] != '\0' && url_target[i] != '?' && url_target[i] != '#' && i < sizeof(target) - 1) {
-        target[i] = url_target[i];
-        i++;
-    }
-    target[i] = '\0';
-
-    if (target[0] == '\0') {
-        return 400;
-    }
-
-    // Block traversal attempts early.
-    if (contains_traversal(target)) {
-        return 403;
+    int rc = normalize_target(url_target, strlen(url_target), target, sizeof(target));
+    if (rc != 0) {
+        return rc;
     }
 
     char normalized[PATH_MAX];
@@ -89,8 +144,16 @@ int resolve_path(const char *doc_root, const char *url_target, char *out_path, s
     }
 
     // Canonicalize to resolve symlinks and "..".
+    // Listing mode: no index.html means the directory itself.
     char canonical[PATH_MAX];
-    if (!realpath(candidate, canonical)) {
+    int found = (realpath(candidate, canonical) != NULL);
+    if (!found && errno == ENOENT && allow_dir && strcmp(normalized, target) != 0) {
+        if (snprintf(candidate, sizeof(candidate), "%s%s", doc_root, target) >= (int)sizeof(candidate)) {
+            return 400;
+        }
+        found = (realpath(candidate, canonical) != NULL);
+    }
+    if (!found) {
         if (errno == ENOENT || errno == ENOTDIR) {
             return 404;
         }
@@ -105,7 +168,7 @@ int resolve_path(const char *doc_root, const char *url_target, char *out_path, s
         return 403;
     }
 
-    // Must be a regular file.
+    // Must be a regular file (or a directory to list).
     struct stat st;
     if (stat(canonical, &st) != 0) {
         if (errno == ENOENT || errno == ENOTDIR) return 404;
@@ -113,7 +176,7 @@ int resolve_path(const char *doc_root, const char *url_target, char *out_path, s
         return 500;
     }
 
-    if (!S_ISREG(st.st_mode)) {
+    if (!S_ISREG(st.st_mode) && !(allow_dir && S_ISDIR(st.st_mode))) {
         return 403;
     }
 
@@ -124,3 +187,168 @@ int resolve_path(const char *doc_root, const char *url_target, char *out_path, s
 
     return 0;
 }
+
+int path_reopen(int f, const char *path, const struct stat *st) {
+    // Through /proc: the very inode f names, so nothing swapped in after
+    // the check is opened.
+    char link[64];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", f);
+    int r = open(link, O_RDONLY | O_CLOEXEC);
+    if (r >= 0 || errno != ENOENT) return r;
+
+    // No /proc: by path, without waiting in open(), and only if it is
+    // still the same file.
+    r = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (r < 0) return -1;
+    struct stat now;
+    if (fstat(r, &now) != 0 || now.st_dev != st->st_dev || now.st_ino != st->st_ino) {
+        close(r);
+        errno = ENOENT;
+        return -1;
+    }
+    return r;
+}
+
+#ifdef HAVE_OPENAT2
+
+// Set once openat2 turns out to be unavailable (old kernel, seccomp).
+static atomic_int g_no_openat2;
+
+static int open_how_at(int root_fd, const char *rel, int flags, uint64_t resolve) {
+    struct open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = (uint64_t)(flags | O_CLOEXEC);
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS | resolve;
+    return (int)syscall(SYS_openat2, root_fd, rel, &how, sizeof(how));
+}
+
+// Open rel beneath root_fd. Sets *via_link if a symlink was followed on
+// the way (the literal path then does not name the file).
+static int open_beneath(int root_fd, const char *rel, int flags, int *via_link) {
+    *via_link = 0;
+    int f = open_how_at(root_fd, rel, flags, RESOLVE_NO_SYMLINKS);
+    if (f >= 0 || errno != ELOOP) return f;
+
+    *via_link = 1;
+    return open_how_at(root_fd, rel, flags, 0);
+}
+
+// Canonical path of the open file f into out (for results reached
+// through a symlink). Returns 0, or -1 if it cannot be determined.
+static int canonical_path(int f, const char *literal, char *out, size_t out_sz) {
+    char link[64];
+    char canonical[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", f);
+    ssize_t n = readlink(link, canonical, sizeof(canonical));
+    if (n > 0 && (size_t)n < sizeof(canonical)) {
+        canonical[n] = '\0';
+    } else if (!realpath(literal, canonical)) {
+        return -1;
+    }
+    return snprintf(out, out_sz, "%s", canonical) < (int)out_sz ? 0 : -1;
+}
+
+int path_root_open(const char *doc_root) {
+    return open(doc_root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+int resolve_path_at(int root_fd,
+                    const char *doc_root,
+                    const char *url_target,
+                    int allow_dir,
+                    int want_fd,
+                    char *out_path,
+                    size_t out_sz,
+                    int *fd,
+                    struct stat *st) {
+    if (root_fd < 0 || atomic_load_explicit(&g_no_openat2, memory_order_relaxed)) return -1;
+    if (!doc_root || !url_target || !out_path) return 500;
+    if (url_target[0] != '/') return 400;
+
+    // out_path = doc_root + normalized path (+ "index.html"); the part
+    // after doc_root is opened relative to root_fd.
+    size_t root_len = strlen(doc_root);
+    size_t index_len = strlen("index.html");
+    if (root_len + index_len + 2 > out_sz) return 400;
+    memcpy(out_path, doc_root, root_len);
+    int rc = normalize_target(url_target, strlen(url_target), out_path + root_len, out_sz - root_len - index_len);
+    if (rc != 0) return rc;
+
+    size_t n = strlen(out_path);
+    int dir_url = (out_path[n - 1] == '/');
+    if (dir_url) memcpy(out_path + n, "index.html", index_len + 1);
+    const char *rel = out_path + root_len + 1;
+
+    // O_PATH first: opening a FIFO or device for reading can block (or
+    // act on the device), so only a checked file is opened for reading.
+    int via_link;
+    int f = open_beneath(root_fd, rel, O_PATH, &via_link);
+    // Listing mode: no index.html means the directory itself.
+    if (f < 0 && errno == ENOENT && dir_url && allow_dir) {
+        out_path[n - 1] = '\0';
+        f = open_beneath(root_fd, n - 1 > root_len ? rel : ".", O_PATH, &via_link);
+    }
+    if (f < 0) {
+        if (errno == ENOSYS || errno == EPERM || errno == EINVAL || errno == E2BIG) {
+            atomic_store_explicit(&g_no_openat2, 1, memory_order_relaxed);
+            return -1;
+        }
+        if (errno == ENOENT || errno == ENOTDIR) return 404;
+        // EXDEV: the path (or a symlink on it) leads outside the root.
+        if (errno == EXDEV || errno == ELOOP || errno == EACCES || errno == ENXIO || errno == EAGAIN) return 403;
+        return 500;
+    }
+
+    if (fstat(f, st) != 0) {
+        close(f);
+        return 500;
+    }
+    if (!S_ISREG(st->st_mode) && !(allow_dir && S_ISDIR(st->st_mode))) {
+        close(f);
+        return 403;
+    }
+    // Through a symlink: report where it led, so caches keyed by path
+    // follow the change events of the target rather than the link.
+    if (via_link && canonical_path(f, out_path, out_path, out_sz) != 0) {
+        close(f);
+        return 500;
+    }
+    if (want_fd) {
+        int r = path_reopen(f, out_path, st);
+        close(f);
+        if (r < 0) return (errno == EACCES || errno == ENXIO || errno == EAGAIN) ? 403 : 500;
+        f = r;
+    }
+    *fd = f;
+    return 0;
+}
+
+#else
+
+int path_root_open(const char *doc_root) {
+    (void)doc_root;
+    return -1;
+}
+
+int resolve_path_at(int root_fd,
+                    const char *doc_root,
+                    const char *url_target,
+                    int allow_dir,
+                    int want_fd,
+                    char *out_path,
+                    size_t out_sz,
+                    int *fd,
+                    struct stat *st) {
+    (void)root_fd;
+    (void)doc_root;
+    (void)url_target;
+    (void)allow_dir;
+    (void)want_fd;
+    (void)out_path;
+    (void)out_sz;
+    (void)fd;
+    (void)st;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include "pathindex.h"
+
+#include "http.h"
+#include "rcu.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Independent shards, each with its own buckets, count and clock hand.
+#define PI_SHARDS 16
+#define PI_SHARD_BUCKETS 256
+// Upper bound on remembered URLs per shard; eviction is CLOCK
+// (second chance), so lookups only ever set a flag.
+#define PI_SHARD_MAX 1024
+
+// Immutable once published, apart from the referenced flag.
+typedef struct pi_entry {
+    _Atomic(struct pi_entry *) hnext;
+    atomic_int referenced;
+    char *url;
+    size_t url_len;
+    uint64_t hash;
+    char *path;
+    struct stat st;
+    const char *mime;
+    char etag[HTTP_ETAG_MAX];
+} pi_entry_t;
+
+typedef struct {
+    _Atomic(pi_entry_t *) buckets[PI_SHARD_BUCKETS];
+    size_t count;
+    size_t hand;             // next bucket the clock looks at
+} pi_shard_t;
+
+struct path_index {
+    pi_shard_t shards[PI_SHARDS];
+};
+
+path_index_t *path_index_create(void) {
+    return calloc(1, sizeof(path_index_t));
+}
+
+// Low bits pick the bucket, high bits the shard.
+static pi_shard_t *shard_for(const path_index_t *pi, uint64_t h) {
+    return (pi_shard_t *)&pi->shards[(h >> 56) % PI_SHARDS];
+}
+
+static _Atomic(pi_entry_t *) *bucket_for(const path_index_t *pi, uint64_t h) {
+    return &shard_for(pi, h)->buckets[h % PI_SHARD_BUCKETS];
+}
+
+static void free_entry(void *p) {
+    pi_entry_t *e = (pi_entry_t *)p;
+    free(e->url);
+    free(e->path);
+    free(e);
+}
+
+// Writer: unlink from its bucket and retire. Readers already on e keep a
+// valid hnext, so their walk continues past it.
+static void remove_entry(path_index_t *pi, pi_entry_t *e) {
+    _Atomic(pi_entry_t *) *pp = bucket_for(pi, e->hash);
+    pi_entry_t *cur;
+    while ((cur = atomic_load_explicit(pp, memory_order_relaxed)) != NULL && cur != e) {
+        pp = &cur->hnext;
+    }
+    if (!cur) return;
+
+    atomic_store_explicit(pp, atomic_load_explicit(&e->hnext, memory_order_relaxed), memory_order_release);
+    shard_for(pi, e->hash)->count--;
+    rcu_retire(e, free_entry);
+}
+
+// Safe for readers inside a read-side section and for the writer.
+static pi_entry_t *find_entry(const path_index_t *pi, const char *url, size_t len, uint64_t h) {
+    pi_entry_t *e = atomic_load_explicit(bucket_for(pi, h), memory_order_acquire);
+    for (; e; e = atomic_load_explicit(&e->hnext, memory_order_acquire)) {
+        if (e->hash == h && e->url_len == len && memcmp(e->url, url, len) == 0) return e;
+    }
+    return NULL;
+}
+
+// Drop the entry for one URL, if any.
+static void forget_url(path_index_t *pi, const char *url, size_t len) {
+    pi_entry_t *e = find_entry(pi, url, len, hash_bytes(url, len));
+    if (e) remove_entry(pi, e);
+}
+
+// Writer: make room in a full shard. Sweeps buckets from the hand,
+// clearing referenced flags, and evicts the first entry without one.
+static void evict_one(path_index_t *pi, pi_shard_t *s) {
+    for (size_t step = 0; step < 2 * PI_SHARD_BUCKETS + 1; step++) {
+        _Atomic(pi_entry_t *) *b = &s->buckets[s->hand];
+        pi_entry_t *e = atomic_load_explicit(b, memory_order_relaxed);
+        for (; e; e = atomic_load_explicit(&e->hnext, memory_order_relaxed)) {
+            if (!atomic_exchange_explicit(&e->referenced, 0, memory_order_relaxed)) {
+                remove_entry(pi, e);
+                return;
+            }
+        }
+        s->hand = (s->hand + 1) % PI_SHARD_BUCKETS;
+    }
+}
+
+int path_index_lookup(path_index_t *pi, const char *url, size_t len, path_info_t *out) {
+    if (!pi || !url) return -1;
+
+    pi_entry_t *e = find_entry(pi, url, len, hash_bytes(url, len));
+    if (!e) return -1;
+
+    atomic_store_explicit(&e->referenced, 1, memory_order_relaxed);
+    out->path = e->path;
+    out->st = e->st;
+    out->mime = e->mime;
+    out->etag = e->etag;
+    return 0;
+}
+
+int path_index_read(const path_index_t *pi, const char *url, size_t len, char *path, size_t cap, struct stat *st) {
+    if (!pi || !url || !rcu_is_reader()) return -1;
+
+    uint64_t h = hash_bytes(url, len);
+    int rc = -1;
+
+    rcu_read_lock();
+    pi_entry_t *e = find_entry(pi, url, len, h);
+    if (e && (size_t)snprintf(path, cap, "%s", e->path) < cap) {
+        atomic_store_explicit(&e->referenced, 1, memory_order_relaxed);
+        *st = e->st;
+        rc = 0;
+    }
+    rcu_read_unlock();
+    return rc;
+}
+
+int path_index_insert(path_index_t *pi,
+                      const char *doc_root,
+                      const char *url,
+                      size_t len,
+                      const char *path,
+                      const struct stat *st) {
+    if (!pi || !url || len == 0 || url[0] != '/' || !S_ISREG(st->st_mode)) return -1;
+
+    // path must be exactly doc_root + url (+ "index.html" for "dir/").
+    size_t root_len = strlen(doc_root);
+    size_t path_len = strlen(path);
+    int dir_url = (url[len - 1] == '/');
+    size_t want = root_len + len + (dir_url ? strlen("index.html") : 0);
+    if (path_len != want ||
+        memcmp(path, doc_root, root_len) != 0 ||
+        memcmp(path + root_len, url, len) != 0 ||
+        (dir_url && strcmp(path + root_len + len, "index.html") != 0)) {
+        return -1;
+    }
+
+    uint64_t h = hash_bytes(url, len);
+    pi_shard_t *s = shard_for(pi, h);
+    pi_entry_t *e = find_entry(pi, url, len, h);
+    if (e) remove_entry(pi, e);
+    if (s->count >= PI_SHARD_MAX) evict_one(pi, s);
+
+    // Fully built before it becomes reachable.
+    e = calloc(1, sizeof(*e));
+    if (!e) return -1;
+    e->url = malloc(len);
+    e->path = malloc(path_len + 1);
+    if (!e->url || !e->path) {
+        free_entry(e);
+        return -1;
+    }
+    memcpy(e->url, url, len);
+    memcpy(e->path, path, path_len + 1);
+    e->url_len = len;
+    e->hash = h;
+    e->st = *st;
+    e->mime = guess_mime_type(path);
+    format_etag(st, e->etag, sizeof(e->etag));
+
+    _Atomic(pi_entry_t *) *b = bucket_for(pi, h);
+    atomic_store_explicit(&e->hnext, atomic_load_explicit(b, memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(b, e, memory_order_release);
+    s->count++;
+    return 0;
+}
+
+// Writer: remove every entry whose path lies below dir (n = strlen(dir)).
+static void forget_below(path_index_t *pi, const char *dir, size_t n) {
+    for (int i = 0; i < PI_SHARDS; i++) {
+        for (int j = 0; j < PI_SHARD_BUCKETS; j++) {
+            pi_entry_t *e = atomic_load_explicit(&pi->shards[i].buckets[j], memory_order_relaxed);
+            while (e) {
+                pi_entry_t *next = atomic_load_explicit(&e->hnext, memory_order_relaxed);
+                if (!dir || (strncmp(e->path, dir, n) == 0 && e->path[n] == '/')) remove_entry(pi, e);
+                e = next;
+            }
+        }
+    }
+}
+
+void path_index_invalidate(path_index_t *pi, const char *doc_root, const char *path, int is_dir) {
+    if (!pi || !path) return;
+
+    size_t root_len = strlen(doc_root);
+    if (strncmp(path, doc_root, root_len) != 0) return;
+    if (path[root_len] == '\0') {
+        path_index_clear(pi);
+        return;
+    }
+    if (path[root_len] != '/') return;
+
+    // Entries are literal, so the URL is the path below the root; an
+    // index.html also answers for its directory URL.
+    const char *url = path + root_len;
+    size_t len = strlen(url);
+    forget_url(pi, url, len);
+
+    const char *base = strrchr(url, '/') + 1;
+    if (strcmp(base, "index.html") == 0) forget_url(pi, url, (size_t)(base - url));
+
+    // Directory renamed/removed: everything below it.
+    if (is_dir) forget_below(pi, path, strlen(path));
+}
+
+void path_index_clear(path_index_t *pi) {
+    if (!pi) return;
+
+    forget_below(pi, NULL, 0);
+}
+
+void path_index_destroy(path_index_t *pi) {
+    if (!pi) return;
+
+    // No readers are left; free directly.
+    for (int i = 0; i < PI_SHARDS; i++) {
+        for (int j = 0; j < PI_SHARD_BUCKETS; j++) {
+            pi_entry_t *e = atomic_load_explicit(&pi->shards[i].buckets[j], memory_order_relaxed);
+            while (e) {
+                pi_entry_t *next = atomic_load_explicit(&e->hnext, memory_order_relaxed);
+                free_entry(e);
+                e = next;
+            }
+        }
+    }
+    free(pi);
+}
@@ -0,0 +1,197 @@
+#include "ratelimit.h"
+
+#include "util.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimum time between sweeps.
+#define SWEEP_INTERVAL_MS 1000
+// Extra idle time before an entry with a full bucket is forgotten.
+#define IDLE_GRACE_MS 1000
+
+// One tracked address: 32 bytes, two per cache line.
+typedef struct {
+    rate_key_t key;
+    uint32_t conns;          // Open connections from this address
+    float tokens;            // Request tokens left
+    uint32_t last_ms;        // Low 32 bits of last refill time
+    uint32_t used;           // Slot occupied
+} rl_entry_t;
+
+struct rate_limiter {
+    rl_entry_t *slots;
+    rl_entry_t *scratch;     // Rebuild space for sweeps
+    size_t mask;             // capacity - 1
+    size_t count;
+
+    unsigned max_conns;
+    float rate;              // Tokens per millisecond
+    float burst;
+    uint32_t idle_ms;        // Idle time after which state is default again
+
+    uint64_t last_sweep_ms;
+};
+
+rate_limiter_t *rate_limiter_create(size_t capacity, unsigned max_conns, double rate, double burst) {
+    size_t cap = 64;
+    while (cap < capacity) cap <<= 1;
+
+    rate_limiter_t *rl = calloc(1, sizeof(*rl));
+    if (!rl) return NULL;
+
+    rl->slots = calloc(cap, sizeof(*rl->slots));
+    rl->scratch = calloc(cap, sizeof(*rl->scratch));
+    if (!rl->slots || !rl->scratch) {
+        rate_limiter_destroy(rl);
+        return NULL;
+    }
+
+    rl->mask = cap - 1;
+    rate_limiter_configure(rl, max_conns, rate, burst);
+    return rl;
+}
+
+void rate_limiter_configure(rate_limiter_t *rl, unsigned max_conns, double rate, double burst) {
+    if (!rl) return;
+
+    rl->max_conns = max_conns;
+    rl->rate = (float)(rate / 1000.0);
+    rl->burst = (float)(burst < 1.0 ? 1.0 : burst);
+
+    // A full bucket with no connections is indistinguishable from no entry.
+    rl->idle_ms = IDLE_GRACE_MS;
+    if (rate > 0) rl->idle_ms += (uint32_t)(rl->burst / rl->rate);
+}
+
+void rate_limiter_destroy(rate_limiter_t *rl) {
+    if (!rl) return;
+    free(rl->slots);
+    free(rl->scratch);
+    free(rl);
+}
+
+int rate_key_from_addr(const struct sockaddr *sa, rate_key_t *key) {
+    memset(key, 0, sizeof(*key));
+
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in *in4 = (const struct sockaddr_in *)sa;
+        key->b[10] = 0xff;
+        key->b[11] = 0xff;
+        memcpy(&key->b[12], &in4->sin_addr, 4);
+        return 0;
+    }
+    if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)sa;
+        memcpy(key->b, &in6->sin6_addr, 16);
+        return 0;
+    }
+    return -1;
+}
+
+// Refill tokens for elapsed time.
+static void refill(const rate_limiter_t *rl, rl_entry_t *e, uint64_t now_ms) {
+    uint32_t now = (uint32_t)now_ms;
+    uint32_t dt = now - e->last_ms;
+
+    e->tokens += (float)dt * rl->rate;
+    if (e->tokens > rl->burst) e->tokens = rl->burst;
+    e->last_ms = now;
+}
+
+// Insert into a table known to have room (no duplicate check).
+static void place(rl_entry_t *slots, size_t mask, const rl_entry_t *src) {
+    size_t i = (size_t)hash_bytes(src->key.b, sizeof(src->key.b)) & mask;
+    while (slots[i].used) i = (i + 1) & mask;
+    slots[i] = *src;
+}
+
+// Rebuild the table without idle entries.
+static void rebuild(rate_limiter_t *rl, uint64_t now_ms) {
+    size_t cap = rl->mask + 1;
+    size_t live = 0;
+
+    for (size_t i = 0; i < cap; i++) {
+        rl_entry_t *e = &rl->slots[i];
+        if (!e->used) continue;
+        if (e->conns == 0 && (uint32_t)now_ms - e->last_ms >= rl->idle_ms) continue;
+        rl->scratch[live++] = *e;
+    }
+
+    memset(rl->slots, 0, cap * sizeof(*rl->slots));
+    for (size_t i = 0; i < live; i++) place(rl->slots, rl->mask, &rl->scratch[i]);
+
+    rl->count = live;
+    rl->last_sweep_ms = now_ms;
+}
+
+void rate_limiter_sweep(rate_limiter_t *rl, uint64_t now_ms) {
+    if (!rl || now_ms - rl->last_sweep_ms < SWEEP_INTERVAL_MS) return;
+    rebuild(rl, now_ms);
+}
+
+// Find entry for key, creating it if missing. NULL when the table is full.
+static rl_entry_t *lookup(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms, int create) {
+    size_t i = (size_t)hash_bytes(key->b, sizeof(key->b)) & rl->mask;
+
+    for (;;) {
+        rl_entry_t *e = &rl->slots[i];
+        if (!e->used) break;
+        if (memcmp(e->key.b, key->b, sizeof(key->b)) == 0) {
+            refill(rl, e, now_ms);
+            return e;
+        }
+        i = (i + 1) & rl->mask;
+    }
+
+    if (!create) return NULL;
+
+    // Keep probe chains short: age out idle entries, else fail open.
+    if (rl->count + 1 > (rl->mask + 1) - (rl->mask + 1) / 8) {
+        rebuild(rl, now_ms);
+        if (rl->count + 1 > (rl->mask + 1) - (rl->mask + 1) / 8) return NULL;
+    }
+
+    rl_entry_t fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.key = *key;
+    fresh.tokens = rl->burst;
+    fresh.last_ms = (uint32_t)now_ms;
+    fresh.used = 1;
+
+    place(rl->slots, rl->mask, &fresh);
+    rl->count++;
+
+    return lookup(rl, key, now_ms, 0);
+}
+
+int rate_limiter_conn_open(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms) {
+    if (!rl || rl->max_conns == 0) return 0;
+
+    rl_entry_t *e = lookup(rl, key, now_ms, 1);
+    if (!e) return 0;
+
+    if (e->conns >= rl->max_conns) return -1;
+    e->conns++;
+    return 1;
+}
+
+void rate_limiter_conn_close(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms) {
+    if (!rl) return;
+
+    rl_entry_t *e = lookup(rl, key, now_ms, 0);
+    if (e && e->conns > 0) e->conns--;
+}
+
+int rate_limiter_take(rate_limiter_t *rl, const rate_key_t *key, uint64_t now_ms) {
+    if (!rl || rl->rate <= 0.0f) return 0;
+
+    rl_entry_t *e = lookup(rl, key, now_ms, 1);
+    if (!e) return 0;
+
+    if (e->tokens < 1.0f) return -1;
+    e->tokens -= 1.0f;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "rcu.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// A node waiting until no reader can hold it.
+typedef struct retired {
+    void *p;
+    void (*fn)(void *);
+    uint64_t epoch;          // global epoch when it was unlinked
+    struct retired *next;
+} retired_t;
+
+// Bumped on every retire; readers publish the value they entered with.
+static _Atomic uint64_t g_epoch = 1;
+
+// Per reader slot: entry epoch while inside a section, 0 when quiescent.
+static _Atomic uint64_t g_reader_epoch[RCU_MAX_READERS];
+static atomic_int g_reader_used[RCU_MAX_READERS];
+
+static _Thread_local int t_slot = -1;
+
+// Writer-owned list, oldest first.
+static retired_t *g_retired_head = NULL;
+static retired_t *g_retired_tail = NULL;
+
+int rcu_register_reader(void) {
+    if (t_slot >= 0) return 0;
+
+    for (int i = 0; i < RCU_MAX_READERS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&g_reader_used[i], &expected, 1)) {
+            atomic_store(&g_reader_epoch[i], 0);
+            t_slot = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void rcu_unregister_reader(void) {
+    if (t_slot < 0) return;
+
+    atomic_store(&g_reader_epoch[t_slot], 0);
+    atomic_store(&g_reader_used[t_slot], 0);
+    t_slot = -1;
+}
+
+int rcu_is_reader(void) {
+    return t_slot >= 0;
+}
+
+void rcu_read_lock(void) {
+    // Publish the epoch before loading any shared pointer.
+    atomic_store(&g_reader_epoch[t_slot], atomic_load(&g_epoch));
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void rcu_read_unlock(void) {
+    atomic_store_explicit(&g_reader_epoch[t_slot], 0, memory_order_release);
+}
+
+// Oldest epoch any reader is still inside (UINT64_MAX: none).
+static uint64_t oldest_reader(void) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    uint64_t min = UINT64_MAX;
+    for (int i = 0; i < RCU_MAX_READERS; i++) {
+        uint64_t e = atomic_load(&g_reader_epoch[i]);
+        if (e != 0 && e < min) min = e;
+    }
+    return min;
+}
+
+void rcu_retire(void *p, void (*fn)(void *)) {
+    if (!p) return;
+
+    // Readers entering after this bump cannot have seen p.
+    uint64_t epoch = atomic_fetch_add(&g_epoch, 1);
+
+    retired_t *r = malloc(sizeof(*r));
+    if (!r) {
+        // No memory to defer: wait out the readers instead.
+        while (oldest_reader() <= epoch) sched_yield();
+        fn(p);
+        return;
+    }
+    r->p = p;
+    r->fn = fn;
+    r->epoch = epoch;
+    r->next = NULL;
+    if (g_retired_tail) g_retired_tail->next = r;
+    else g_retired_head = r;
+    g_retired_tail = r;
+}
+
+void rcu_reclaim(void) {
+    if (!g_retired_head) return;
+
+    // Epochs only grow along the list, so stop at the first one in use.
+    uint64_t oldest = oldest_reader();
+    while (g_retired_head && g_retired_head->epoch < oldest) {
+        retired_t *r = g_retired_head;
+        g_retired_head = r->next;
+        r->fn(r->p);
+        free(r);
+    }
+    if (!g_retired_head) g_retired_tail = NULL;
+}
@@ -1,14 +1,27 @@
 #include "server.h"
 
+#include "errpage.h"
+#include "filecache.h"
+#include "fspool.h"
+#include "fswatch.h"
+#include "h2.h"
 #include "http.h"
+#include "listen.h"
+#include "overload.h"
 #include "path.h"
+#include "ratelimit.h"
+#include "rcu.h"
+#include "tls.h"
 #include "util.h"
+#include "vhost.h"
+#include "warmup.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdio.h>
@@ -17,30 +30,62 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
-// Maximum concurrent clients handled by poll.
-#define MAX_CLIENTS 1024
-// Hard cap for request header bytes.
-#define MAX_HEADER_BYTES 16384
+extern char **environ;
+
 // Buffer size for generated response headers.
 #define MAX_RESP_HEADER 2048
-// Buffer size for generated error response body.
-#define MAX_ERROR_BODY 512
-// File streaming chunk size.
-#define FILE_CHUNK 8192
 
-// Client mode in the event loop.
-typedef enum { MODE_READING = 0, MODE_WRITING = 1 } io_mode_t;
+// Bytes an HTTP/2 connection may read per loop iteration (the reading
+// counterpart of --write-budget).
+#define H2_READ_BUDGET (64 * 1024)
+
+// Linux hint to hold partial segments while more data follows.
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+// Fixed poll slots ahead of the client slots (unused listener slots stay -1).
+enum {
+    SLOT_FSPOOL = 0,
+    SLOT_RELOAD,
+    SLOT_FSWATCH,
+    SLOT_SIGNAL,
+    FIRST_LISTEN_SLOT,
+    FIRST_CLIENT_SLOT = FIRST_LISTEN_SLOT + MAX_LISTENERS
+};
+
+// Client mode in the event loop (MODE_H2: multiplexed HTTP/2 connection).
+typedef enum { MODE_READING = 0, MODE_WRITING = 1, MODE_RESOLVING = 2, MODE_H2 = 3 } io_mode_t;
 
 // Per-client state.
 typedef struct {
     int active;              // Slot in use
     int fd;                  // Client socket
-    io_mode_t mode;          // Read request / write response
-
-    // Request buffer
-    char req_buf[MAX_HEADER_BYTES + 1];
+    io_mode_t mode;          // Read request / wait for lookup / write response
+    int slot;                // Index in poll/client arrays
+    unsigned gen;            // Connection generation (detects slot reuse)
+
+    // TLS connection (NULL on plain listeners)
+    tls_conn_t *tls;
+    int handshaking;         // reading waits for the handshake to finish
+
+    // HTTP/2 framing and streams (MODE_H2). Each stream's response lives
+    // in a client_t of its own, marked is_stream (no socket, no slot).
+    h2_conn_t *h2;
+    int is_stream;
+
+    // Per-IP limiting
+    rate_key_t peer;
+    int has_peer;            // peer is a limited address family
+    int conn_counted;        // Counted against the per-IP connection cap
+
+    // Request buffer (kept across connections on this slot)
+    char *req_buf;
+    size_t req_cap;
     size_t req_len;
 
     // Response header buffer
@@ -48,146 +93,125 @@ typedef struct {
     size_t hdr_len;
     size_t hdr_sent;
 
-    // In-memory body (used for generated error pages)
-    char mem_body[MAX_ERROR_BODY];
+    // Shared response body (error pages, listings, bundles); sent after hdr_buf
+    const char *mem_body;
     size_t mem_len;
     size_t mem_sent;
 
     int is_head;             // HEAD => headers only
+    size_t budget;           // bytes this connection may still send this iteration
+
+    // URL path of the request within req_buf (path index key)
+    size_t url_off;
+    size_t url_len;
+    unsigned watch_epoch;    // g_watch_epoch when the lookup started
 
     // File streaming state (GET success path)
     int file_fd;             // -1 if not streaming a file
     off_t file_size;
     off_t file_sent;
 
-    unsigned char chunk[FILE_CHUNK];
+    // Streaming buffer (kept across connections on this slot)
+    unsigned char *chunk;
+    size_t chunk_cap;
     ssize_t chunk_len;
     ssize_t chunk_sent;
-} client_t;
+    int cork;                // Cork socket while streaming this file
+    int corked;              // TCP_CORK currently set
 
-// Global stop flag for graceful shutdown.
-static volatile sig_atomic_t g_stop = 0;
-// Bind IP from CLI args.
-static char g_bind_ip[64] = "0.0.0.0";
+    // Site chosen by Host (default site until the request is parsed)
+    vhost_t *vhost;
 
-// Signal handler sets stop flag.
-static void on_signal(int sig) {
-    (void)sig;
-    g_stop = 1;
-}
+    // Shared in-memory copy of a hot small file from vhost's cache (NULL if streaming/none)
+    fc_entry_t *cached;
+    size_t cached_sent;
 
-// Validate numeric TCP port.
-static int parse_port_number(const char *port_str) {
-    if (!port_str || *port_str == '\0') return -1;
+    // Rendered directory listing from vhost's cache, sent as mem_body
+    dir_listing_t *listing;
 
-    char *end = NULL;
-    long v = strtol(port_str, &end, 10);
+    // Bundle whose mapping mem_body points into (referenced while sending)
+    bundle_t *bundle;
 
-    if (!end || *end != '\0') return -1;
-    if (v < 1 || v > 65535) return -1;
+    uint64_t last_active_ms; // Last I/O progress (idle timeout)
+} client_t;
 
-    return (int)v;
+// Stop requests: 1 = drain gracefully, 2+ = stop immediately.
+static volatile sig_atomic_t g_stop = 0;
+// Hot reload requested (SIGUSR2).
+static volatile sig_atomic_t g_reload = 0;
+// Config re-read requested (SIGHUP).
+static volatile sig_atomic_t g_reconfig = 0;
+// Self-pipe the handlers write to, so a signal that lands just before
+// poll() still wakes it (-1 => signals wait for the poll timeout).
+static int g_signal_pipe[2] = {-1, -1};
+// Poll/client slots in use (fixed slots + max_clients).
+static int g_num_slots = 0;
+// Filesystem worker pool (NULL => lookups run inline on the loop).
+static fs_pool_t *g_fs_pool = NULL;
+// Per-IP connection/request limiter (NULL => no limits).
+static rate_limiter_t *g_rate_limiter = NULL;
+// Sites by Host name, each with its own file cache and error pages.
+static vhost_table_t *g_vhosts = NULL;
+// Change watcher over all document roots (NULL => caches revalidate).
+static fs_watch_t *g_watch = NULL;
+// Bumped per batch of change events; lookups that overlap one are not indexed.
+static unsigned g_watch_epoch = 0;
+// Generation counter for accepted connections.
+static unsigned g_next_gen = 0;
+
+// Active connections, and whether new requests are being shed.
+static int g_num_clients = 0;
+static overload_t g_overload;
+// Listening sockets; listener i is polled in slot FIRST_LISTEN_SLOT + i.
+static listener_t g_listeners[MAX_LISTENERS];
+static int g_num_listeners = 0;
+// Certificate and settings for "tls:" listeners (NULL if there are none).
+static tls_server_t *g_tls = NULL;
+
+// Wake the event loop from a signal handler (async-signal-safe).
+static void wake_loop(void) {
+    int saved = errno;
+    if (g_signal_pipe[1] >= 0) {
+        // EAGAIN means the loop is already due to wake.
+        char b = 1;
+        ssize_t w = write(g_signal_pipe[1], &b, 1);
+        (void)w;
+    }
+    errno = saved;
 }
 
-// Validate literal IPv4/IPv6 string.
-static int is_valid_ip_literal(const char *ip) {
-    struct in_addr a4;
-    struct in6_addr a6;
-
-    if (!ip || *ip == '\0') return 0;
-    if (inet_pton(AF_INET, ip, &a4) == 1) return 1;
-    if (inet_pton(AF_INET6, ip, &a6) == 1) return 1;
-    return 0;
+// Signal handler bumps stop level.
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = g_stop + 1;
+    wake_loop();
 }
 
-// Parse CLI args: <ip> <port> <doc_root>.
-int parse_arguments(int argc, char **argv, server_config_t *cfg) {
-    if (!cfg) return -1;
-
-    // Default config values.
-    memset(cfg, 0, sizeof(*cfg));
-    cfg->max_header_size = 8192;
-    cfg->backlog = 128;
-
-    // Expect exactly 3 args after program name.
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <ip> <port> <doc_root>\n", argv[0]);
-        return -1;
-    }
-
-    // Validate and store bind IP.
-    if (!is_valid_ip_literal(argv[1])) {
-        fprintf(stderr, "Invalid IP: %s\n", argv[1]);
-        return -1;
-    }
-    snprintf(g_bind_ip, sizeof(g_bind_ip), "%s", argv[1]);
-
-    // Validate and store port.
-    if (parse_port_number(argv[2]) < 0) {
-        fprintf(stderr, "Invalid port: %s\n", argv[2]);
-        return -1;
-    }
-    snprintf(cfg->port, sizeof(cfg->port), "%s", argv[2]);
-
-    // Canonicalize and validate document root.
-    char canonical[PATH_MAX];
-    if (!realpath(argv[3], canonical)) {
-        perror("realpath(doc_root)");
-        return -1;
-    }
-
-    struct stat st;
-    if (stat(canonical, &st) != 0 || !S_ISDIR(st.st_mode)) {
-        fprintf(stderr, "Document root is not a directory: %s\n", canonical);
-        return -1;
-    }
-    snprintf(cfg->doc_root, sizeof(cfg->doc_root), "%s", canonical);
-
-    // Clamp max header size to safe limits.
-    if (cfg->max_header_size <= 0 || cfg->max_header_size > MAX_HEADER_BYTES) {
-        cfg->max_header_size = 8192;
-    }
-
-    return 0;
+// Signal handler requests hot reload.
+static void on_reload_signal(int sig) {
+    (void)sig;
+    g_reload = 1;
+    wake_loop();
 }
 
-// Create, bind, listen, and set non-blocking listening socket.
-static int init_server_socket(const char *bind_ip, const char *port, int backlog) {
-    struct addrinfo hints, *res = NULL, *p = NULL;
-    int listen_fd = -1;
-
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;       // IPv4 or IPv6
-    hints.ai_socktype = SOCK_STREAM;   // TCP
-    hints.ai_flags = AI_NUMERICHOST;   // bind_ip is numeric literal
+// Signal handler requests config re-read.
+static void on_reconfig_signal(int sig) {
+    (void)sig;
+    g_reconfig = 1;
+    wake_loop();
+}
 
-    int gai = getaddrinfo(bind_ip, port, &hints, &res);
-    if (gai != 0) {
-        fprintf(stderr, "getaddrinfo(%s:%s): %s\n", bind_ip, port, gai_strerror(gai));
-        return -1;
+// Create the wakeup pipe (both ends non-blocking, not inherited).
+static void open_signal_pipe(void) {
+    if (pipe(g_signal_pipe) != 0) {
+        perror("signal pipe");
+        g_signal_pipe[0] = g_signal_pipe[1] = -1;
+        return;
     }
-
-    // Try each candidate until one succeeds.
-    for (p = res; p; p = p->ai_next) {
-        int fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (fd < 0) continue;
-
-        // Allow quick restart after close.
-        int yes = 1;
-        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-
-        if (bind(fd, p->ai_addr, p->ai_addrlen) == 0 &&
-            listen(fd, backlog) == 0 &&
-            set_nonblocking(fd) == 0) {
-            listen_fd = fd;
-            break;
-        }
-
-        close(fd);
+    for (int i = 0; i < 2; i++) {
+        (void)set_nonblocking(g_signal_pipe[i]);
+        (void)set_cloexec(g_signal_pipe[i]);
     }
-
-    freeaddrinfo(res);
-    return listen_fd;
 }
 
 // Return 1 if request buffer contains "\r\n\r\n".
@@ -203,24 +227,52 @@ static int has_header_end(const char *buf, size_t len) {
     return 0;
 }
 
-// Map filesystem errno to HTTP status.
-static int status_from_errno(void) {
-    if (errno == ENOENT || errno == ENOTDIR) return 404;
-    if (errno == EACCES) return 403;
-    return 500;
-}
-
 // Reset one client slot.
+// Slot buffers survive so the next connection can reuse them.
 static void reset_client(client_t *c) {
+    char *req_buf = c->req_buf;
+    size_t req_cap = c->req_cap;
+    unsigned char *chunk = c->chunk;
+    size_t chunk_cap = c->chunk_cap;
+
     memset(c, 0, sizeof(*c));
     c->fd = -1;
     c->file_fd = -1;
+
+    c->req_buf = req_buf;
+    c->req_cap = req_cap;
+    c->chunk = chunk;
+    c->chunk_cap = chunk_cap;
+}
+
+// Size a reusable slot buffer to exactly need bytes. Returns 0 on success.
+static int size_buffer(void **buf, size_t *cap, size_t need) {
+    if (*buf && *cap == need) return 0;
+
+    void *p = realloc(*buf, need);
+    if (!p) return -1;
+
+    *buf = p;
+    *cap = need;
+    return 0;
+}
+
+// Drop whatever the current response holds (file, cached copy, listing, bundle).
+static void release_response(client_t *c) {
+    if (c->file_fd >= 0) close(c->file_fd);
+    if (c->cached) file_cache_release(c->vhost->cache, c->cached);
+    if (c->listing) dir_index_release(c->vhost->listings, c->listing);
+    bundle_unref(c->bundle);
 }
 
 // Close client and clear its poll slot.
 static void close_client_slot(struct pollfd *pfd, client_t *c) {
+    if (c->active) g_num_clients--;
+    h2_conn_destroy(c->h2);
+    tls_conn_destroy(c->tls);
     if (c->fd >= 0) close(c->fd);
-    if (c->file_fd >= 0) close(c->file_fd);
+    release_response(c);
+    if (c->conn_counted) rate_limiter_conn_close(g_rate_limiter, &c->peer, monotonic_ms());
 
     pfd->fd = -1;
     pfd->events = 0;
@@ -229,8 +281,8 @@ static void close_client_slot(struct pollfd *pfd, client_t *c) {
     reset_client(c);
 }
 
-// Build generated HTML error response.
-static int make_error_response(client_t *c, int status, int is_head, int include_allow) {
+// Prebuilt error response: headers copied per connection, body shared.
+static int make_error_response(client_t *c, int status, int is_head) {
     // Error response is memory-backed.
     c->is_head = is_head;
     c->file_fd = -1;
@@ -239,24 +291,10 @@ static int make_error_response(client_t *c, int status, int is_head, int include
     c->chunk_len = 0;
     c->chunk_sent = 0;
 
-    int n = snprintf(c->mem_body, sizeof(c->mem_body),
-                     "<html><body><h1>%d %s</h1></body></html>\n",
-                     status, http_reason_phrase(status));
-    if (n < 0) return -1;
-
-    c->mem_len = (size_t)n;
-    c->mem_sent = 0;
-
-    int h = build_response_headers(
-        c->hdr_buf,
-        sizeof(c->hdr_buf),
-        status,
-        "text/html; charset=utf-8",
-        (off_t)c->mem_len,
-        include_allow
-    );
+    int h = error_page_get(c->vhost->pages, status, is_head, c->hdr_buf, sizeof(c->hdr_buf), &c->mem_body,
+                           &c->mem_len);
     if (h < 0) return -1;
-
+    c->mem_sent = 0;
     c->hdr_len = (size_t)h;
     c->hdr_sent = 0;
     c->mode = MODE_WRITING;
@@ -264,93 +302,405 @@ static int make_error_response(client_t *c, int status, int is_head, int include
     return 0;
 }
 
-// Parse request and prepare success/error response state.
-static int prepare_response(client_t *c, const server_config_t *cfg) {
+// "?format=json" (alone or among other query parameters) selects JSON listings.
+static int wants_json_listing(const char *target) {
+    const char *q = strchr(target, '?');
+    while (q) {
+        q++;
+        if (strncmp(q, "format=json", 11) == 0 && (q[11] == '\0' || q[11] == '&' || q[11] == '#')) {
+            return 1;
+        }
+        q = strchr(q, '&');
+    }
+    return 0;
+}
+
+// Respond with the (cached) listing of the directory open as res->fd.
+// Takes ownership of res->fd and res->entries.
+static int make_listing_response(client_t *c, int is_head, fs_result_t *res) {
+    // Links, title and cache key use the normalized URL path (one
+    // listing however the request spelled it); the request is still in
+    // req_buf.
     http_request_t req;
-    int rc = parse_http_request(c->req_buf, c->req_len, &req);
+    char url_dir[PATH_MAX];
+    int json = 0;
+    int ok = (parse_http_request(c->req_buf, c->req_len, &req) == 0) &&
+             path_normalize(c->req_buf + c->url_off, c->url_len, url_dir, sizeof(url_dir) - 1) == 0;
+    if (ok) {
+        size_t n = strlen(url_dir);
+        if (url_dir[n - 1] != '/') url_dir[n++] = '/';
+        url_dir[n] = '\0';
+        json = wants_json_listing(req.target);
+        c->listing = dir_index_acquire(c->vhost->listings, url_dir, res->path, &res->st, res->fd, res->entries,
+                                       json);
+    } else {
+        dir_entries_free(res->entries);
+    }
+    res->entries = NULL;
+    close(res->fd);
+    res->fd = -1;
+    if (!c->listing) return make_error_response(c, 500, is_head);
 
-    // Parsing/method errors.
-    if (rc == 400) return make_error_response(c, 400, 0, 0);
-    if (rc == 405) return make_error_response(c, 405, 0, 1);
+    size_t len = dir_listing_size(c->listing);
+    int h = build_response_headers(c->hdr_buf, sizeof(c->hdr_buf), 200,
+                                   json ? "application/json; charset=utf-8" : "text/html; charset=utf-8",
+                                   (off_t)len, 0);
+    if (h < 0) return make_error_response(c, 500, is_head);
 
-    int is_head = (req.method == HTTP_METHOD_HEAD);
+    c->hdr_len = (size_t)h;
+    c->hdr_sent = 0;
+    c->is_head = is_head;
+    c->mem_body = dir_listing_data(c->listing);
+    c->mem_len = is_head ? 0 : len;
+    c->mem_sent = 0;
+    c->mode = MODE_WRITING;
+    return 0;
+}
+
+// The request's path is in the site's negative cache (or its name
+// filter) while every change under the root is seen.
+static int known_missing(const client_t *c) {
+    char path[PATH_MAX];
+    return c->vhost->missing && fs_watch_healthy(g_watch) == 0 &&
+           path_normalize(c->req_buf + c->url_off, c->url_len, path, sizeof(path)) == 0 &&
+           neg_cache_missing(c->vhost->missing, path, strlen(path), monotonic_ms());
+}
+
+// Remember a 404 unless a change was reported while its lookup ran.
+static void remember_missing(const client_t *c, const server_config_t *cfg) {
+    char path[PATH_MAX];
+    if (c->vhost->missing && fs_watch_healthy(g_watch) == 0 && c->watch_epoch == g_watch_epoch &&
+        path_normalize(c->req_buf + c->url_off, c->url_len, path, sizeof(path)) == 0) {
+        neg_cache_insert(c->vhost->missing, path, strlen(path),
+                         monotonic_ms() + (uint64_t)cfg->neg_cache_ttl * 1000);
+    }
+}
+
+// Turn a finished file lookup into success/error response state.
+// Takes ownership of res->fd and res->entries.
+static int finish_response(client_t *c, int is_head, fs_result_t *res, const server_config_t *cfg) {
+    if (res->status != 0) {
+        if (res->status == 404) remember_missing(c, cfg);
+        return make_error_response(c, res->status, is_head);
+    }
 
-    // Resolve URL target under doc root safely.
-    char fs_path[PATH_MAX];
-    rc = resolve_path(cfg->doc_root, req.target, fs_path, sizeof(fs_path));
-    if (rc != 0) {
-        if (rc != 400 && rc != 403 && rc != 404) rc = 500;
-        return make_error_response(c, rc, is_head, 0);
+    // Directory without index.html (only resolved with autoindex on).
+    if (S_ISDIR(res->st.st_mode)) {
+        return make_listing_response(c, is_head, res);
     }
 
-    // Stat for existence/type/size.
-    struct stat st;
-    if (stat(fs_path, &st) != 0) {
-        return make_error_response(c, status_from_errno(), is_head, 0);
+    // Remember the resolution while every change under the root is seen
+    // (and none was reported while this lookup ran).
+    if (fs_watch_healthy(g_watch) == 0 && c->watch_epoch == g_watch_epoch) {
+        (void)path_index_insert(c->vhost->paths, c->vhost->doc_root,
+                                c->req_buf + c->url_off, c->url_len, res->path, &res->st);
     }
 
     // Build 200 response headers.
+    char etag[HTTP_ETAG_MAX];
+    format_etag(&res->st, etag, sizeof(etag));
     int h = build_response_headers(
         c->hdr_buf,
         sizeof(c->hdr_buf),
         200,
-        guess_mime_type(fs_path),
-        st.st_size,
+        guess_mime_type(res->path),
+        res->st.st_size,
         0
     );
-    if (h < 0) return make_error_response(c, 500, is_head, 0);
+    if (h >= 0) h = append_response_header(c->hdr_buf, sizeof(c->hdr_buf), h, "ETag", etag);
+    if (h < 0) {
+        if (res->fd >= 0) close(res->fd);
+        return make_error_response(c, 500, is_head);
+    }
 
     c->hdr_len = (size_t)h;
     c->hdr_sent = 0;
 
     // No memory body for success path.
+    c->mem_body = NULL;
     c->mem_len = 0;
     c->mem_sent = 0;
 
     c->is_head = is_head;
 
-    // Reset file stream state.
-    c->file_fd = -1;
-    c->file_size = st.st_size;
+    // Reset file stream state; GET streams the already-open file.
+    c->file_fd = res->fd;
+    c->file_size = res->st.st_size;
     c->file_sent = 0;
     c->chunk_len = 0;
     c->chunk_sent = 0;
 
-    // GET streams file body; HEAD skips body.
-    if (!is_head) {
-        c->file_fd = open(fs_path, O_RDONLY);
-        if (c->file_fd < 0) {
-            return make_error_response(c, status_from_errno(), is_head, 0);
+    // Hot small file: send from the shared in-memory copy, no per-request reads.
+    c->cached = NULL;
+    c->cached_sent = 0;
+    if (c->file_fd >= 0) {
+        c->cached = file_cache_acquire(c->vhost->cache, res->path, &res->st, c->file_fd);
+        if (c->cached) {
+            close(c->file_fd);
+            c->file_fd = -1;
         }
     }
 
+    // Streaming needs the slot's chunk buffer at the configured size.
+    if (c->file_fd >= 0 &&
+        size_buffer((void **)&c->chunk, &c->chunk_cap, cfg->chunk_size) != 0) {
+        close(c->file_fd);
+        c->file_fd = -1;
+        return make_error_response(c, 500, is_head);
+    }
+
+    // Multi-chunk streams: only full segments leave until the last chunk.
+    c->cork = (c->file_fd >= 0 && !is_head && cfg->tcp_cork &&
+               (size_t)c->file_size > c->chunk_cap);
+
     c->mode = MODE_WRITING;
     return 0;
 }
 
+// Answer from the site's bundle: prebuilt header fields, body straight
+// from the mapping. The path is decoded and normalized as for the
+// filesystem; paths missing from the bundle are 404.
+static int make_bundle_response(client_t *c, int is_head, int gzip) {
+    char path[PATH_MAX];
+    int rc = path_normalize(c->req_buf + c->url_off, c->url_len, path, sizeof(path));
+    if (rc != 0) return make_error_response(c, rc, is_head);
+
+    bundle_file_t f;
+    if (bundle_find(c->vhost->bundle, path, strlen(path), gzip, &f) != 0) {
+        return make_error_response(c, 404, is_head);
+    }
+
+    int h = build_headers_with_fields(c->hdr_buf, sizeof(c->hdr_buf), 200, f.fields, f.fields_len);
+    if (h < 0) return make_error_response(c, 500, is_head);
+
+    c->bundle = c->vhost->bundle;
+    bundle_ref(c->bundle);
+
+    c->hdr_len = (size_t)h;
+    c->hdr_sent = 0;
+    c->is_head = is_head;
+    c->mem_body = f.body;
+    c->mem_len = is_head ? 0 : f.body_len;
+    c->mem_sent = 0;
+    c->mode = MODE_WRITING;
+    return 0;
+}
+
+// Answer from the path index without touching the filesystem: HEAD from
+// the remembered metadata, GET when the file is in the memory store.
+// Returns 1 if the response is ready, 0 if a normal lookup is needed.
+static int make_indexed_response(client_t *c, int is_head) {
+    path_info_t info;
+    if (fs_watch_healthy(g_watch) != 0 ||
+        path_index_lookup(c->vhost->paths, c->req_buf + c->url_off, c->url_len, &info) != 0) {
+        return 0;
+    }
+
+    fc_entry_t *e = NULL;
+    if (!is_head) {
+        e = file_cache_acquire_loaded(c->vhost->cache, info.path, &info.st);
+        if (!e) return 0;
+    }
+
+    int h = build_response_headers(c->hdr_buf, sizeof(c->hdr_buf), 200, info.mime, info.st.st_size, 0);
+    if (h >= 0) h = append_response_header(c->hdr_buf, sizeof(c->hdr_buf), h, "ETag", info.etag);
+    if (h < 0) {
+        file_cache_release(c->vhost->cache, e);
+        return 0;
+    }
+
+    c->hdr_len = (size_t)h;
+    c->hdr_sent = 0;
+    c->mem_body = NULL;
+    c->mem_len = 0;
+    c->mem_sent = 0;
+    c->is_head = is_head;
+    c->file_fd = -1;
+    c->file_size = info.st.st_size;
+    c->file_sent = 0;
+    c->cached = e;
+    c->cached_sent = 0;
+    c->mode = MODE_WRITING;
+    return 1;
+}
+
+// Parse request and prepare success/error response state.
+static int prepare_response(client_t *c, const server_config_t *cfg) {
+    http_request_t req;
+    int rc = parse_http_request(c->req_buf, c->req_len, &req);
+
+    // Parsing/method errors.
+    if (rc == 400) return make_error_response(c, 400, 0);
+    if (rc == 405) return make_error_response(c, 405, 0);
+
+    int is_head = (req.method == HTTP_METHOD_HEAD);
+    int flags = (is_head ? 0 : FS_WANT_FD) | (cfg->autoindex ? FS_ALLOW_DIR : 0);
+    c->vhost = vhost_find(g_vhosts, req.host);
+
+    // The target follows the method in req_buf; its path is the index key.
+    const char *sp = memchr(c->req_buf, ' ', c->req_len);
+    c->url_off = sp ? (size_t)(sp + 1 - c->req_buf) : 0;
+    c->url_len = sp ? strcspn(req.target, "?#") : 0;
+    c->watch_epoch = g_watch_epoch;
+    if (sp && c->vhost->bundle) return make_bundle_response(c, is_head, req.accept_gzip);
+    if (sp && make_indexed_response(c, is_head)) return 0;
+    if (sp && known_missing(c)) return make_error_response(c, 404, is_head);
+
+    // Hand blocking resolve/stat/open to the pool when enabled; workers
+    // may shortcut through the path index while it is trusted, and read a
+    // directory's entries so a listing is only rendered here. Inline, they
+    // are read only when the listing cache misses.
+    const path_index_t *paths = (fs_watch_healthy(g_watch) == 0) ? c->vhost->paths : NULL;
+    if (g_fs_pool && !c->is_stream &&
+        fs_pool_submit(g_fs_pool, c->slot, c->gen, c->vhost->doc_root, c->vhost->root_fd, paths, req.target,
+                       (flags & FS_ALLOW_DIR) ? flags | FS_READ_DIR : flags) == 0) {
+        c->is_head = is_head;
+        c->mode = MODE_RESOLVING;
+        return 0;
+    }
+
+    // Inline lookup (no pool, or queueing failed).
+    fs_result_t res;
+    fs_lookup(c->vhost->doc_root, c->vhost->root_fd, req.target, flags, &res);
+    return finish_response(c, is_head, &res, cfg);
+}
+
+// A whole request head is in req_buf: refuse it if this address is over
+// its request rate or the server is shedding load, else prepare the response.
+static int start_response(client_t *c, const server_config_t *cfg) {
+    if (c->has_peer && rate_limiter_take(g_rate_limiter, &c->peer, monotonic_ms()) != 0) {
+        return make_error_response(c, 429, 0);
+    }
+    // Overloaded: refuse before doing any work for it.
+    if (g_overload.shedding) return make_error_response(c, 503, 0);
+    return prepare_response(c, cfg);
+}
+
+// Body bytes of a stream's response, from the source prepare_response chose.
+static ssize_t read_stream_body(void *resp, void *dst, size_t cap) {
+    client_t *s = resp;
+    const char *src = NULL;
+    size_t *sent = NULL;
+    size_t len = 0;
+
+    if (s->mem_body) {
+        src = s->mem_body;
+        len = s->mem_len;
+        sent = &s->mem_sent;
+    } else if (s->cached) {
+        src = fc_entry_data(s->cached);
+        len = fc_entry_size(s->cached);
+        sent = &s->cached_sent;
+    } else if (s->file_fd >= 0) {
+        ssize_t n;
+        do {
+            n = read(s->file_fd, dst, cap);
+        } while (n < 0 && errno == EINTR);
+        return n > 0 ? n : -1;
+    }
+    if (!sent || *sent >= len) return -1;
+
+    size_t n = len - *sent < cap ? len - *sent : cap;
+    memcpy(dst, src + *sent, n);
+    *sent += n;
+    return (ssize_t)n;
+}
+
+static void free_stream(void *resp) {
+    client_t *s = resp;
+    release_response(s);
+    free(s->req_buf);
+    free(s->chunk);
+    free(s);
+}
+
+static const h2_body_ops_t k_stream_ops = {read_stream_body, free_stream};
+
+// Switch c to HTTP/2, handing over what was already read.
+static int start_h2(client_t *c, const server_config_t *cfg) {
+    c->h2 = h2_conn_create(&k_stream_ops, cfg->h2_max_streams);
+    if (!c->h2) return -1;
+
+    h2_feed(c->h2, c->req_buf, c->req_len);
+    c->req_len = 0;
+    c->mode = MODE_H2;
+    return 0;
+}
+
+// Answer the requests completed on HTTP/2 connection c. Each stream is
+// prepared like an HTTP/1.1 request, in a client_t of its own; lookups
+// run inline, so every response is ready here.
+static void open_h2_streams(client_t *c, const server_config_t *cfg) {
+    const char *head;
+    size_t len;
+    uint32_t id;
+
+    while ((id = h2_next_request(c->h2, &head, &len)) != 0) {
+        client_t *s = calloc(1, sizeof(*s));
+        if (!s) {
+            h2_reset(c->h2, id);
+            continue;
+        }
+        reset_client(s);
+        s->is_stream = 1;
+        s->vhost = vhost_default(g_vhosts);
+        s->peer = c->peer;
+        s->has_peer = c->has_peer;
+        if (size_buffer((void **)&s->req_buf, &s->req_cap, cfg->max_header_size + 1) != 0) {
+            free_stream(s);
+            h2_reset(c->h2, id);
+            continue;
+        }
+
+        // Same header limit as HTTP/1.1.
+        int rc;
+        if (len >= s->req_cap - 1) {
+            rc = make_error_response(s, 400, 0);
+        } else {
+            memcpy(s->req_buf, head, len);
+            s->req_buf[len] = '\0';
+            s->req_len = len;
+            rc = start_response(s, cfg);
+        }
+        if (rc < 0) {
+            free_stream(s);
+            h2_reset(c->h2, id);
+            continue;
+        }
+
+        uint64_t body = 0;
+        if (s->mem_body) body = s->mem_len - s->mem_sent;
+        else if (!s->is_head && s->cached) body = fc_entry_size(s->cached);
+        else if (!s->is_head && s->file_fd >= 0) body = (uint64_t)s->file_size;
+        (void)h2_respond(c->h2, id, s, s->hdr_buf, s->hdr_len, body);
+    }
+}
+
 // Read request bytes until full headers are received.
 static int read_client_request(client_t *c, const server_config_t *cfg) {
     for (;;) {
-        ssize_t n = recv(
-            c->fd,
-            c->req_buf + c->req_len,
-            (size_t)cfg->max_header_size - c->req_len,
-            0
-        );
+        char *dst = c->req_buf + c->req_len;
+        size_t room = c->req_cap - 1 - c->req_len;
+        ssize_t n = c->tls ? tls_recv(c->tls, dst, room) : recv(c->fd, dst, room, 0);
 
         if (n > 0) {
             c->req_len += (size_t)n;
             c->req_buf[c->req_len] = '\0';
 
+            // HTTP/2 with prior knowledge: the connection preface, not a
+            // request (frames may already fill the buffer behind it).
+            if (cfg->http2 && h2_is_preface(c->req_buf, c->req_len)) {
+                if (c->req_len < H2_PREFACE_LEN) continue;
+                return start_h2(c, cfg);
+            }
+
             // Reject oversized headers.
-            if (c->req_len >= (size_t)cfg->max_header_size) {
-                return make_error_response(c, 400, 0, 0);
+            if (c->req_len >= c->req_cap - 1) {
+                return make_error_response(c, 400, 0);
             }
 
             // When headers complete, move to response prep.
-            if (has_header_end(c->req_buf, c->req_len)) {
-                return prepare_response(c, cfg);
-            }
+            if (has_header_end(c->req_buf, c->req_len)) return start_response(c, cfg);
 
             // Keep draining readable bytes this loop.
             continue;
@@ -362,12 +712,25 @@ static int read_client_request(client_t *c, const server_config_t *cfg) {
     }
 }
 
+// Send the start of iov: through the TLS library, unless the connection
+// is plain or the kernel encrypts (kTLS).
+static ssize_t send_iov(client_t *c, struct iovec *iov, int cnt, int flags) {
+    if (c->tls && !tls_kernel_send(c->tls)) return tls_sendv(c->tls, iov, cnt);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)cnt;
+    return sendmsg(c->fd, &msg, flags);
+}
+
 // Send memory buffer with partial-send support.
-static int send_buffer(int fd, const void *buf, size_t len, size_t *sent) {
+static int send_buffer(client_t *c, const void *buf, size_t len, size_t *sent) {
     const char *p = (const char *)buf;
 
     while (*sent < len) {
-        ssize_t n = send(fd, p + *sent, len - *sent, 0);
+        struct iovec iov = { (char *)p + *sent, len - *sent };
+        ssize_t n = send_iov(c, &iov, 1, 0);
 
         if (n > 0) {
             *sent += (size_t)n;
@@ -381,15 +744,70 @@ static int send_buffer(int fd, const void *buf, size_t len, size_t *sent) {
     return 1; // Done.
 }
 
+// Send remaining headers plus a body buffer, one sendmsg per attempt.
+// Headers and (small) bodies leave in the same syscall and segment;
+// flags may carry MSG_MORE when further body bytes follow this buffer.
+// Stops (as if the socket were full) once c->budget is used up.
+static int send_with_body(client_t *c, const void *body, size_t body_len, size_t *body_sent, int flags) {
+    while (c->hdr_sent < c->hdr_len || *body_sent < body_len) {
+        if (c->budget == 0) return 0;
+
+        struct iovec iov[2];
+        int cnt = 0;
+
+        if (c->hdr_sent < c->hdr_len) {
+            iov[cnt].iov_base = c->hdr_buf + c->hdr_sent;
+            iov[cnt].iov_len = c->hdr_len - c->hdr_sent;
+            cnt++;
+        }
+        if (*body_sent < body_len) {
+            // Headers always go whole; the body is cut to the budget.
+            size_t room = c->budget > c->hdr_len - c->hdr_sent ? c->budget - (c->hdr_len - c->hdr_sent) : 0;
+            iov[cnt].iov_base = (char *)body + *body_sent;
+            iov[cnt].iov_len = body_len - *body_sent;
+            if (iov[cnt].iov_len > room) {
+                iov[cnt].iov_len = room;
+                flags |= MSG_MORE;
+            }
+            if (iov[cnt].iov_len > 0) cnt++;
+        }
+
+        ssize_t n = send_iov(c, iov, cnt, flags);
+
+        if (n > 0) {
+            // Credit header bytes first, the rest to the body.
+            size_t left = (size_t)n;
+            size_t h = c->hdr_len - c->hdr_sent;
+            if (h > left) h = left;
+            c->hdr_sent += h;
+            *body_sent += left - h;
+            c->budget = (size_t)n < c->budget ? c->budget - (size_t)n : 0;
+            continue;
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+
+    return 1; // Done.
+}
+
 // Stream file body chunk-by-chunk.
+// Unsent headers go out together with the first chunk.
 static int flush_file(client_t *c) {
-    if (c->file_fd < 0) return 1;
+    if (c->cork && !c->corked) c->corked = (set_tcp_cork(c->fd, 1) == 0);
 
     for (;;) {
-        // Load new chunk if needed.
-        if (c->chunk_len == 0 || c->chunk_sent == c->chunk_len) {
-            ssize_t r = read(c->file_fd, c->chunk, sizeof(c->chunk));
-            if (r == 0) return 1; // EOF
+        if (c->budget == 0) return 0;
+
+        // Load new chunk if needed, at our own offset: the fd may be a
+        // duplicate shared with other connections (coalesced lookups).
+        if (c->chunk_sent == c->chunk_len) {
+            ssize_t r = pread(c->file_fd, c->chunk, c->chunk_cap, c->file_sent);
+            if (r == 0) {
+                // EOF (headers alone for an empty file).
+                return send_buffer(c, c->hdr_buf, c->hdr_len, &c->hdr_sent);
+            }
             if (r < 0) {
                 if (errno == EINTR) continue;
                 return -1;
@@ -398,155 +816,821 @@ static int flush_file(client_t *c) {
             c->chunk_sent = 0;
         }
 
-        // Send current chunk.
-        while (c->chunk_sent < c->chunk_len) {
-            ssize_t n = send(
-                c->fd,
-                c->chunk + c->chunk_sent,
-                (size_t)(c->chunk_len - c->chunk_sent),
-                0
-            );
+        // Hint the kernel to coalesce segments while more file data follows.
+        off_t after = c->file_sent + (off_t)(c->chunk_len - c->chunk_sent);
+        int flags = (after < c->file_size) ? MSG_MORE : 0;
 
-            if (n > 0) {
-                c->chunk_sent += n;
-                c->file_sent += n;
-                continue;
-            }
+        // Send current chunk (plus any pending header bytes).
+        size_t sent = (size_t)c->chunk_sent;
+        int r = send_with_body(c, c->chunk, (size_t)c->chunk_len, &sent, flags);
+
+        c->file_sent += (off_t)(sent - (size_t)c->chunk_sent);
+        c->chunk_sent = (ssize_t)sent;
 
-            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
-            return -1;
+        if (r <= 0) return r; // -1 error, 0 would block
+
+        // Whole file queued: push out the partial tail segment now.
+        if (c->corked && c->file_sent >= c->file_size) {
+            (void)set_tcp_cork(c->fd, 0);
+            c->corked = 0;
         }
     }
 }
 
-// Write headers first, then optional body.
+// Write headers together with the body source of this response.
 static int write_client_response(client_t *c) {
-    int r = send_buffer(c->fd, c->hdr_buf, c->hdr_len, &c->hdr_sent);
-    if (r <= 0) return r; // -1 error, 0 would block
+    // Prebuilt error response (already trimmed for HEAD).
+    if (c->mem_body) {
+        return send_with_body(c, c->mem_body, c->mem_len, &c->mem_sent, 0);
+    }
 
     // HEAD is headers-only.
-    if (c->is_head) return 1;
+    if (c->is_head) {
+        return send_buffer(c, c->hdr_buf, c->hdr_len, &c->hdr_sent);
+    }
 
-    // Error pages have memory body.
-    if (c->mem_len > 0) {
-        return send_buffer(c->fd, c->mem_body, c->mem_len, &c->mem_sent);
+    // Mapped hot file.
+    if (c->cached) {
+        return send_with_body(c, fc_entry_data(c->cached), fc_entry_size(c->cached), &c->cached_sent, 0);
     }
 
     // Normal GET streams file.
-    return flush_file(c);
+    if (c->file_fd >= 0) {
+        return flush_file(c);
+    }
+
+    return send_buffer(c, c->hdr_buf, c->hdr_len, &c->hdr_sent);
+}
+
+// This round's send allowance for c.
+static void refill_budget(client_t *c, const server_config_t *cfg) {
+    // Bounded share per round, so one fast download cannot hold up
+    // everyone else; the rest goes next round.
+    c->budget = cfg->write_budget > 0 ? cfg->write_budget : SIZE_MAX;
+
+    // Library TLS sends whole records; a smaller share would stall it.
+    if (c->tls && !tls_kernel_send(c->tls) && c->budget < TLS_RECORD_MAX) c->budget = TLS_RECORD_MAX;
+}
+
+// Send as much of the response as the socket and this round's budget
+// allow. Closes the connection when done or failed; otherwise waits for
+// POLLOUT to continue.
+static void write_or_wait(struct pollfd *pfd, client_t *c, const server_config_t *cfg) {
+    refill_budget(c, cfg);
+    c->last_active_ms = monotonic_ms();
+
+    int wr = write_client_response(c);
+    if (wr != 0) {
+        close_client_slot(pfd, c);
+        return;
+    }
+    pfd->events = (c->tls && !tls_kernel_send(c->tls)) ? tls_wait_events(c->tls) : POLLOUT;
+}
+
+// Send queued HTTP/2 frames. Returns 1 when nothing is left to send now,
+// 0 when the socket or this round's budget is full, -1 on error.
+static int send_h2(client_t *c) {
+    for (;;) {
+        const void *data;
+        size_t len = h2_output(c->h2, &data);
+        if (len == 0) return 1;
+        if (c->budget == 0) return 0;
+        if (len > c->budget) len = c->budget;
+
+        struct iovec iov = {(void *)data, len};
+        ssize_t n = send_iov(c, &iov, 1, 0);
+        if (n > 0) {
+            h2_consume(c->h2, (size_t)n);
+            c->budget -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+}
+
+// HTTP/2 connection: take in frames (up to this round's read budget, and
+// not while the peer leaves our output unread), answer the requests that
+// completed, then send what the flow-control windows and this round's
+// budget allow.
+static void serve_h2(struct pollfd *pfd, client_t *c, const server_config_t *cfg) {
+    size_t read_left = H2_READ_BUDGET;
+    int more_input = 0;
+    for (;;) {
+        if (read_left == 0 || h2_input_paused(c->h2)) {
+            more_input = 1; // Maybe more; back in a later round.
+            break;
+        }
+        size_t want = c->req_cap < read_left ? c->req_cap : read_left;
+        ssize_t n = c->tls ? tls_recv(c->tls, c->req_buf, want) : recv(c->fd, c->req_buf, want, 0);
+        if (n > 0) {
+            h2_feed(c->h2, c->req_buf, (size_t)n);
+            read_left -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        close_client_slot(pfd, c); // Peer closed or hard error.
+        return;
+    }
+
+    open_h2_streams(c, cfg);
+
+    refill_budget(c, cfg);
+    c->last_active_ms = monotonic_ms();
+    int wr = send_h2(c);
+    if (wr < 0 || (wr == 1 && h2_finished(c->h2))) {
+        close_client_slot(pfd, c);
+        return;
+    }
+    // Window updates and new requests arrive as input, unless output has
+    // to drain first. Cut-short input is picked up again through POLLOUT
+    // (the socket is almost always writable; TLS may hold decrypted bytes).
+    short events = h2_input_paused(c->h2) ? 0 : POLLIN;
+    if (wr == 0 || more_input) events |= POLLOUT;
+    pfd->events = events;
+}
+
+// Read what the client sent; once the request is complete, start the
+// response. A prepared response is written right away (the socket is
+// almost always writable). While a pool lookup runs, only errors/hangups
+// matter.
+static void read_and_respond(struct pollfd *pfd, client_t *c, const server_config_t *cfg) {
+    // TLS: the request follows the handshake, which may take a few rounds.
+    if (c->handshaking) {
+        short events = POLLIN;
+        int hs = tls_handshake(c->tls, &events);
+        if (hs < 0) {
+            close_client_slot(pfd, c);
+            return;
+        }
+        if (hs == 0) {
+            pfd->events = events;
+            return;
+        }
+        c->handshaking = 0;
+
+        // ALPN picked HTTP/2: no HTTP/1.1 request will come.
+        if (tls_alpn_h2(c->tls) && start_h2(c, cfg) != 0) {
+            close_client_slot(pfd, c);
+            return;
+        }
+    }
+
+    if (c->mode != MODE_H2 && read_client_request(c, cfg) < 0) {
+        close_client_slot(pfd, c);
+        return;
+    }
+
+    if (c->mode == MODE_WRITING) {
+        write_or_wait(pfd, c, cfg);
+    } else if (c->mode == MODE_RESOLVING) {
+        pfd->events = 0;
+    } else if (c->mode == MODE_H2) {
+        serve_h2(pfd, c, cfg);
+    } else {
+        pfd->events = c->tls ? tls_wait_events(c->tls) : POLLIN;
+    }
 }
 
 // Add new client socket to first free slot.
-static int add_client_to_slot(struct pollfd *pfds, client_t *clients, int client_fd) {
-    for (int i = 1; i <= MAX_CLIENTS; i++) {
+// Returns the slot index, or -1 if the table is full.
+static int add_client_to_slot(struct pollfd *pfds, client_t *clients, int client_fd, size_t max_header) {
+    for (int i = FIRST_CLIENT_SLOT; i < g_num_slots; i++) {
         if (!clients[i].active) {
             reset_client(&clients[i]);
 
+            // Request buffer sized by the current header limit (+ NUL).
+            if (size_buffer((void **)&clients[i].req_buf, &clients[i].req_cap, max_header + 1) != 0) {
+                return -1;
+            }
+
+            // Zero is reserved for "never used".
+            if (++g_next_gen == 0) g_next_gen = 1;
+
             clients[i].active = 1;
+            g_num_clients++;
             clients[i].fd = client_fd;
+            clients[i].slot = i;
+            clients[i].gen = g_next_gen;
             clients[i].mode = MODE_READING;
             clients[i].file_fd = -1;
+            clients[i].vhost = vhost_default(g_vhosts);
+            clients[i].last_active_ms = monotonic_ms();
 
             pfds[i].fd = client_fd;
             pfds[i].events = POLLIN;
             pfds[i].revents = 0;
-            return 0;
+            return i;
         }
     }
     return -1; // No room.
 }
 
 // Accept all pending client connections.
-static void accept_new_clients(int listen_fd, struct pollfd *pfds, client_t *clients) {
-    for (;;) {
+static void accept_new_clients(const listener_t *l, struct pollfd *pfds, client_t *clients, const server_config_t *cfg) {
+    // With every slot taken, leave connections queued in the kernel.
+    while (g_num_clients < g_num_slots - FIRST_CLIENT_SLOT) {
         struct sockaddr_storage addr;
         socklen_t len = sizeof(addr);
 
-        int cfd = accept(listen_fd, (struct sockaddr *)&addr, &len);
+        // Non-blocking client sockets are required for poll loop.
+        int cfd = accept_nonblocking(l->fd, (struct sockaddr *)&addr, &len);
         if (cfd < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == ECONNABORTED || errno == EINTR) continue;
             perror("accept");
             break;
         }
 
-        // Non-blocking client sockets are required for poll loop.
-        if (set_nonblocking(cfd) != 0) {
+        // Per-IP connection cap.
+        rate_key_t key;
+        int has_peer = (rate_key_from_addr((struct sockaddr *)&addr, &key) == 0);
+        int counted = 0;
+        if (has_peer) {
+            counted = rate_limiter_conn_open(g_rate_limiter, &key, monotonic_ms());
+            if (counted < 0) {
+                close(cfd);
+                continue;
+            }
+        }
+
+        // No buffer for the new slot.
+        int slot = add_client_to_slot(pfds, clients, cfd, cfg->max_header_size);
+        if (slot < 0) {
+            if (counted > 0) rate_limiter_conn_close(g_rate_limiter, &key, monotonic_ms());
             close(cfd);
             continue;
         }
 
-        // Drop if client table is full.
-        if (add_client_to_slot(pfds, clients, cfd) != 0) {
-            close(cfd);
+        clients[slot].peer = key;
+        clients[slot].has_peer = has_peer;
+        clients[slot].conn_counted = (counted > 0);
+
+        if (l->tls) {
+            clients[slot].tls = tls_conn_create(g_tls, cfd);
+            if (!clients[slot].tls) {
+                close_client_slot(&pfds[slot], &clients[slot]);
+                continue;
+            }
+            clients[slot].handshaking = 1;
+        }
+
+        // The request usually arrived with the handshake (always, with
+        // deferred accept): answer it now rather than next round.
+        if (cfg->read_on_accept) read_and_respond(&pfds[slot], &clients[slot], cfg);
+    }
+}
+
+// Apply finished pool lookups to their (still connected) clients.
+static void collect_fs_completions(struct pollfd *pfds, client_t *clients, const server_config_t *cfg) {
+    int slot;
+    unsigned gen;
+    fs_result_t res;
+
+    fs_pool_ack(g_fs_pool);
+
+    while (fs_pool_next_done(g_fs_pool, &slot, &gen, &res)) {
+        client_t *c = &clients[slot];
+
+        // Client went away (or slot was reused) while the lookup ran.
+        if (!c->active || c->gen != gen || c->mode != MODE_RESOLVING) {
+            if (res.fd >= 0) close(res.fd);
+            dir_entries_free(res.entries);
+            continue;
+        }
+
+        if (finish_response(c, c->is_head, &res, cfg) < 0) {
+            close_client_slot(&pfds[slot], c);
+            continue;
+        }
+        write_or_wait(&pfds[slot], c, cfg);
+    }
+}
+
+// A path under some document root changed (NULL: unknown, drop everything).
+static void on_fs_change(const char *path, int is_dir, void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < vhost_count(g_vhosts); i++) {
+        vhost_t *s = (vhost_t *)vhost_at(g_vhosts, i);
+        size_t n = strlen(s->doc_root);
+
+        if (!path) {
+            path_index_clear(s->paths);
+            file_cache_clear(s->cache);
+            dir_index_clear(s->listings);
+            neg_cache_changed(s->missing, s->doc_root, NULL);
+        } else if (strncmp(path, s->doc_root, n) == 0 && (path[n] == '\0' || path[n] == '/')) {
+            path_index_invalidate(s->paths, s->doc_root, path, is_dir);
+            file_cache_invalidate(s->cache, path, is_dir);
+            dir_index_invalidate(s->listings, path, is_dir);
+            neg_cache_changed(s->missing, s->doc_root, path);
+        }
+    }
+}
+
+// Apply pending change events; if coverage was lost, stop trusting the index.
+static void collect_fs_changes(void) {
+    int was_healthy = (fs_watch_healthy(g_watch) == 0);
+    g_watch_epoch++;
+    // Lookups started before these changes are not joined any more.
+    fs_pool_end_flights(g_fs_pool);
+    fs_watch_dispatch(g_watch, on_fs_change, NULL);
+
+    if (was_healthy && fs_watch_healthy(g_watch) != 0) {
+        fprintf(stderr, "Change watching incomplete; revalidating every request.\n");
+        for (int i = 0; i < vhost_count(g_vhosts); i++) {
+            path_index_clear(((vhost_t *)vhost_at(g_vhosts, i))->paths);
+        }
+    }
+    rcu_reclaim();
+}
+
+// Watch every document root. Returns NULL (caches keep revalidating per
+// request) when watching is off, unsupported or cannot cover every directory.
+static fs_watch_t *setup_watch(const server_config_t *cfg) {
+    if (!cfg->watch) return NULL;
+
+    fs_watch_t *w = fs_watch_create();
+    if (!w) {
+        fprintf(stderr, "Change watching unavailable; revalidating every request.\n");
+        return NULL;
+    }
+    for (int i = 0; i < vhost_count(g_vhosts); i++) {
+        if (fs_watch_add_tree(w, vhost_at(g_vhosts, i)->doc_root) != 0) {
+            fprintf(stderr, "Change watching incomplete; revalidating every request.\n");
+            fs_watch_destroy(w);
+            return NULL;
+        }
+    }
+    return w;
+}
+
+// Environment handed to a successor started by hot reload.
+#define ENV_LISTEN_FDS "HTTPD_LISTEN_FDS"
+#define ENV_READY_FD "HTTPD_READY_FD"
+
+// Use listening sockets inherited from a predecessor, else open the
+// configured ones. Returns the number of listeners, or -1 on failure.
+static int setup_listeners(const server_config_t *cfg) {
+    int n = listeners_inherit(getenv(ENV_LISTEN_FDS), g_listeners);
+    unsetenv(ENV_LISTEN_FDS);
+    if (n == 0) n = listeners_open(cfg, g_listeners);
+    return n;
+}
+
+// Tell a predecessor waiting on hot reload that we are serving.
+static void notify_predecessor(void) {
+    const char *v = getenv(ENV_READY_FD);
+    if (!v) return;
+
+    long fd;
+    if (parse_long(v, 0, INT_MAX, &fd) == 0) {
+        char b = 1;
+        ssize_t w = write((int)fd, &b, 1);
+        (void)w;
+        close((int)fd);
+    }
+    unsetenv(ENV_READY_FD);
+}
+
+// Build envp for the successor: current environment plus handoff vars.
+static char **build_successor_env(char *listen_var, char *ready_var) {
+    size_t n = 0;
+    while (environ[n]) n++;
+
+    char **envp = calloc(n + 3, sizeof(*envp));
+    if (!envp) return NULL;
+
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (strncmp(environ[i], ENV_LISTEN_FDS "=", strlen(ENV_LISTEN_FDS) + 1) == 0) continue;
+        if (strncmp(environ[i], ENV_READY_FD "=", strlen(ENV_READY_FD) + 1) == 0) continue;
+        envp[k++] = environ[i];
+    }
+    envp[k++] = listen_var;
+    envp[k++] = ready_var;
+    envp[k] = NULL;
+    return envp;
+}
+
+// Exec a fresh copy of this binary that inherits every listener.
+// Returns the read end of its readiness pipe, or -1 on failure.
+static int spawn_successor(char **argv, pid_t *pid_out) {
+    int ready[2];
+    if (pipe(ready) != 0) return -1;
+    (void)set_cloexec(ready[0]);
+    (void)set_cloexec(ready[1]);
+
+    // Everything the child needs is prepared before fork().
+    char listen_var[sizeof(ENV_LISTEN_FDS) + MAX_LISTENERS * 16];
+    char ready_var[64];
+    size_t off = (size_t)snprintf(listen_var, sizeof(listen_var), "%s=", ENV_LISTEN_FDS);
+    for (int i = 0; i < g_num_listeners; i++) {
+        off += (size_t)snprintf(listen_var + off, sizeof(listen_var) - off, "%s%s%d", i ? "," : "",
+                                g_listeners[i].tls ? "tls:" : "", g_listeners[i].fd);
+    }
+    snprintf(ready_var, sizeof(ready_var), "%s=%d", ENV_READY_FD, ready[1]);
+
+    char **envp = build_successor_env(listen_var, ready_var);
+    if (!envp) {
+        close(ready[0]);
+        close(ready[1]);
+        return -1;
+    }
+
+    // Prefer the path we were started as, so a binary replaced on disk
+    // is picked up; /proc/self/exe covers PATH-relative invocations.
+    const char *self = strchr(argv[0], '/') ? argv[0] : "/proc/self/exe";
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child: only the listeners and the ready pipe survive exec.
+        for (int i = 0; i < g_num_listeners; i++) fcntl(g_listeners[i].fd, F_SETFD, 0);
+        fcntl(ready[1], F_SETFD, 0);
+        execve(self, argv, envp);
+        _exit(127);
+    }
+
+    free(envp);
+    close(ready[1]);
+
+    if (pid < 0) {
+        close(ready[0]);
+        return -1;
+    }
+
+    *pid_out = pid;
+    return ready[0];
+}
+
+// Stop accepting; in-flight responses continue until done or deadline.
+static void begin_drain(struct pollfd *pfds, client_t *clients) {
+    listeners_close(g_listeners, g_num_listeners);
+    for (int i = 0; i < g_num_listeners; i++) pfds[FIRST_LISTEN_SLOT + i].fd = -1;
+
+    // Connections that have not sent anything yet have nothing in flight;
+    // HTTP/2 ones are told to open no more streams (GOAWAY) and close
+    // once the open ones are answered.
+    for (int i = FIRST_CLIENT_SLOT; i < g_num_slots; i++) {
+        if (clients[i].active && clients[i].mode == MODE_READING && clients[i].req_len == 0) {
+            close_client_slot(&pfds[i], &clients[i]);
+        } else if (clients[i].active && clients[i].mode == MODE_H2) {
+            h2_shutdown(clients[i].h2);
+            pfds[i].events |= POLLOUT;
         }
     }
 }
 
+static int count_active_clients(const client_t *clients) {
+    int n = 0;
+    for (int i = FIRST_CLIENT_SLOT; i < g_num_slots; i++) {
+        if (clients[i].active) n++;
+    }
+    return n;
+}
+
+// SIGHUP: re-read settings and push the live-changeable ones into place.
+// Header limit and chunk size take effect for new connections/responses.
+static void reload_live_config(server_config_t *cfg) {
+    if (reload_arguments(cfg) != 0) {
+        fprintf(stderr, "Config reload failed; keeping current settings.\n");
+        return;
+    }
+
+    for (int i = 0; i < g_num_listeners; i++) listener_apply_options(&g_listeners[i], cfg);
+
+    if (g_rate_limiter) {
+        rate_limiter_configure(g_rate_limiter, cfg->max_conns_per_ip, cfg->rate_limit, cfg->rate_burst);
+    } else if (cfg->max_conns_per_ip > 0 || cfg->rate_limit > 0.0) {
+        g_rate_limiter = rate_limiter_create(cfg->rate_table_size,
+                                             cfg->max_conns_per_ip,
+                                             cfg->rate_limit,
+                                             cfg->rate_burst);
+    }
+
+    vhost_table_apply_limits(g_vhosts, cfg);
+    // autoindex decides whether "dir/" is a 404.
+    for (int i = 0; i < vhost_count(g_vhosts); i++) neg_cache_forget(vhost_at(g_vhosts, i)->missing);
+    vhost_table_set_bundle(g_vhosts, cfg->bundle);
+    overload_configure(&g_overload, cfg->overload_lag, cfg->overload_queue);
+
+    fprintf(stdout, "Configuration reloaded.\n");
+    fflush(stdout);
+}
+
+// Close connections that made no progress within the client timeout.
+// Connections waiting on a pool lookup are not idle.
+static void expire_idle_clients(struct pollfd *pfds, client_t *clients, uint64_t now, int timeout_s) {
+    if (timeout_s <= 0) return;
+
+    uint64_t limit = (uint64_t)timeout_s * 1000u;
+    for (int i = FIRST_CLIENT_SLOT; i < g_num_slots; i++) {
+        client_t *c = &clients[i];
+        if (!c->active || c->mode == MODE_RESOLVING) continue;
+        if (now - c->last_active_ms >= limit) close_client_slot(&pfds[i], c);
+    }
+}
+
+// Release everything run_server set up (safe on partial setup).
+static void free_server_state(void) {
+    // Workers may still hold opened fds; destroy closes them.
+    fs_pool_destroy(g_fs_pool);
+    g_fs_pool = NULL;
+
+    fs_watch_destroy(g_watch);
+    g_watch = NULL;
+
+    // All cached copies were released with their clients.
+    vhost_table_destroy(g_vhosts);
+    g_vhosts = NULL;
+    rcu_reclaim();
+    rate_limiter_destroy(g_rate_limiter);
+    g_rate_limiter = NULL;
+    tls_server_destroy(g_tls);
+    g_tls = NULL;
+    listeners_close(g_listeners, g_num_listeners);
+
+    for (int i = 0; i < 2; i++) {
+        if (g_signal_pipe[i] >= 0) close(g_signal_pipe[i]);
+        g_signal_pipe[i] = -1;
+    }
+}
+
 // Run poll-based server loop.
-int run_server(const server_config_t *cfg) {
+int run_server(server_config_t *cfg) {
     if (!cfg) return 1;
 
     // Signal behavior:
-    // - SIGINT/SIGTERM -> graceful stop
+    // - SIGINT/SIGTERM -> graceful drain (second signal: stop now)
+    // - SIGUSR2 -> hot reload: exec successor on same socket, then drain
+    // - SIGHUP -> re-read config file (settings safe to change live)
     // - SIGPIPE ignored so send() gives error instead of process kill
+    // Handlers set a flag and wake poll() through the signal pipe.
+    open_signal_pipe();
     signal(SIGINT, on_signal);
     signal(SIGTERM, on_signal);
+    signal(SIGUSR2, on_reload_signal);
+    signal(SIGHUP, on_reconfig_signal);
     signal(SIGPIPE, SIG_IGN);
 
-    // Initialize listening socket.
-    int listen_fd = init_server_socket(g_bind_ip, cfg->port, cfg->backlog);
-    if (listen_fd < 0) {
+    // Initialize listening socket (or take over the predecessor's).
+    g_num_listeners = setup_listeners(cfg);
+    if (g_num_listeners <= 0) {
+        g_num_listeners = 0;
         fprintf(stderr, "Failed to initialize server socket\n");
         return 1;
     }
+    for (int i = 0; i < g_num_listeners; i++) listener_apply_options(&g_listeners[i], cfg);
+
+    // Certificate for TLS listeners (read once; a reload re-reads it).
+    for (int i = 0; i < g_num_listeners && !g_tls; i++) {
+        if (!g_listeners[i].tls) continue;
+        if (cfg->tls_cert[0] == '\0' || cfg->tls_key[0] == '\0') {
+            fprintf(stderr, "TLS listener %s needs --tls-cert and --tls-key\n", g_listeners[i].name);
+            free_server_state();
+            return 1;
+        }
+        g_tls = tls_server_create(cfg->tls_cert, cfg->tls_key, cfg->tls_tickets, cfg->http2);
+        if (!g_tls) {
+            free_server_state();
+            return 1;
+        }
+    }
+
+    // Sites: prebuilt error responses (custom <status>.html pages read
+    // once here) and a store for hot small files, per document root.
+    g_vhosts = vhost_table_create(cfg);
+    if (!g_vhosts) {
+        fprintf(stderr, "Failed to set up document roots\n");
+        free_server_state();
+        return 1;
+    }
+
+    // Change events replace per-request revalidation where possible.
+    g_watch = setup_watch(cfg);
+
+    // Warm-up after the watch exists, so changes made during the walk
+    // still invalidate what it recorded.
+    if (cfg->warmup > 0) {
+        uint64_t t0 = monotonic_ms();
+        long n = warmup_sites(g_vhosts, cfg, fs_watch_healthy(g_watch) == 0);
+        fprintf(stdout, "Warm-up: %ld file(s) in %llu ms\n", n, (unsigned long long)(monotonic_ms() - t0));
+    }
+
+    // Name filters, also once the watch exists; without it they are unused.
+    if (cfg->neg_filter && fs_watch_healthy(g_watch) == 0) {
+        uint64_t t0 = monotonic_ms();
+        long n = 0;
+        for (int i = 0; i < vhost_count(g_vhosts); i++) {
+            long names = neg_cache_build(vhost_at(g_vhosts, i)->missing, vhost_at(g_vhosts, i)->doc_root);
+            if (names < 0) fprintf(stderr, "Cannot build name filter for %s\n", vhost_at(g_vhosts, i)->doc_root);
+            else n += names;
+        }
+        fprintf(stdout, "Name filter: %ld name(s) in %llu ms\n", n, (unsigned long long)(monotonic_ms() - t0));
+    }
+
+    // Optional filesystem worker pool.
+    if (cfg->fs_threads > 0) {
+        g_fs_pool = fs_pool_create(cfg->fs_threads);
+        if (!g_fs_pool) {
+            fprintf(stderr, "Failed to start filesystem worker pool\n");
+            free_server_state();
+            return 1;
+        }
+    }
+
+    // Per-IP limits.
+    if (cfg->max_conns_per_ip > 0 || cfg->rate_limit > 0.0) {
+        g_rate_limiter = rate_limiter_create(cfg->rate_table_size,
+                                             cfg->max_conns_per_ip,
+                                             cfg->rate_limit,
+                                             cfg->rate_burst);
+        if (!g_rate_limiter) {
+            fprintf(stderr, "Failed to create rate limiter\n");
+            free_server_state();
+            return 1;
+        }
+    }
 
     // Allocate poll and client arrays.
-    struct pollfd *pfds = calloc((size_t)MAX_CLIENTS + 1, sizeof(*pfds));
-    client_t *clients = calloc((size_t)MAX_CLIENTS + 1, sizeof(*clients));
+    g_num_slots = FIRST_CLIENT_SLOT + cfg->max_clients;
+    struct pollfd *pfds = calloc((size_t)g_num_slots, sizeof(*pfds));
+    client_t *clients = calloc((size_t)g_num_slots, sizeof(*clients));
     if (!pfds || !clients) {
         perror("calloc");
         free(pfds);
         free(clients);
-        close(listen_fd);
+        free_server_state();
         return 1;
     }
 
     // Initialize all slots to empty.
-    for (int i = 0; i <= MAX_CLIENTS; i++) {
+    for (int i = 0; i < g_num_slots; i++) {
         pfds[i].fd = -1;
         pfds[i].events = 0;
         pfds[i].revents = 0;
         reset_client(&clients[i]);
     }
 
-    // Poll slot 0 reserved for listening socket.
-    pfds[0].fd = listen_fd;
-    pfds[0].events = POLLIN;
+    // Fixed slots: listening sockets, pool completion pipe, change watcher
+    // and signal pipe. The reload slot is filled while a successor is starting.
+    for (int i = 0; i < g_num_listeners; i++) {
+        pfds[FIRST_LISTEN_SLOT + i].fd = g_listeners[i].fd;
+        pfds[FIRST_LISTEN_SLOT + i].events = POLLIN;
+        fprintf(stdout, "Server listening on %s\n", g_listeners[i].name);
+    }
+    pfds[SLOT_FSPOOL].fd = fs_pool_notify_fd(g_fs_pool);
+    pfds[SLOT_FSPOOL].events = POLLIN;
+    pfds[SLOT_FSWATCH].fd = fs_watch_fd(g_watch);
+    pfds[SLOT_FSWATCH].events = POLLIN;
+    pfds[SLOT_SIGNAL].fd = g_signal_pipe[0];
+    pfds[SLOT_SIGNAL].events = POLLIN;
 
-    fprintf(stdout, "Server listening on %s:%s\n", g_bind_ip, cfg->port);
     fprintf(stdout, "Document root: %s\n", cfg->doc_root);
+    if (cfg->bundle[0] != '\0') fprintf(stdout, "Bundle: %s\n", cfg->bundle);
+    for (int i = 0; i < cfg->num_vhosts; i++) fprintf(stdout, "Virtual host: %s\n", cfg->vhost[i]);
+    fflush(stdout);
+
+    // Serving now; a predecessor may start draining.
+    notify_predecessor();
+
+    int draining = 0;
+    uint64_t drain_deadline = 0;
+    uint64_t last_idle_sweep = monotonic_ms();
+    uint64_t work_start = last_idle_sweep;
+    int rr_start = 0;
+    pid_t successor = -1;
+
+    memset(&g_overload, 0, sizeof(g_overload));
+    overload_configure(&g_overload, cfg->overload_lag, cfg->overload_queue);
 
     // Main event loop.
-    while (!g_stop) {
-        int n = poll(pfds, MAX_CLIENTS + 1, 1000);
+    for (;;) {
+        // Config re-read requested.
+        if (g_reconfig) {
+            g_reconfig = 0;
+            reload_live_config(cfg);
+        }
+
+        // Hot reload requested: start successor, keep serving until it is up.
+        if (g_reload) {
+            g_reload = 0;
+            if (!draining && pfds[SLOT_RELOAD].fd < 0) {
+                pfds[SLOT_RELOAD].fd = spawn_successor(cfg->argv, &successor);
+                pfds[SLOT_RELOAD].events = POLLIN;
+                if (pfds[SLOT_RELOAD].fd < 0) perror("hot reload");
+            }
+        }
+
+        // Stop requested: drain in-flight work, or stop at once on a repeat.
+        if (g_stop > 1) break;
+        if (g_stop && !draining) {
+            begin_drain(pfds, clients);
+            draining = 1;
+            drain_deadline = monotonic_ms() + (uint64_t)cfg->drain_timeout * 1000u;
+            fprintf(stdout, "Draining %d connection(s)...\n", count_active_clients(clients));
+            fflush(stdout);
+        }
+        if (draining) {
+            if (count_active_clients(clients) == 0) break;
+            if (monotonic_ms() >= drain_deadline) {
+                fprintf(stdout, "Drain deadline reached.\n");
+                break;
+            }
+        }
+
+        // Feed the time the last round of events took (what a ready
+        // socket waited) and the lookup backlog to the shedding decision.
+        if (overload_update(&g_overload, monotonic_ms() - work_start, fs_pool_queued(g_fs_pool))) {
+            if (g_overload.shedding) {
+                fprintf(stderr, "Overloaded (loop %.1f ms, %zu lookups queued); answering 503.\n",
+                        g_overload.lag_ms, g_overload.queued);
+            } else {
+                fprintf(stderr, "Load back to normal.\n");
+            }
+        }
+
+        // Listen only while a slot is free; otherwise clients wait in the
+        // backlog instead of being accepted and dropped.
+        short listen_events = (g_num_clients < g_num_slots - FIRST_CLIENT_SLOT) ? POLLIN : 0;
+        for (int i = 0; i < g_num_listeners; i++) pfds[FIRST_LISTEN_SLOT + i].events = listen_events;
+
+        int n = poll(pfds, g_num_slots, 1000);
         if (n < 0) {
             if (errno == EINTR) continue;
             perror("poll");
             break;
         }
+
+        // Once a second: age out idle per-IP entries and stalled clients,
+        // look for a replaced bundle and free retired index entries.
+        uint64_t now = monotonic_ms();
+        work_start = now;
+        rate_limiter_sweep(g_rate_limiter, now);
+        if (now - last_idle_sweep >= 1000) {
+            expire_idle_clients(pfds, clients, now, cfg->client_timeout);
+            if (cfg->bundle[0] != '\0') vhost_table_set_bundle(g_vhosts, cfg->bundle);
+            rcu_reclaim();
+            last_idle_sweep = now;
+        }
+
         if (n == 0) continue; // timeout
 
         // Accept new connections.
-        if (pfds[0].revents & POLLIN) {
-            accept_new_clients(listen_fd, pfds, clients);
+        for (int i = 0; i < g_num_listeners; i++) {
+            if (pfds[FIRST_LISTEN_SLOT + i].revents & POLLIN) {
+                accept_new_clients(&g_listeners[i], pfds, clients, cfg);
+            }
+        }
+
+        // Signal arrived: empty the pipe; its flags are acted on at the top
+        // of the loop.
+        if (pfds[SLOT_SIGNAL].revents & POLLIN) {
+            char buf[64];
+            while (read(g_signal_pipe[0], buf, sizeof(buf)) > 0) {
+            }
+        }
+
+        // Files changed under a document root.
+        if (pfds[SLOT_FSWATCH].revents & POLLIN) {
+            collect_fs_changes();
+        }
+
+        // Finished filesystem lookups.
+        if (pfds[SLOT_FSPOOL].revents & POLLIN) {
+            collect_fs_completions(pfds, clients, cfg);
         }
 
-        // Handle client events.
-        for (int i = 1; i <= MAX_CLIENTS; i++) {
+        // Successor reported (byte = serving, EOF = it died first).
+        if (pfds[SLOT_RELOAD].revents & (POLLIN | POLLHUP)) {
+            char b = 0;
+            ssize_t r = read(pfds[SLOT_RELOAD].fd, &b, 1);
+            close(pfds[SLOT_RELOAD].fd);
+            pfds[SLOT_RELOAD].fd = -1;
+
+            if (r == 1) {
+                fprintf(stdout, "Successor %ld is serving; draining.\n", (long)successor);
+                g_stop = 1;
+            } else {
+                fprintf(stderr, "Successor failed to start; still serving.\n");
+                waitpid(successor, NULL, 0);
+            }
+            successor = -1;
+            continue;
+        }
+
+        // Handle client events, starting one slot further each round so
+        // no connection is always served first.
+        int num_client_slots = g_num_slots - FIRST_CLIENT_SLOT;
+        rr_start = (rr_start + 1) % num_client_slots;
+        for (int k = 0; k < num_client_slots; k++) {
+            int i = FIRST_CLIENT_SLOT + (rr_start + k) % num_client_slots;
             if (!clients[i].active) continue;
 
             short rev = pfds[i].revents;
             if (rev == 0) continue;
+            clients[i].last_active_ms = now;
 
             // Close on poll/socket errors.
             if (rev & (POLLERR | POLLHUP | POLLNVAL)) {
@@ -554,39 +1638,43 @@ int run_server(const server_config_t *cfg) {
                 continue;
             }
 
-            // Read phase.
-            if (clients[i].mode == MODE_READING && (rev & POLLIN)) {
-                if (read_client_request(&clients[i], cfg) < 0) {
-                    close_client_slot(&pfds[i], &clients[i]);
-                    continue;
-                }
-
-                // If response is prepared, switch to write events.
-                if (clients[i].mode == MODE_WRITING) {
-                    pfds[i].events = POLLOUT;
-                }
+            // HTTP/2: reading and writing interleave.
+            if (clients[i].mode == MODE_H2) {
+                serve_h2(&pfds[i], &clients[i], cfg);
+                continue;
+            }
+
+            // Read phase (TLS may wait for POLLOUT here, and POLLIN
+            // while writing).
+            if (clients[i].mode == MODE_READING && (rev & (POLLIN | POLLOUT))) {
+                read_and_respond(&pfds[i], &clients[i], cfg);
+                continue;
             }
 
             // Write phase.
-            if (clients[i].active &&
-                clients[i].mode == MODE_WRITING &&
-                (rev & POLLOUT)) {
-                int wr = write_client_response(&clients[i]);
-
-                // Done or failed -> close connection.
-                if (wr < 0 || wr > 0) {
-                    close_client_slot(&pfds[i], &clients[i]);
-                }
+            if (clients[i].mode == MODE_WRITING && (rev & (POLLIN | POLLOUT))) {
+                write_or_wait(&pfds[i], &clients[i], cfg);
             }
         }
     }
 
-    // Cleanup active clients.
-    for (int i = 1; i <= MAX_CLIENTS; i++) {
+    // Cleanup remaining clients (drain deadline passed or forced stop).
+    for (int i = FIRST_CLIENT_SLOT; i < g_num_slots; i++) {
         if (clients[i].active) close_client_slot(&pfds[i], &clients[i]);
+        free(clients[i].req_buf);
+        free(clients[i].chunk);
+    }
+
+    if (pfds[SLOT_RELOAD].fd >= 0) close(pfds[SLOT_RELOAD].fd);
+
+    if (g_fs_pool) {
+        unsigned long run, joined;
+        fs_pool_counts(g_fs_pool, &run, &joined);
+        fprintf(stdout, "Lookups: %lu run, %lu joined\n", run, joined);
     }
 
-    close(listen_fd);
+    free_server_state();
+
     free(pfds);
     free(clients);
 
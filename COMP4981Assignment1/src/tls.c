@@ -0,0 +1,274 @@
+#include "tls.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_OPENSSL
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+// Sessions remembered for resumption by session ID.
+#define TLS_SESSION_CACHE 20000
+
+struct tls_server {
+    SSL_CTX *ctx;
+    int h2;                  // offer HTTP/2 through ALPN
+};
+
+struct tls_conn {
+    SSL *ssl;
+    short wait;              // events the last SSL_ERROR_WANT_* asked for
+    int kernel_send;         // kTLS took over the send side
+};
+
+// Print and clear the OpenSSL error queue.
+static void report_errors(const char *what) {
+    unsigned long e;
+    char buf[256];
+    int any = 0;
+    while ((e = ERR_get_error()) != 0) {
+        ERR_error_string_n(e, buf, sizeof(buf));
+        fprintf(stderr, "%s: %s\n", what, buf);
+        any = 1;
+    }
+    if (!any) fprintf(stderr, "%s failed\n", what);
+}
+
+// ALPN: "h2" when enabled and offered, else "http/1.1" (or no protocol).
+static int select_alpn(SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                       const unsigned char *in, unsigned int inlen, void *arg) {
+    (void)ssl;
+    const tls_server_t *ts = arg;
+    const unsigned char *http11 = NULL;
+
+    for (unsigned i = 0; i < inlen && i + 1 + in[i] <= inlen; i += 1u + in[i]) {
+        if (ts->h2 && in[i] == 2 && memcmp(in + i + 1, "h2", 2) == 0) {
+            *out = in + i + 1;
+            *outlen = 2;
+            return SSL_TLSEXT_ERR_OK;
+        }
+        if (in[i] == 8 && memcmp(in + i + 1, "http/1.1", 8) == 0) http11 = in + i + 1;
+    }
+    if (!http11) return SSL_TLSEXT_ERR_NOACK;
+    *out = http11;
+    *outlen = 8;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+tls_server_t *tls_server_create(const char *cert_file, const char *key_file, int tickets, int h2) {
+    tls_server_t *ts = calloc(1, sizeof(*ts));
+    if (!ts) return NULL;
+    ts->h2 = h2;
+
+    ts->ctx = SSL_CTX_new(TLS_server_method());
+    if (!ts->ctx) {
+        report_errors("TLS context");
+        free(ts);
+        return NULL;
+    }
+
+    SSL_CTX_set_min_proto_version(ts->ctx, TLS1_2_VERSION);
+
+    // Partial writes let one record go out per send attempt; the write
+    // buffer may move between retries (it is rebuilt from the response).
+    SSL_CTX_set_mode(ts->ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    long opts = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+#ifdef SSL_OP_ENABLE_KTLS
+    opts |= SSL_OP_ENABLE_KTLS;
+#endif
+    if (!tickets) opts |= SSL_OP_NO_TICKET;
+    SSL_CTX_set_options(ts->ctx, opts);
+
+    // Resumption: stateless tickets (keys rotate inside OpenSSL) plus a
+    // server-side cache for clients that resume by session ID.
+    static const unsigned char sid_ctx[] = "comp4981-httpd";
+    SSL_CTX_set_session_id_context(ts->ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(ts->ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ts->ctx, TLS_SESSION_CACHE);
+    SSL_CTX_set_alpn_select_cb(ts->ctx, select_alpn, ts);
+
+    if (SSL_CTX_use_certificate_chain_file(ts->ctx, cert_file) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ts->ctx, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ts->ctx) != 1) {
+        report_errors("TLS certificate/key");
+        tls_server_destroy(ts);
+        return NULL;
+    }
+    return ts;
+}
+
+void tls_server_destroy(tls_server_t *ts) {
+    if (!ts) return;
+    SSL_CTX_free(ts->ctx);
+    free(ts);
+}
+
+tls_conn_t *tls_conn_create(tls_server_t *ts, int fd) {
+    tls_conn_t *tc = calloc(1, sizeof(*tc));
+    if (!tc) return NULL;
+
+    tc->ssl = SSL_new(ts->ctx);
+    if (!tc->ssl || SSL_set_fd(tc->ssl, fd) != 1) {
+        SSL_free(tc->ssl);
+        free(tc);
+        ERR_clear_error();
+        return NULL;
+    }
+    SSL_set_accept_state(tc->ssl);
+    return tc;
+}
+
+void tls_conn_destroy(tls_conn_t *tc) {
+    if (!tc) return;
+
+    // One non-blocking close_notify; the peer may already be gone.
+    if (SSL_is_init_finished(tc->ssl)) (void)SSL_shutdown(tc->ssl);
+    SSL_free(tc->ssl);
+    ERR_clear_error();
+    free(tc);
+}
+
+// Map an SSL result to EAGAIN + wait events, or a hard failure.
+static int classify(tls_conn_t *tc, int rc) {
+    int err = SSL_get_error(tc->ssl, rc);
+    if (err == SSL_ERROR_WANT_READ) {
+        tc->wait = POLLIN;
+        errno = EAGAIN;
+        return 0;
+    }
+    if (err == SSL_ERROR_WANT_WRITE) {
+        tc->wait = POLLOUT;
+        errno = EAGAIN;
+        return 0;
+    }
+    ERR_clear_error();
+    errno = (err == SSL_ERROR_SYSCALL && errno != 0) ? errno : EPROTO;
+    return -1;
+}
+
+int tls_handshake(tls_conn_t *tc, short *events) {
+    int rc = SSL_do_handshake(tc->ssl);
+    if (rc == 1) {
+        tc->kernel_send = (BIO_get_ktls_send(SSL_get_wbio(tc->ssl)) == 1);
+        return 1;
+    }
+    if (classify(tc, rc) < 0) return -1;
+    *events = tc->wait;
+    return 0;
+}
+
+int tls_kernel_send(const tls_conn_t *tc) {
+    return tc && tc->kernel_send;
+}
+
+int tls_alpn_h2(const tls_conn_t *tc) {
+    const unsigned char *proto = NULL;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(tc->ssl, &proto, &len);
+    return len == 2 && memcmp(proto, "h2", 2) == 0;
+}
+
+ssize_t tls_recv(tls_conn_t *tc, void *buf, size_t len) {
+    size_t got = 0;
+    int rc = SSL_read_ex(tc->ssl, buf, len, &got);
+    if (rc == 1) return (ssize_t)got;
+
+    if (SSL_get_error(tc->ssl, rc) == SSL_ERROR_ZERO_RETURN) return 0;
+    (void)classify(tc, rc);
+    return -1;
+}
+
+ssize_t tls_sendv(tls_conn_t *tc, const struct iovec *iov, int cnt) {
+    // Gather the first record's worth into one buffer.
+    unsigned char rec[TLS_RECORD_MAX];
+    size_t len = 0;
+    for (int i = 0; i < cnt && len < sizeof(rec); i++) {
+        size_t n = iov[i].iov_len;
+        if (n > sizeof(rec) - len) n = sizeof(rec) - len;
+        memcpy(rec + len, iov[i].iov_base, n);
+        len += n;
+    }
+
+    size_t sent = 0;
+    int rc = SSL_write_ex(tc->ssl, rec, len, &sent);
+    if (rc == 1) {
+        tc->wait = POLLOUT;
+        return (ssize_t)sent;
+    }
+    (void)classify(tc, rc);
+    return -1;
+}
+
+short tls_wait_events(const tls_conn_t *tc) {
+    return tc ? tc->wait : POLLOUT;
+}
+
+#else
+
+// Built without OpenSSL: TLS listeners cannot be served.
+tls_server_t *tls_server_create(const char *cert_file, const char *key_file, int tickets, int h2) {
+    (void)cert_file;
+    (void)key_file;
+    (void)tickets;
+    (void)h2;
+    fprintf(stderr, "TLS support not compiled in (needs OpenSSL)\n");
+    return NULL;
+}
+
+void tls_server_destroy(tls_server_t *ts) {
+    (void)ts;
+}
+
+tls_conn_t *tls_conn_create(tls_server_t *ts, int fd) {
+    (void)ts;
+    (void)fd;
+    return NULL;
+}
+
+void tls_conn_destroy(tls_conn_t *tc) {
+    (void)tc;
+}
+
+int tls_handshake(tls_conn_t *tc, short *events) {
+    (void)tc;
+    (void)events;
+    return -1;
+}
+
+int tls_kernel_send(const tls_conn_t *tc) {
+    (void)tc;
+    return 0;
+}
+
+int tls_alpn_h2(const tls_conn_t *tc) {
+    (void)tc;
+    return 0;
+}
+
+ssize_t tls_recv(tls_conn_t *tc, void *buf, size_t len) {
+    (void)tc;
+    (void)buf;
+    (void)len;
+    errno = ENOTSUP;
+    return -1;
+}
+
+ssize_t tls_sendv(tls_conn_t *tc, const struct iovec *iov, int cnt) {
+    (void)tc;
+    (void)iov;
+    (void)cnt;
+    errno = ENOTSUP;
+    return -1;
+}
+
+short tls_wait_events(const tls_conn_t *tc) {
+    (void)tc;
+    return POLLOUT;
+}
+
+#endif
@@ -1,6 +1,17 @@
+// accept4() is a GNU extension.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "util.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 // Set file descriptor to non-blocking mode.
 int set_nonblocking(int fd) {
@@ -13,3 +24,77 @@ int set_nonblocking(int fd) {
     }
     return 0;
 }
+
+// Set close-on-exec flag.
+int set_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1) {
+        return -1;
+    }
+    if (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+// Accept with flags set atomically where supported.
+int accept_nonblocking(int listen_fd, struct sockaddr *addr, socklen_t *len) {
+#if defined(__linux__)
+    return accept4(listen_fd, addr, len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int fd = accept(listen_fd, addr, len);
+    if (fd < 0) {
+        return -1;
+    }
+    if (set_nonblocking(fd) != 0 || set_cloexec(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+// Hold/release partial segments on a TCP socket.
+int set_tcp_cork(int fd, int on) {
+#ifdef TCP_CORK
+    return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+#else
+    (void)fd;
+    (void)on;
+    return -1;
+#endif
+}
+
+// Validate bounded integer value.
+int parse_long(const char *s, long min, long max, long *out) {
+    if (!s || *s == '\0') return -1;
+
+    char *end = NULL;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+
+    if (errno != 0 || !end || *end != '\0') return -1;
+    if (v < min || v > max) return -1;
+
+    *out = v;
+    return 0;
+}
+
+// 64-bit FNV-1a hash for cache/table keys.
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 1469598103934665603ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Monotonic milliseconds.
+uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)(ts.tv_nsec / 1000000);
+}
@@ -0,0 +1,221 @@
+#include "vhost.h"
+
+#include "http.h"
+#include "path.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// One host name in the open-addressing name table.
+typedef struct {
+    uint64_t hash;
+    char *name;              // NULL = empty slot
+    int site;
+} vhost_name_t;
+
+struct vhost_table {
+    vhost_t *sites;          // [0] is the default site
+    int num_sites;
+
+    vhost_name_t *names;
+    size_t mask;             // name table capacity - 1
+
+    int bundle_failed;       // last bundle (re)open failed; reported once
+};
+
+// Site caches for one document root.
+static int init_site(vhost_t *s, const char *doc_root, const server_config_t *cfg) {
+    snprintf(s->doc_root, sizeof(s->doc_root), "%s", doc_root);
+    s->root_fd = path_root_open(s->doc_root);
+
+    // Custom <status>.html pages are read once here, per site.
+    s->pages = error_pages_create(s->doc_root, cfg->retry_after);
+    if (!s->pages) return -1;
+
+    s->listings = dir_index_create(cfg->autoindex_cache);
+    if (!s->listings) return -1;
+
+    s->paths = path_index_create();
+    if (!s->paths) return -1;
+
+    if (cfg->neg_cache > 0 || cfg->neg_filter) {
+        s->missing = neg_cache_create(cfg->neg_cache, cfg->neg_filter);
+        if (!s->missing) return -1;
+    }
+
+    if (cfg->cache_budget > 0) {
+        s->cache = file_cache_create(cfg->cache_budget, cfg->cache_max_file);
+        if (!s->cache) return -1;
+    }
+    return 0;
+}
+
+// Insert one lowercased name; duplicates are a configuration error.
+static int add_name(vhost_table_t *vt, const char *name, size_t len, int site) {
+    char key[HTTP_HOST_MAX];
+    if (len > 0 && name[len - 1] == '.') len--;
+    if (len == 0 || len >= sizeof(key)) return -1;
+
+    for (size_t i = 0; i < len; i++) key[i] = (char)tolower((unsigned char)name[i]);
+    key[len] = '\0';
+
+    uint64_t h = hash_bytes(key, len);
+    size_t i = (size_t)h & vt->mask;
+    while (vt->names[i].name) {
+        if (vt->names[i].hash == h && strcmp(vt->names[i].name, key) == 0) {
+            fprintf(stderr, "Duplicate vhost name: %s\n", key);
+            return -1;
+        }
+        i = (i + 1) & vt->mask;
+    }
+
+    vt->names[i].name = malloc(len + 1);
+    if (!vt->names[i].name) return -1;
+    memcpy(vt->names[i].name, key, len + 1);
+    vt->names[i].hash = h;
+    vt->names[i].site = site;
+    return 0;
+}
+
+vhost_table_t *vhost_table_create(const server_config_t *cfg) {
+    vhost_table_t *vt = calloc(1, sizeof(*vt));
+    if (!vt) return NULL;
+
+    // Load factor <= 1/2 assuming a handful of names per site.
+    size_t cap = 16;
+    while (cap < (size_t)cfg->num_vhosts * 8) cap <<= 1;
+
+    vt->sites = calloc((size_t)cfg->num_vhosts + 1, sizeof(*vt->sites));
+    vt->names = calloc(cap, sizeof(*vt->names));
+    vt->mask = cap - 1;
+    if (!vt->sites || !vt->names) {
+        vhost_table_destroy(vt);
+        return NULL;
+    }
+
+    vt->num_sites = 1;
+    if (init_site(&vt->sites[0], cfg->doc_root, cfg) != 0) {
+        vhost_table_destroy(vt);
+        return NULL;
+    }
+    if (cfg->bundle[0] != '\0') {
+        vt->sites[0].bundle = bundle_open(cfg->bundle);
+        if (!vt->sites[0].bundle) {
+            fprintf(stderr, "Cannot load bundle: %s\n", cfg->bundle);
+            vhost_table_destroy(vt);
+            return NULL;
+        }
+    }
+
+    size_t used = 0;
+    for (int i = 0; i < cfg->num_vhosts; i++) {
+        // Entry is "name[,name...]=doc_root" (validated by config parsing).
+        const char *spec = cfg->vhost[i];
+        const char *eq = strchr(spec, '=');
+        int site = vt->num_sites++;
+
+        if (!eq || init_site(&vt->sites[site], eq + 1, cfg) != 0) {
+            vhost_table_destroy(vt);
+            return NULL;
+        }
+
+        const char *p = spec;
+        while (p < eq) {
+            const char *comma = memchr(p, ',', (size_t)(eq - p));
+            const char *end = comma ? comma : eq;
+
+            // Keep at least one empty slot so probing terminates.
+            if (end > p && (++used > vt->mask || add_name(vt, p, (size_t)(end - p), site) != 0)) {
+                vhost_table_destroy(vt);
+                return NULL;
+            }
+            p = end + 1;
+        }
+    }
+
+    return vt;
+}
+
+void vhost_table_destroy(vhost_table_t *vt) {
+    if (!vt) return;
+
+    for (int i = 0; vt->sites && i < vt->num_sites; i++) {
+        file_cache_destroy(vt->sites[i].cache);
+        error_pages_destroy(vt->sites[i].pages);
+        dir_index_destroy(vt->sites[i].listings);
+        path_index_destroy(vt->sites[i].paths);
+        neg_cache_destroy(vt->sites[i].missing);
+        bundle_unref(vt->sites[i].bundle);
+        if (vt->sites[i].root_fd >= 0) close(vt->sites[i].root_fd);
+    }
+    for (size_t i = 0; vt->names && i <= vt->mask; i++) free(vt->names[i].name);
+
+    free(vt->sites);
+    free(vt->names);
+    free(vt);
+}
+
+vhost_t *vhost_find(const vhost_table_t *vt, const char *host) {
+    if (!host || host[0] == '\0' || vt->num_sites == 1) return &vt->sites[0];
+
+    size_t len = strlen(host);
+    uint64_t h = hash_bytes(host, len);
+    for (size_t i = (size_t)h & vt->mask; vt->names[i].name; i = (i + 1) & vt->mask) {
+        if (vt->names[i].hash == h && strcmp(vt->names[i].name, host) == 0) {
+            return &vt->sites[vt->names[i].site];
+        }
+    }
+    return &vt->sites[0];
+}
+
+vhost_t *vhost_default(const vhost_table_t *vt) {
+    return &vt->sites[0];
+}
+
+void vhost_table_apply_limits(vhost_table_t *vt, const server_config_t *cfg) {
+    for (int i = 0; i < vt->num_sites; i++) {
+        vhost_t *s = &vt->sites[i];
+        if (s->cache) {
+            file_cache_set_limits(s->cache, cfg->cache_budget, cfg->cache_max_file);
+        } else if (cfg->cache_budget > 0) {
+            s->cache = file_cache_create(cfg->cache_budget, cfg->cache_max_file);
+        }
+        dir_index_set_budget(s->listings, cfg->autoindex_cache);
+    }
+}
+
+void vhost_table_set_bundle(vhost_table_t *vt, const char *path) {
+    vhost_t *s = &vt->sites[0];
+
+    if (path[0] == '\0') {
+        bundle_unref(s->bundle);
+        s->bundle = NULL;
+        return;
+    }
+    if (s->bundle && strcmp(bundle_path(s->bundle), path) == 0 && !bundle_replaced(s->bundle)) return;
+
+    bundle_t *b = bundle_open(path);
+    if (!b) {
+        if (!vt->bundle_failed) fprintf(stderr, "Cannot load bundle %s; keeping the current one\n", path);
+        vt->bundle_failed = 1;
+        return;
+    }
+    vt->bundle_failed = 0;
+    bundle_unref(s->bundle);
+    s->bundle = b;
+    fprintf(stdout, "Bundle %s: %zu entries\n", path, bundle_count(b));
+    fflush(stdout);
+}
+
+int vhost_count(const vhost_table_t *vt) {
+    return vt->num_sites;
+}
+
+const vhost_t *vhost_at(const vhost_table_t *vt, int i) {
+    return (i >= 0 && i < vt->num_sites) ? &vt->sites[i] : NULL;
+}
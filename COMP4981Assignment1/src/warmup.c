@@ -0,0 +1,236 @@
+#include "warmup.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A directory still to be read.
+typedef struct {
+    int site;
+    char *dir;
+} warm_dir_t;
+
+// A regular file found by the walk (data: preloaded contents or NULL).
+typedef struct {
+    int site;
+    char *path;
+    struct stat st;
+    void *data;
+} warm_file_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Directory stack shared by the workers; done when empty and idle.
+    warm_dir_t *dirs;
+    size_t ndirs;
+    size_t dirs_cap;
+    int busy;
+    int failed;
+
+    warm_file_t *files;
+    size_t nfiles;
+    size_t files_cap;
+
+    // Preload: bytes reserved per site against the cache budget.
+    size_t *reserved;
+    size_t budget;
+    size_t preload_max;
+} warm_state_t;
+
+// Append under ws->lock. Returns 0 on success.
+static int push_dir(warm_state_t *ws, int site, const char *dir) {
+    if (ws->ndirs == ws->dirs_cap) {
+        size_t cap = ws->dirs_cap ? ws->dirs_cap * 2 : 64;
+        warm_dir_t *p = realloc(ws->dirs, cap * sizeof(*p));
+        if (!p) return -1;
+        ws->dirs = p;
+        ws->dirs_cap = cap;
+    }
+    ws->dirs[ws->ndirs].dir = strdup(dir);
+    if (!ws->dirs[ws->ndirs].dir) return -1;
+    ws->dirs[ws->ndirs].site = site;
+    ws->ndirs++;
+    return 0;
+}
+
+// Append under ws->lock. Takes ownership of f->path and f->data.
+static int push_file(warm_state_t *ws, const warm_file_t *f) {
+    if (ws->nfiles == ws->files_cap) {
+        size_t cap = ws->files_cap ? ws->files_cap * 2 : 256;
+        warm_file_t *p = realloc(ws->files, cap * sizeof(*p));
+        if (!p) return -1;
+        ws->files = p;
+        ws->files_cap = cap;
+    }
+    ws->files[ws->nfiles++] = *f;
+    return 0;
+}
+
+// Reserve size bytes of a site's cache budget. Returns 1 if granted.
+static int reserve_preload(warm_state_t *ws, int site, off_t size) {
+    if (size <= 0 || (size_t)size > ws->preload_max) return 0;
+
+    pthread_mutex_lock(&ws->lock);
+    int ok = (ws->reserved[site] + (size_t)size <= ws->budget);
+    if (ok) ws->reserved[site] += (size_t)size;
+    pthread_mutex_unlock(&ws->lock);
+    return ok;
+}
+
+// Load a file found by the walk; metadata comes from the open file itself.
+static void *preload_file(warm_state_t *ws, warm_file_t *f) {
+    // Non-blocking: the walk saw a regular file, but a FIFO may have taken
+    // its place since.
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    void *m = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == f->st.st_size &&
+        reserve_preload(ws, f->site, st.st_size)) {
+        m = file_cache_load(fd, &st);
+        if (!m) {
+            pthread_mutex_lock(&ws->lock);
+            ws->reserved[f->site] -= (size_t)st.st_size;
+            pthread_mutex_unlock(&ws->lock);
+        } else {
+            f->st = st;
+        }
+    }
+    close(fd);
+    return m;
+}
+
+// Read one directory: queue subdirectories, record regular files.
+// Symlinks are skipped (they never map onto a URL literally).
+static void scan_dir(warm_state_t *ws, int site, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path)) continue;
+
+        warm_file_t f = {site, NULL, {0}, NULL};
+        if (fstatat(dirfd(d), de->d_name, &f.st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+
+        if (S_ISDIR(f.st.st_mode)) {
+            pthread_mutex_lock(&ws->lock);
+            if (push_dir(ws, site, path) != 0) ws->failed = 1;
+            pthread_cond_signal(&ws->cond);
+            pthread_mutex_unlock(&ws->lock);
+            continue;
+        }
+        if (!S_ISREG(f.st.st_mode)) continue;
+
+        f.path = strdup(path);
+        if (!f.path) continue;
+        f.data = preload_file(ws, &f);
+
+        pthread_mutex_lock(&ws->lock);
+        int rc = push_file(ws, &f);
+        pthread_mutex_unlock(&ws->lock);
+        if (rc != 0) {
+            free(f.data);
+            free(f.path);
+        }
+    }
+    closedir(d);
+}
+
+static void *warm_worker(void *arg) {
+    warm_state_t *ws = (warm_state_t *)arg;
+
+    pthread_mutex_lock(&ws->lock);
+    for (;;) {
+        while (ws->ndirs == 0 && ws->busy > 0) pthread_cond_wait(&ws->cond, &ws->lock);
+        if (ws->ndirs == 0) break;
+
+        warm_dir_t job = ws->dirs[--ws->ndirs];
+        ws->busy++;
+        pthread_mutex_unlock(&ws->lock);
+
+        scan_dir(ws, job.site, job.dir);
+        free(job.dir);
+
+        pthread_mutex_lock(&ws->lock);
+        ws->busy--;
+        if (ws->busy == 0 && ws->ndirs == 0) pthread_cond_broadcast(&ws->cond);
+    }
+    pthread_mutex_unlock(&ws->lock);
+    return NULL;
+}
+
+// Hand walk results to each site's caches on the calling thread.
+static void apply_results(vhost_table_t *vt, warm_state_t *ws, int use_index) {
+    for (size_t i = 0; i < ws->nfiles; i++) {
+        warm_file_t *f = &ws->files[i];
+        vhost_t *s = (vhost_t *)vhost_at(vt, f->site);
+        const char *url = f->path + strlen(s->doc_root);
+        size_t len = strlen(url);
+
+        if (use_index) {
+            (void)path_index_insert(s->paths, s->doc_root, url, len, f->path, &f->st);
+
+            // index.html also answers for its directory.
+            const char *base = strrchr(url, '/') + 1;
+            if (strcmp(base, "index.html") == 0) {
+                (void)path_index_insert(s->paths, s->doc_root, url, (size_t)(base - url), f->path, &f->st);
+            }
+        }
+
+        if (f->data && file_cache_adopt(s->cache, f->path, &f->st, f->data) != 0) free(f->data);
+        free(f->path);
+    }
+}
+
+long warmup_sites(vhost_table_t *vt, const server_config_t *cfg, int use_index) {
+    int nsites = vhost_count(vt);
+    warm_state_t ws;
+    memset(&ws, 0, sizeof(ws));
+
+    // Preloaded files must also fit the memory store's own limits.
+    ws.budget = cfg->cache_budget;
+    ws.preload_max = cfg->warmup_preload < cfg->cache_max_file ? cfg->warmup_preload : cfg->cache_max_file;
+    ws.reserved = calloc((size_t)nsites, sizeof(*ws.reserved));
+    if (!ws.reserved) return -1;
+
+    pthread_mutex_init(&ws.lock, NULL);
+    pthread_cond_init(&ws.cond, NULL);
+
+    for (int i = 0; i < nsites; i++) {
+        if (push_dir(&ws, i, vhost_at(vt, i)->doc_root) != 0) ws.failed = 1;
+    }
+
+    pthread_t *threads = calloc((size_t)cfg->warmup, sizeof(*threads));
+    int started = 0;
+    while (threads && !ws.failed && started < cfg->warmup &&
+           pthread_create(&threads[started], NULL, warm_worker, &ws) == 0) {
+        started++;
+    }
+
+    // No thread could start: walk on this one.
+    if (started == 0) warm_worker(&ws);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+
+    apply_results(vt, &ws, use_index);
+    long found = (long)ws.nfiles;
+
+    for (size_t i = 0; i < ws.ndirs; i++) free(ws.dirs[i].dir);
+    free(ws.dirs);
+    free(ws.files);
+    free(ws.reserved);
+    pthread_mutex_destroy(&ws.lock);
+    pthread_cond_destroy(&ws.cond);
+    return found;
+}
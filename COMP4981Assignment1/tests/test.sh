@@ -5,15 +5,38 @@ PORT=18080
 DOCROOT=./www
 SERVER=./http_server
 
-cleanup() {
-  if [[ -n "${SERVER_PID:-}" ]] && kill -0 "$SERVER_PID" 2>/dev/null; then
-    kill "$SERVER_PID" || true
-    wait "$SERVER_PID" 2>/dev/null || true
+stop_server() {
+  local pid="$1"
+  if [[ -n "$pid" ]] && kill -0 "$pid" 2>/dev/null; then
+    kill "$pid" || true
+    wait "$pid" 2>/dev/null || true
+    # A hot-reload successor is not our child; wait for it to exit.
+    while kill -0 "$pid" 2>/dev/null; do sleep 0.05; done
   fi
 }
+
+cleanup() {
+  stop_server "${SERVER_PID:-}"
+  stop_server "${ALT_PID:-}"
+  stop_server "${NEW_PID:-}"
+}
+
+# Print the PID of parent's http_server child, waiting up to 5 s for it.
+wait_for_child() {
+  local parent="$1" pid=""
+  for _ in $(seq 100); do
+    pid=$(pgrep -x -P "$parent" http_server || true)
+    if [[ -n "$pid" ]]; then
+      echo "$pid"
+      return 0
+    fi
+    sleep 0.05
+  done
+  return 1
+}
 trap cleanup EXIT
 
-$SERVER "$PORT" "$DOCROOT" > /tmp/http_server_test.log 2>&1 &
+$SERVER 127.0.0.1 "$PORT" "$DOCROOT" > /tmp/http_server_test.log 2>&1 &
 SERVER_PID=$!
 
 sleep 0.5
@@ -83,4 +106,974 @@ done < <(seq 1 20 | xargs -I{} -P20 curl -s -o /dev/null -w "%{http_code}\n" "ht
 [[ "$fail" == "0" ]]
 echo "  OK"
 
+echo "[7] Filesystem worker pool (--fs-threads)"
+ALT_PORT=18081
+$SERVER --fs-threads 2 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+code=$(curl -s -o /tmp/get_body -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/index.html")
+[[ "$code" == "200" ]]
+cmp -s /tmp/get_body "$DOCROOT/index.html"
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/nope.txt")
+[[ "$code" == "404" ]]
+fail=0
+while read -r c; do
+  [[ "$c" == "200" ]] || fail=1
+done < <(seq 1 20 | xargs -I{} -P20 curl -s -o /dev/null -w "%{http_code}\n" "http://127.0.0.1:${ALT_PORT}/index.html")
+[[ "$fail" == "0" ]]
+stop_server "$ALT_PID"
+echo "  OK"
+
+echo "[8] Hot small files served from the memory store, reloaded on change"
+TMPROOT=$(mktemp -d)
+echo "first version" > "$TMPROOT/hot.txt"
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for _ in 1 2 3; do
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/hot.txt"
+  cmp -s /tmp/get_body "$TMPROOT/hot.txt"
+done
+sleep 0.01
+echo "second, longer version" > "$TMPROOT/hot.txt"
+for _ in 1 2 3; do
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/hot.txt"
+  cmp -s /tmp/get_body "$TMPROOT/hot.txt"
+done
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[9] Large file and empty file streamed intact"
+TMPROOT=$(mktemp -d)
+head -c 1000003 /dev/urandom > "$TMPROOT/big.bin"
+: > "$TMPROOT/empty.txt"
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin"
+cmp -s /tmp/get_body "$TMPROOT/big.bin"
+code=$(curl -s -o /tmp/get_body -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/empty.txt")
+[[ "$code" == "200" ]]
+[[ ! -s /tmp/get_body ]]
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[10] Custom error page from doc root"
+TMPROOT=$(mktemp -d)
+echo "<p>custom not found</p>" > "$TMPROOT/404.html"
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+code=$(curl -s -o /tmp/get_body -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/missing")
+[[ "$code" == "404" ]]
+cmp -s /tmp/get_body "$TMPROOT/404.html"
+curl -s -I "http://127.0.0.1:${ALT_PORT}/missing" | grep -q "Content-Length: $(stat -c %s "$TMPROOT/404.html")"
+# Each response carries the Date of the second it was made.
+d1=$(curl -s -I "http://127.0.0.1:${ALT_PORT}/missing" | tr -d '\r' | grep -i '^date:')
+sleep 1.1
+d2=$(curl -s -I "http://127.0.0.1:${ALT_PORT}/missing" | tr -d '\r' | grep -i '^date:')
+[[ -n "$d1" && "$d1" != "$d2" ]]
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[11] Per-IP request rate and connection caps"
+$SERVER --rate-limit 1 --rate-burst 2 --max-conns-per-ip 1 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+codes=$(for _ in 1 2 3 4 5; do curl -s -o /dev/null -w "%{http_code}\n" "http://127.0.0.1:${ALT_PORT}/index.html"; done)
+echo "$codes" | grep -q "^200$"
+echo "$codes" | grep -q "^429$"
+python3 - "$ALT_PORT" <<'PY'
+import socket, sys
+port = int(sys.argv[1])
+held = socket.create_connection(("127.0.0.1", port))
+extra = socket.create_connection(("127.0.0.1", port))
+extra.settimeout(2)
+extra.sendall(b"GET /index.html HTTP/1.1\r\n\r\n")
+try:
+    data = extra.recv(64)
+except ConnectionResetError:
+    data = b""
+assert data == b"", "second connection from same IP was served"
+held.close()
+extra.close()
+PY
+stop_server "$ALT_PID"
+echo "  OK"
+
+echo "[12] Hot reload and graceful drain keep downloads intact"
+TMPROOT=$(mktemp -d)
+head -c 20000000 /dev/urandom > "$TMPROOT/big.bin"
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+curl -s --limit-rate 8M -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin" &
+DL_PID=$!
+sleep 0.3
+kill -USR2 "$ALT_PID"
+NEW_PID=$(wait_for_child "$ALT_PID")
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/big.bin")
+[[ "$code" == "200" ]]
+wait "$DL_PID"
+cmp -s /tmp/get_body "$TMPROOT/big.bin"
+wait "$ALT_PID" 2>/dev/null || true
+ALT_PID=$NEW_PID
+NEW_PID=
+curl -s --limit-rate 8M -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin" &
+DL_PID=$!
+sleep 0.3
+kill -TERM "$ALT_PID"
+wait "$DL_PID"
+cmp -s /tmp/get_body "$TMPROOT/big.bin"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[13] Config file, CLI override and SIGHUP reload"
+CONF=$(mktemp)
+# mmap-budget is the old name of cache-budget and must keep working.
+printf "# test config\nrate-limit = 0\nchunk-size = 4K\nmmap-budget = 0\n" > "$CONF"
+if $SERVER --config /nonexistent 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /dev/null 2>&1; then
+  echo "missing config file accepted"; exit 1
+fi
+echo "bogus-key = 1" > /tmp/http_server_bad.conf
+if $SERVER --config /tmp/http_server_bad.conf 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /dev/null 2>&1; then
+  echo "unknown config key accepted"; exit 1
+fi
+# Out-of-range and fractional values are refused, however large.
+for bad in "--backlog 1e300" "--backlog -1e300" "--backlog 2.5" "--fs-threads nan" "--max-clients 1e19"; do
+  if $SERVER $bad 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_bad.log 2>&1; then
+    echo "accepted $bad"; exit 1
+  fi
+  grep -q "^Invalid ${bad%% *}: " /tmp/http_server_bad.log
+done
+$SERVER --config "$CONF" --max-clients 64 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for _ in 1 2 3 4; do
+  code=$(curl -s -o /tmp/get_body -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/index.html")
+  [[ "$code" == "200" ]]
+  cmp -s /tmp/get_body "$DOCROOT/index.html"
+done
+printf "rate-limit = 0.5\nrate-burst = 1\n" > "$CONF"
+kill -HUP "$ALT_PID"
+sleep 0.3
+codes=$(for _ in 1 2 3; do curl -s -o /dev/null -w "%{http_code}\n" "http://127.0.0.1:${ALT_PORT}/index.html"; done)
+echo "$codes" | grep -q "^429$"
+stop_server "$ALT_PID"
+rm -f "$CONF" /tmp/http_server_bad.conf /tmp/http_server_bad.log
+echo "  OK"
+
+echo "[14] Socket tuning: cork, deferred accept, fast open"
+TMPROOT=$(mktemp -d)
+head -c 300007 /dev/urandom > "$TMPROOT/big.bin"
+$SERVER --tcp-cork 1 --tcp-nodelay 1 --defer-accept 5 --fastopen 16 --chunk-size 4K \
+  127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for _ in 1 2; do
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin"
+  cmp -s /tmp/get_body "$TMPROOT/big.bin"
+done
+curl -s --tcp-fastopen -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin"
+cmp -s /tmp/get_body "$TMPROOT/big.bin"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[15] Multiple listeners: IPv4, IPv6, Unix socket, dual-stack"
+SOCK=$(mktemp -u /tmp/http_server_test.XXXXXX.sock)
+$SERVER --listen "[::1]:${ALT_PORT}" --listen "unix:${SOCK}" --rate-limit 0.5 --rate-burst 1 \
+  127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for url in "http://127.0.0.1:${ALT_PORT}/index.html" "http://[::1]:${ALT_PORT}/index.html"; do
+  curl -s -o /tmp/get_body "$url"
+  cmp -s /tmp/get_body "$DOCROOT/index.html"
+done
+# Local proxy traffic is not subject to per-IP limits.
+for _ in 1 2 3 4; do
+  code=$(curl -s --unix-socket "$SOCK" -o /tmp/get_body -w "%{http_code}" "http://localhost/index.html")
+  [[ "$code" == "200" ]]
+  cmp -s /tmp/get_body "$DOCROOT/index.html"
+done
+# Hot reload hands every listener to the successor (idle: old one exits at once).
+kill -USR2 "$ALT_PID"
+wait "$ALT_PID" 2>/dev/null || true
+NEW_PID=$(pgrep -n -x http_server)
+[[ -n "$NEW_PID" && "$NEW_PID" != "$ALT_PID" ]]
+ALT_PID=$NEW_PID
+code=$(curl -s --unix-socket "$SOCK" -o /dev/null -w "%{http_code}" "http://localhost/index.html")
+[[ "$code" == "200" ]]
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://[::1]:${ALT_PORT}/index.html")
+[[ "$code" == "200" ]]
+stop_server "$ALT_PID"
+# A stale socket file from a dead server is replaced; "::" also takes IPv4.
+$SERVER --listen "unix:${SOCK}" :: "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/index.html")
+[[ "$code" == "200" ]]
+code=$(curl -s --unix-socket "$SOCK" -o /dev/null -w "%{http_code}" "http://localhost/index.html")
+[[ "$code" == "200" ]]
+stop_server "$ALT_PID"
+rm -f "$SOCK"
+echo "  OK"
+
+echo "[16] Virtual hosts by Host header"
+SITE_A=$(mktemp -d)
+SITE_B=$(mktemp -d)
+echo "site a" > "$SITE_A/index.html"
+echo "site b" > "$SITE_B/index.html"
+echo "<p>b has no such page</p>" > "$SITE_B/404.html"
+$SERVER --vhost "a.test,www.a.test=$SITE_A" --vhost "b.test=$SITE_B" --fs-threads 2 \
+  127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for _ in 1 2 3; do
+  curl -s -o /tmp/get_body -H "Host: a.test" "http://127.0.0.1:${ALT_PORT}/index.html"
+  cmp -s /tmp/get_body "$SITE_A/index.html"
+  curl -s -o /tmp/get_body -H "Host: WWW.A.Test.:${ALT_PORT}" "http://127.0.0.1:${ALT_PORT}/index.html"
+  cmp -s /tmp/get_body "$SITE_A/index.html"
+  curl -s -o /tmp/get_body -H "Host: b.test" "http://127.0.0.1:${ALT_PORT}/index.html"
+  cmp -s /tmp/get_body "$SITE_B/index.html"
+done
+# Unknown host falls back to the positional document root.
+curl -s -o /tmp/get_body -H "Host: other.test" "http://127.0.0.1:${ALT_PORT}/index.html"
+cmp -s /tmp/get_body "$DOCROOT/index.html"
+# Error pages are per site.
+curl -s -o /tmp/get_body -H "Host: b.test" "http://127.0.0.1:${ALT_PORT}/missing"
+grep -q "b has no such page" /tmp/get_body
+curl -s -o /tmp/get_body -H "Host: a.test" "http://127.0.0.1:${ALT_PORT}/missing"
+! grep -q "b has no such page" /tmp/get_body
+# Malformed or repeated Host is rejected.
+python3 - "$ALT_PORT" <<'PY'
+import socket, sys
+for req in (b"GET / HTTP/1.1\r\nHost: bad/host\r\n\r\n",
+            b"GET / HTTP/1.1\r\nHost: a.test\r\nHost: b.test\r\n\r\n"):
+    s = socket.create_connection(("127.0.0.1", int(sys.argv[1])))
+    s.sendall(req)
+    assert b" 400 " in s.recv(256).split(b"\r\n")[0]
+    s.close()
+PY
+stop_server "$ALT_PID"
+if $SERVER --vhost "a.test=/nonexistent" 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /dev/null 2>&1; then
+  echo "missing vhost root accepted"; exit 1
+fi
+rm -rf "$SITE_A" "$SITE_B"
+echo "  OK"
+
+echo "[17] Directory listings (autoindex)"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/files/sub" "$TMPROOT/site" "$TMPROOT/odd dir"
+echo "one" > "$TMPROOT/files/b.txt"
+echo "odd" > "$TMPROOT/odd dir/x y.txt"
+echo "two" > "$TMPROOT/files/a.txt"
+echo "home" > "$TMPROOT/site/index.html"
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${PORT}/")
+[[ "$code" == "200" ]]
+# Inline, and with workers reading the entries.
+for threads in 0 2; do
+  $SERVER --fs-threads "$threads" --autoindex 1 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+  ALT_PID=$!
+  sleep 0.5
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/files/"
+  grep -q 'href="/files/sub/"' /tmp/get_body
+  # Sorted: directories first, then names.
+  [[ "$(grep -o 'href="/files/[^"]*"' /tmp/get_body | tr '\n' ' ')" == 'href="/files/sub/" href="/files/a.txt" href="/files/b.txt" ' ]]
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/files?format=json"
+  python3 -c "import json,sys; d=json.load(open('/tmp/get_body')); assert [e['name'] for e in d['entries']]==['sub','a.txt','b.txt']; assert d['entries'][1]['size']==4"
+  # Cached listing is re-rendered once the directory changes.
+  sleep 0.01
+  echo "three" > "$TMPROOT/files/c.txt"
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/files/"
+  grep -q 'href="/files/c.txt"' /tmp/get_body
+  # Titled and linked by the normalized path, whatever the spelling.
+  curl -s --path-as-is -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/files/sub/../"
+  grep -q "Index of /files/</" /tmp/get_body
+  grep -q 'href="/files/c.txt"' /tmp/get_body
+  grep -q 'href="/">../' /tmp/get_body
+  curl -s --path-as-is -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/%66iles/./"
+  grep -q 'href="/files/sub/"' /tmp/get_body
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/odd%20dir/"
+  grep -q "Index of /odd dir/<" /tmp/get_body
+  grep -q 'href="/odd%20dir/x%20y.txt"' /tmp/get_body
+  # index.html still wins over a listing.
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/site/"
+  cmp -s /tmp/get_body "$TMPROOT/site/index.html"
+  stop_server "$ALT_PID"
+  rm "$TMPROOT/files/c.txt"
+done
+# Submits joining one listing lookup each get the entries.
+HTTPD_LOOKUP_DELAY_MS=300 $SERVER --fs-threads 1 --autoindex 1 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+pids=()
+for i in 1 2 3 4; do
+  curl -s -o "/tmp/get_body.$i" "http://127.0.0.1:${ALT_PORT}/files/" &
+  pids+=($!)
+done
+wait "${pids[@]}"
+for i in 1 2 3 4; do
+  grep -q 'href="/files/b.txt"' "/tmp/get_body.$i"
+  rm "/tmp/get_body.$i"
+done
+stop_server "$ALT_PID"
+grep -q "^Lookups: 1 run, 3 joined$" /tmp/http_server_test_alt.log
+# Off by default: directories stay forbidden.
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/files/")
+[[ "$code" == "403" || "$code" == "404" ]]
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[18] Change watching keeps indexed and cached files fresh"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/files"
+echo "one" > "$TMPROOT/files/a.txt"
+echo "v1" > "$TMPROOT/hot.txt"
+$SERVER --fs-threads 2 --autoindex 1 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for _ in 1 2 3; do
+  curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/hot.txt"
+  cmp -s /tmp/get_body "$TMPROOT/hot.txt"
+done
+# Atomic replace (deploy style), then in-place rewrite, then removal.
+echo "version two" > "$TMPROOT/hot.tmp"
+mv "$TMPROOT/hot.tmp" "$TMPROOT/hot.txt"
+sleep 0.1
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/hot.txt"
+cmp -s /tmp/get_body "$TMPROOT/hot.txt"
+[[ "$(curl -sI "http://127.0.0.1:${ALT_PORT}/hot.txt" | tr -d '\r' | grep -i '^content-length:')" == "Content-Length: 12" ]]
+echo "three, third version" > "$TMPROOT/hot.txt"
+sleep 0.1
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/hot.txt"
+cmp -s /tmp/get_body "$TMPROOT/hot.txt"
+rm "$TMPROOT/hot.txt"
+sleep 0.1
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/hot.txt")
+[[ "$code" == "404" ]]
+# Listing shows new sizes even though the directory itself did not change.
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/files/?format=json"
+echo "one, longer" > "$TMPROOT/files/a.txt"
+sleep 0.1
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/files/?format=json"
+python3 -c "import json; d=json.load(open('/tmp/get_body')); assert d['entries'][0]['size']==12"
+# Directories created later are watched too.
+mkdir -p "$TMPROOT/new/deep"
+echo "x" > "$TMPROOT/new/deep/f.txt"
+sleep 0.1
+for _ in 1 2 3; do curl -s -o /dev/null "http://127.0.0.1:${ALT_PORT}/new/deep/f.txt"; done
+echo "changed" > "$TMPROOT/new/deep/f.txt"
+sleep 0.1
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/new/deep/f.txt"
+cmp -s /tmp/get_body "$TMPROOT/new/deep/f.txt"
+mv "$TMPROOT/new" "$TMPROOT/old"
+sleep 0.1
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/new/deep/f.txt")
+[[ "$code" == "404" ]]
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/old/deep/f.txt"
+cmp -s /tmp/get_body "$TMPROOT/old/deep/f.txt"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[19] Startup warm-up indexes and preloads the document root"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/a/b" "$TMPROOT/site"
+echo "deep" > "$TMPROOT/a/b/deep.txt"
+echo "home" > "$TMPROOT/site/index.html"
+head -c 200000 /dev/urandom > "$TMPROOT/big.bin"
+$SERVER --warmup 2 --warmup-preload 64K 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+grep -q "Warm-up: 3 file(s)" /tmp/http_server_test_alt.log
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/a/b/deep.txt"
+cmp -s /tmp/get_body "$TMPROOT/a/b/deep.txt"
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/site/"
+cmp -s /tmp/get_body "$TMPROOT/site/index.html"
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin"
+cmp -s /tmp/get_body "$TMPROOT/big.bin"
+# Responses carry an ETag that follows the file's version.
+etag1=$(curl -sI "http://127.0.0.1:${ALT_PORT}/a/b/deep.txt" | tr -d '\r' | sed -n 's/^ETag: //p')
+[[ -n "$etag1" ]]
+echo "deeper" > "$TMPROOT/a/b/deep.txt"
+sleep 0.1
+etag2=$(curl -sI "http://127.0.0.1:${ALT_PORT}/a/b/deep.txt" | tr -d '\r' | sed -n 's/^ETag: //p')
+[[ -n "$etag2" && "$etag1" != "$etag2" ]]
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/a/b/deep.txt"
+cmp -s /tmp/get_body "$TMPROOT/a/b/deep.txt"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[20] Packed asset bundle served from one mapping"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/src/css" "$TMPROOT/src/docs" "$TMPROOT/empty"
+echo "bundled home" > "$TMPROOT/src/index.html"
+echo "docs home" > "$TMPROOT/src/docs/index.html"
+for i in $(seq 1 200); do echo "body { margin: ${i}px; }"; done > "$TMPROOT/src/css/site.css"
+head -c 3000 /dev/urandom > "$TMPROOT/src/blob.bin"
+echo "spaced" > "$TMPROOT/src/a b.txt"
+./mkbundle -z "$TMPROOT/src" "$TMPROOT/site.bundle" > /dev/null
+$SERVER --bundle "$TMPROOT/site.bundle" 127.0.0.1 "$ALT_PORT" "$TMPROOT/empty" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/"
+cmp -s /tmp/get_body "$TMPROOT/src/index.html"
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/docs/"
+cmp -s /tmp/get_body "$TMPROOT/src/docs/index.html"
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/blob.bin"
+cmp -s /tmp/get_body "$TMPROOT/src/blob.bin"
+# Precompressed variant only for clients that accept gzip.
+curl -s -D /tmp/get_headers -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/css/site.css"
+cmp -s /tmp/get_body "$TMPROOT/src/css/site.css"
+! grep -qi '^content-encoding' /tmp/get_headers
+curl -s --compressed -D /tmp/get_headers -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/css/site.css"
+grep -qi '^content-encoding: gzip' /tmp/get_headers
+cmp -s /tmp/get_body "$TMPROOT/src/css/site.css"
+[[ "$(curl -sI "http://127.0.0.1:${ALT_PORT}/css/site.css" | tr -d '\r' | grep -i '^content-length:')" == "Content-Length: $(stat -c %s "$TMPROOT/src/css/site.css")" ]]
+code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/missing.txt")
+[[ "$code" == "404" ]]
+code=$(curl -s --path-as-is -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/../etc/passwd")
+[[ "$code" == "403" ]]
+# Paths are decoded and normalized as for files on disk.
+for target in "/a%20b.txt" "/./blob.bin" "/css/../%62lob.bin" "//docs/"; do
+  [[ "$(curl -s --path-as-is -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}${target}")" == "200" ]]
+done
+curl -s --path-as-is -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/%69ndex.html"
+cmp -s /tmp/get_body "$TMPROOT/src/index.html"
+# Deploy: replace the bundle file; the server swaps within a second.
+echo "new home" > "$TMPROOT/src/index.html"
+./mkbundle "$TMPROOT/src" "$TMPROOT/site.bundle" > /dev/null
+sleep 1.5
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/"
+cmp -s /tmp/get_body "$TMPROOT/src/index.html"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[21] Pool workers read the path index while files are swapped"
+TMPROOT=$(mktemp -d)
+head -c 150000 /dev/urandom > "$TMPROOT/v1"
+head -c 150000 /dev/urandom > "$TMPROOT/v2"
+mkdir -p "$TMPROOT/www"
+cp "$TMPROOT/v1" "$TMPROOT/www/data.bin"
+# Too big for the memory store, so every GET is opened by a worker.
+$SERVER --fs-threads 4 --cache-max-file 1K 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.3
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/data.bin"
+cmp -s /tmp/get_body "$TMPROOT/v1"
+# Each response is one whole version, never a stale or mixed file.
+(
+    for i in $(seq 1 20); do
+        cp "$TMPROOT/v$((i % 2 + 1))" "$TMPROOT/www/.tmp" && mv "$TMPROOT/www/.tmp" "$TMPROOT/www/data.bin"
+        sleep 0.02
+    done
+) &
+SWAP_PID=$!
+seq 1 40 | xargs -I{} -P20 curl -s -o "$TMPROOT/out.{}" "http://127.0.0.1:${ALT_PORT}/data.bin"
+wait "$SWAP_PID"
+for i in $(seq 1 40); do
+    cmp -s "$TMPROOT/out.$i" "$TMPROOT/v1" || cmp -s "$TMPROOT/out.$i" "$TMPROOT/v2"
+done
+sleep 0.1
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/data.bin"
+cmp -s /tmp/get_body "$TMPROOT/www/data.bin"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[22] Overload: 503 with Retry-After, accept paused when full"
+TMPROOT=$(mktemp -d)
+mkdir "$TMPROOT/big"
+(cd "$TMPROOT/big" && seq 1 20000 | sed 's/^/file_with_a_longer_name_/' | xargs touch)
+echo "small" > "$TMPROOT/small.txt"
+# Rendering a huge listing uncached (HEAD still renders it to size it)
+# makes one slow loop iteration.
+$SERVER --autoindex 1 --autoindex-cache 0 --overload-lag 1 --retry-after 7 --max-clients 2 \
+    127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.3
+curl -sI -o /dev/null "http://127.0.0.1:${ALT_PORT}/big/"
+curl -s -D /tmp/get_headers -o /dev/null "http://127.0.0.1:${ALT_PORT}/small.txt"
+head -1 /tmp/get_headers | grep -q " 503 "
+grep -qi '^retry-after: 7' /tmp/get_headers
+grep -q "Overloaded" /tmp/http_server_test_alt.log
+# Quick iterations bring the average back down.
+code=""
+for i in $(seq 1 20); do
+    code=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/small.txt")
+    [[ "$code" == "200" ]] && break
+done
+[[ "$code" == "200" ]]
+grep -q "Load back to normal" /tmp/http_server_test_alt.log
+# Both slots held by idle clients: a third waits in the backlog instead
+# of being accepted and closed, and is served once a slot frees up.
+python3 - "$ALT_PORT" <<'PY' &
+import socket, sys, time
+held = [socket.create_connection(("127.0.0.1", int(sys.argv[1]))) for _ in range(2)]
+time.sleep(1.0)
+for s in held:
+    s.close()
+PY
+HOLD_PID=$!
+sleep 0.3
+curl -s -m 5 -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/small.txt"
+cmp -s /tmp/get_body "$TMPROOT/small.txt"
+wait "$HOLD_PID"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[23] Write budgets: responses split across rounds stay intact"
+TMPROOT=$(mktemp -d)
+head -c 3000000 /dev/urandom > "$TMPROOT/big.bin"
+head -c 40000 /dev/urandom > "$TMPROOT/mid.bin"
+echo "small" > "$TMPROOT/small.txt"
+# Budget below the chunk size: chunks and stored files go out in pieces.
+$SERVER --write-budget 5000 --chunk-size 8K --cache-max-file 64K \
+    127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.3
+curl -s -o "$TMPROOT/out.big" "http://127.0.0.1:${ALT_PORT}/big.bin" &
+BIG_PID=$!
+for i in 1 2 3; do
+    curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/mid.bin"
+    cmp -s /tmp/get_body "$TMPROOT/mid.bin"
+done
+fail=0
+while read -r c; do
+  [[ "$c" == "200" ]] || fail=1
+done < <(seq 1 10 | xargs -I{} -P10 curl -s -o /dev/null -w "%{http_code}\n" "http://127.0.0.1:${ALT_PORT}/small.txt")
+[[ "$fail" == "0" ]]
+wait "$BIG_PID"
+cmp -s "$TMPROOT/out.big" "$TMPROOT/big.bin"
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[24] Responses written right after they are prepared"
+TMPROOT=$(mktemp -d)
+head -c 2000000 /dev/urandom > "$TMPROOT/big.bin"
+echo "small" > "$TMPROOT/small.txt"
+$SERVER --fs-threads 2 --sndbuf 16384 127.0.0.1 "$ALT_PORT" "$TMPROOT" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.3
+# Inline, pool, HEAD and error responses.
+for i in 1 2 3; do
+    curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/small.txt"
+    cmp -s /tmp/get_body "$TMPROOT/small.txt"
+done
+[[ "$(curl -sI -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/small.txt")" == "200" ]]
+[[ "$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/missing")" == "404" ]]
+# A client that does not read at first: the first write fills the
+# socket and the rest follows on POLLOUT.
+python3 - "$ALT_PORT" "$TMPROOT/big.bin" <<'PY'
+import socket, sys, time
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+s.connect(("127.0.0.1", int(sys.argv[1])))
+s.sendall(b"GET /big.bin HTTP/1.1\r\nHost: x\r\n\r\n")
+time.sleep(0.5)
+data = b""
+while True:
+    b = s.recv(65536)
+    if not b:
+        break
+    data += b
+body = data.split(b"\r\n\r\n", 1)[1]
+sys.exit(0 if body == open(sys.argv[2], "rb").read() else 1)
+PY
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[25] Read on accept, with and without deferred accept"
+for extra in "" "--defer-accept 1"; do
+    $SERVER --read-on-accept 1 $extra 127.0.0.1 "$ALT_PORT" "$DOCROOT" > /tmp/http_server_test_alt.log 2>&1 &
+    ALT_PID=$!
+    sleep 0.3
+    curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/index.html"
+    cmp -s /tmp/get_body "$DOCROOT/index.html"
+    [[ "$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/missing")" == "404" ]]
+    # Nothing to read yet at accept: the request is picked up later.
+    python3 - "$ALT_PORT" <<'PY'
+import socket, sys, time
+s = socket.create_connection(("127.0.0.1", int(sys.argv[1])))
+time.sleep(0.2)
+s.sendall(b"GET /index.html HTTP/1.1\r\nHost: x\r\n\r\n")
+data = b""
+while True:
+    b = s.recv(65536)
+    if not b:
+        break
+    data += b
+sys.exit(0 if data.startswith(b"HTTP/1.1 200") else 1)
+PY
+    stop_server "$ALT_PID"
+done
+echo "  OK"
+
+echo "[26] TLS listener: requests, small write budget, resumption, hot reload"
+TMPROOT=$(mktemp -d)
+TLS_PORT=$((ALT_PORT + 1))
+openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=localhost -days 1 \
+  -keyout "$TMPROOT/key.pem" -out "$TMPROOT/cert.pem" > /dev/null 2>&1
+mkdir "$TMPROOT/www"
+echo "secure" > "$TMPROOT/www/index.html"
+head -c 1000000 /dev/urandom > "$TMPROOT/www/big.bin"
+$SERVER --listen "tls:127.0.0.1:${TLS_PORT}" --tls-cert "$TMPROOT/cert.pem" --tls-key "$TMPROOT/key.pem" \
+  --write-budget 4096 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+curl -sk -o /tmp/get_body "https://127.0.0.1:${TLS_PORT}/index.html"
+cmp -s /tmp/get_body "$TMPROOT/www/index.html"
+curl -sk -o /tmp/get_body "https://127.0.0.1:${TLS_PORT}/big.bin"
+cmp -s /tmp/get_body "$TMPROOT/www/big.bin"
+[[ "$(curl -sk -o /dev/null -w "%{http_code}" "https://127.0.0.1:${TLS_PORT}/missing")" == "404" ]]
+# The plain listener next to it is unaffected.
+curl -s -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/index.html"
+cmp -s /tmp/get_body "$TMPROOT/www/index.html"
+# A returning client resumes its session (ticket on 1.3, either way on 1.2).
+for ver in -tls1_3 -tls1_2; do
+  openssl s_client "$ver" -connect "127.0.0.1:${TLS_PORT}" -sess_out "$TMPROOT/sess" < /dev/null 2>/dev/null | grep -q "^New"
+  openssl s_client "$ver" -connect "127.0.0.1:${TLS_PORT}" -sess_in "$TMPROOT/sess" < /dev/null 2>/dev/null | grep -q "^Reused"
+done
+# The successor takes the TLS listener over as a TLS listener.
+kill -USR2 "$ALT_PID"
+wait "$ALT_PID" 2>/dev/null || true
+NEW_PID=$(pgrep -n -x http_server)
+[[ -n "$NEW_PID" && "$NEW_PID" != "$ALT_PID" ]]
+ALT_PID=$NEW_PID
+curl -sk -o /tmp/get_body "https://127.0.0.1:${TLS_PORT}/index.html"
+cmp -s /tmp/get_body "$TMPROOT/www/index.html"
+stop_server "$ALT_PID"
+# Without a certificate the server refuses to start.
+if $SERVER --listen "tls:127.0.0.1:${TLS_PORT}" 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /dev/null 2>&1; then
+  exit 1
+fi
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[27] HTTP/2: prior knowledge, many streams on one connection, ALPN over TLS"
+TMPROOT=$(mktemp -d)
+TLS_PORT=$((ALT_PORT + 1))
+openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=localhost -days 1 \
+  -keyout "$TMPROOT/key.pem" -out "$TMPROOT/cert.pem" > /dev/null 2>&1
+mkdir "$TMPROOT/www"
+echo "multiplexed" > "$TMPROOT/www/index.html"
+head -c 300000 /dev/urandom > "$TMPROOT/www/big.bin"
+URLS=()
+for i in $(seq 1 30); do
+  head -c $((i * 3000)) /dev/urandom > "$TMPROOT/www/f$i.bin"
+  URLS+=(-o "$TMPROOT/out$i" "https://127.0.0.1:${TLS_PORT}/f$i.bin")
+done
+TLS_ARGS=(--listen "tls:127.0.0.1:${TLS_PORT}" --tls-cert "$TMPROOT/cert.pem" --tls-key "$TMPROOT/key.pem")
+$SERVER "${TLS_ARGS[@]}" 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+H2="curl -s --http2-prior-knowledge"
+[[ "$($H2 -o /tmp/get_body -w "%{http_version}" "http://127.0.0.1:${ALT_PORT}/index.html")" == "2" ]]
+cmp -s /tmp/get_body "$TMPROOT/www/index.html"
+$H2 -o /tmp/get_body "http://127.0.0.1:${ALT_PORT}/big.bin"
+cmp -s /tmp/get_body "$TMPROOT/www/big.bin"
+[[ "$($H2 -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/missing")" == "404" ]]
+$H2 -I "http://127.0.0.1:${ALT_PORT}/big.bin" | grep -qi "^content-length: 300000"
+# Frames behind the preface may fill a first read past --max-header-size.
+python3 - "$ALT_PORT" "$TMPROOT/www/index.html" <<'PY'
+import socket, sys
+port, want = int(sys.argv[1]), open(sys.argv[2], "rb").read()
+ping = b"\x00\x00\x08\x06\x00\x00\x00\x00\x00" + b"12345678"
+block = b"\x82\x86\x04\x0b/index.html\x01\x01x"
+headers = len(block).to_bytes(3, "big") + b"\x01\x05\x00\x00\x00\x01" + block
+s = socket.create_connection(("127.0.0.1", port))
+s.sendall(b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + b"\x00\x00\x00\x04\x00\x00\x00\x00\x00" + ping * 600 + headers)
+buf, acks, body, done = b"", 0, b"", False
+while not done:
+    d = s.recv(65536)
+    assert d and not buf.startswith(b"HTTP/"), buf[:40]
+    buf += d
+    while len(buf) >= 9 and len(buf) >= 9 + int.from_bytes(buf[:3], "big"):
+        n, t, f = int.from_bytes(buf[:3], "big"), buf[3], buf[4]
+        acks += (t == 6)
+        if t == 0:
+            body += buf[9:9 + n]
+            done = done or bool(f & 1)
+        buf = buf[9 + n:]
+assert acks == 600 and body == want, (acks, len(body))
+# A burst of PINGs whose acks pile up unsent ends with GOAWAY
+# ENHANCE_YOUR_CALM instead of an ever-growing output queue.
+s = socket.create_connection(("127.0.0.1", port))
+s.sendall(b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + b"\x00\x00\x00\x04\x00\x00\x00\x00\x00" + ping * 3000)
+data = b""
+while True:
+    d = s.recv(65536)
+    if not d:
+        break
+    data += d
+frames = []
+while len(data) >= 9:
+    n = int.from_bytes(data[:3], "big")
+    frames.append((data[3], data[9:9 + n]))
+    data = data[9 + n:]
+assert frames[-1][0] == 7 and frames[-1][1][4:8] == b"\x00\x00\x00\x0b", frames[-1]
+assert sum(t == 6 for t, _ in frames) < 3000
+PY
+[[ "$($H2 -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/index.html")" == "200" ]]
+# ALPN picks h2 on the TLS listener, and thirty transfers share one
+# connection. (Over TLS because curl 7.88 cannot reuse a prior-knowledge
+# connection.)
+h2_parallel() {
+  curl -sk --http2 --parallel --parallel-max 30 -w "%{num_connects} %{http_version}\n" "${URLS[@]}" 2>/dev/null |
+    awk '$2 != "2" {bad = 1} {n += $1} END {print bad ? "mixed" : n}'
+}
+h2_outputs_match() {
+  for i in $(seq 1 30); do
+    cmp -s "$TMPROOT/out$i" "$TMPROOT/www/f$i.bin"
+    rm -f "$TMPROOT/out$i"
+  done
+}
+[[ "$(h2_parallel)" == "1" ]]
+h2_outputs_match
+[[ "$(curl -sk --http2 -o /tmp/get_body -w "%{http_version}" "https://127.0.0.1:${TLS_PORT}/big.bin")" == "2" ]]
+cmp -s /tmp/get_body "$TMPROOT/www/big.bin"
+# HTTP/1.1 still works on both listeners.
+[[ "$(curl -sk --http1.1 -o /dev/null -w "%{http_version}" "https://127.0.0.1:${TLS_PORT}/index.html")" == "1.1" ]]
+[[ "$(curl -s -o /dev/null -w "%{http_version}" "http://127.0.0.1:${ALT_PORT}/index.html")" == "1.1" ]]
+stop_server "$ALT_PID"
+# Past the stream limit, refused streams are retried and still complete.
+$SERVER "${TLS_ARGS[@]}" --h2-max-streams 4 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+[[ "$(h2_parallel)" != "mixed" ]]
+h2_outputs_match
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[28] URL paths: percent-decoding and dot-segment removal"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/www/sub dir"
+echo "spaced" > "$TMPROOT/www/my file.txt"
+echo "nested" > "$TMPROOT/www/sub dir/a.txt"
+echo "root" > "$TMPROOT/www/index.html"
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+expect_path() {
+  [[ "$(curl --path-as-is -s -o /tmp/get_body -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}$1")" == "$2" ]]
+}
+expect_path "/my%20file.txt" 200
+cmp -s /tmp/get_body "$TMPROOT/www/my file.txt"
+expect_path "/sub%20dir/../sub%20dir/./a.txt" 200
+cmp -s /tmp/get_body "$TMPROOT/www/sub dir/a.txt"
+expect_path "//sub%20dir//%61.txt?x=/../../" 200
+cmp -s /tmp/get_body "$TMPROOT/www/sub dir/a.txt"
+expect_path "/sub%20dir/%2E%2e" 200
+cmp -s /tmp/get_body "$TMPROOT/www/index.html"
+expect_path "/%2e%2e/etc/passwd" 403
+expect_path "/sub%20dir/../../etc/passwd" 403
+expect_path "/a%5c..%5cb" 403
+expect_path "/my%2" 400
+expect_path "/my%zzfile" 400
+expect_path "/my%00file.txt" 400
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[29] Lookups stay beneath the document root, symlinks included"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/www/sub" "$TMPROOT/outside"
+echo "inside" > "$TMPROOT/www/sub/real.txt"
+echo "secret" > "$TMPROOT/outside/secret.txt"
+ln -s sub/real.txt "$TMPROOT/www/alias.txt"
+ln -s ../outside/secret.txt "$TMPROOT/www/escape.txt"
+ln -s "$TMPROOT/outside" "$TMPROOT/www/outdir"
+mkfifo "$TMPROOT/www/pipe"
+ln -s pipe "$TMPROOT/www/pipe.lnk"
+for threads in 0 2; do
+  $SERVER --fs-threads "$threads" --autoindex 1 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+  ALT_PID=$!
+  sleep 0.5
+  expect_path "/alias.txt" 200
+  cmp -s /tmp/get_body "$TMPROOT/www/sub/real.txt"
+  # Hot through the link, then changed in place: events name the target,
+  # so nothing may be remembered under the link's path.
+  for _ in 1 2; do expect_path "/alias.txt" 200; done
+  echo "appended to the target" >> "$TMPROOT/www/sub/real.txt"
+  sleep 0.1
+  expect_path "/alias.txt" 200
+  cmp -s /tmp/get_body "$TMPROOT/www/sub/real.txt"
+  [[ "$(curl -sI "http://127.0.0.1:${ALT_PORT}/alias.txt" | tr -d '\r' | grep -i '^content-length:')" == \
+     "Content-Length: $(stat -c %s "$TMPROOT/www/sub/real.txt")" ]]
+  expect_path "/escape.txt" 403
+  expect_path "/outdir/secret.txt" 403
+  expect_path "/outdir/" 403
+  expect_path "/sub/real.txt/" 404
+  expect_path "/sub" 200
+  grep -q "real.txt" /tmp/get_body
+  [[ "$(curl -s -I -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/sub/")" == "200" ]]
+  [[ "$(curl -s -I -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/escape.txt")" == "403" ]]
+  # A FIFO is refused without being opened for reading, which would wait
+  # for a writer; the server keeps answering.
+  for target in /pipe /pipe.lnk /pipe /pipe.lnk; do
+    [[ "$(curl -s -m 5 -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}${target}")" == "403" ]]
+    [[ "$(curl -s -m 5 -I -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}${target}")" == "403" ]]
+  done
+  expect_path "/sub/real.txt" 200
+  stop_server "$ALT_PID"
+done
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[30] Known-missing paths are answered from memory and follow changes"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/www/sub"
+echo "inside" > "$TMPROOT/www/sub/real.txt"
+ln -s sub "$TMPROOT/www/link"
+for filter in 0 1; do
+  for threads in 0 2; do
+    rm -rf "$TMPROOT/www/late" "$TMPROOT/www/new.txt" "$TMPROOT/www/moved"
+    $SERVER --neg-filter "$filter" --fs-threads "$threads" 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+    ALT_PID=$!
+    sleep 0.5
+    for _ in 1 2 3; do
+      expect_path "/new.txt" 404
+      expect_path "/late/deep/f.txt" 404
+      expect_path "/sub/nope.txt" 404
+    done
+    # Names behind a symlink are not in the filter.
+    expect_path "/link/real.txt" 200
+    echo "new" > "$TMPROOT/www/new.txt"
+    mkdir -p "$TMPROOT/www/late/deep"
+    echo "late" > "$TMPROOT/www/late/deep/f.txt"
+    sleep 0.1
+    expect_path "/new.txt" 200
+    cmp -s /tmp/get_body "$TMPROOT/www/new.txt"
+    expect_path "/late/deep/f.txt" 200
+    # A tree moved in at once.
+    mkdir -p "$TMPROOT/staging/a"
+    echo "moved" > "$TMPROOT/staging/a/m.txt"
+    expect_path "/moved/a/m.txt" 404
+    mv "$TMPROOT/staging" "$TMPROOT/www/moved"
+    sleep 0.1
+    expect_path "/moved/a/m.txt" 200
+    rm "$TMPROOT/www/new.txt"
+    sleep 0.1
+    expect_path "/new.txt" 404
+    stop_server "$ALT_PID"
+  done
+done
+grep -q "Name filter: " /tmp/http_server_test_alt.log
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[31] Concurrent first requests for one file share a lookup"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/www"
+# Every lookup takes half a second, as on a slow disk, so all requests
+# below arrive while the first GET and HEAD lookups are still running.
+HTTPD_LOOKUP_DELAY_MS=500 $SERVER --fs-threads 1 --chunk-size 4096 --cache-budget 0 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+head -c 300000 /dev/urandom > "$TMPROOT/www/big.bin"
+sleep 0.1
+python3 - "$ALT_PORT" "$TMPROOT/www/big.bin" <<'PY'
+import socket, sys
+port, path = int(sys.argv[1]), sys.argv[2]
+want = open(path, "rb").read()
+def send(method, target):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(f"{method} {target} HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n".encode())
+    return s
+def read_all(s):
+    data = b""
+    while True:
+        d = s.recv(65536)
+        if not d:
+            break
+        data += d
+    s.close()
+    return data
+# Different spellings of the same path, GET and HEAD at once.
+targets = ["/big.bin", "/./big.bin", "//big%2ebin"]
+reqs = [("HEAD" if i % 5 == 0 else "GET", targets[i % 3]) for i in range(60)]
+socks = [send(method, target) for method, target in reqs]
+for s, (method, target) in zip(socks, reqs):
+    head, _, body = read_all(s).partition(b"\r\n\r\n")
+    assert b" 200 " in head.split(b"\r\n")[0], head
+    assert body == (b"" if method == "HEAD" else want), (method, len(body))
+PY
+stop_server "$ALT_PID"
+# One GET and one HEAD lookup ran; every other request joined one of them.
+grep -q "^Lookups: 2 run, 58 joined$" /tmp/http_server_test_alt.log
+rm -rf "$TMPROOT"
+echo "  OK"
+
+echo "[32] Hot file truncated in place while a response is being sent"
+TMPROOT=$(mktemp -d)
+mkdir -p "$TMPROOT/www"
+head -c 50000 /dev/urandom > "$TMPROOT/www/f.bin"
+$SERVER 127.0.0.1 "$ALT_PORT" "$TMPROOT/www" > /tmp/http_server_test_alt.log 2>&1 &
+ALT_PID=$!
+sleep 0.5
+for _ in 1 2 3; do curl -s -o /dev/null "http://127.0.0.1:${ALT_PORT}/f.bin"; done
+# An HTTP/2 stream with a 1000-byte window stalls mid-body; the file is
+# truncated before the window opens. The rest of the original body
+# must still arrive, from the store's own copy.
+python3 - "$ALT_PORT" "$TMPROOT/www/f.bin" <<'PY'
+import socket, struct, sys, time
+port, path = int(sys.argv[1]), sys.argv[2]
+want = open(path, "rb").read()
+def frame(t, flags, sid, payload):
+    return struct.pack(">I", len(payload))[1:] + bytes([t, flags]) + struct.pack(">I", sid) + payload
+s = socket.create_connection(("127.0.0.1", port))
+# SETTINGS_INITIAL_WINDOW_SIZE = 1000, then GET /f.bin on stream 1.
+s.sendall(b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + frame(4, 0, 0, struct.pack(">HI", 4, 1000)))
+target = b"/f.bin"
+block = b"\x82\x86\x04" + bytes([len(target)]) + target + b"\x01\x01x"
+s.sendall(frame(1, 5, 1, block))
+buf = b""
+body = b""
+def read_frames(until):
+    global buf, body
+    s.settimeout(2)
+    while not until():
+        d = s.recv(65536)
+        if not d:
+            raise SystemExit("connection closed")
+        buf += d
+        while len(buf) >= 9:
+            n = int.from_bytes(buf[:3], "big")
+            if len(buf) < 9 + n:
+                break
+            t, fl, sid = buf[3], buf[4], int.from_bytes(buf[5:9], "big") & 0x7fffffff
+            if t == 0 and sid == 1:
+                body += buf[9:9 + n]
+                if fl & 1:
+                    body += b"<END>"
+            if t == 4 and not (fl & 1):
+                s.sendall(frame(4, 1, 0, b""))
+            buf = buf[9 + n:]
+read_frames(lambda: len(body) >= 1000)
+open(path, "r+b").truncate(0)
+time.sleep(0.1)
+s.sendall(frame(8, 0, 1, struct.pack(">I", 1 << 20)))
+read_frames(lambda: body.endswith(b"<END>"))
+assert body[:-5] == want, len(body)
+PY
+kill -0 "$ALT_PID"
+[[ "$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:${ALT_PORT}/f.bin")" == "200" ]]
+stop_server "$ALT_PID"
+rm -rf "$TMPROOT"
+echo "  OK"
+
 echo "All tests passed."
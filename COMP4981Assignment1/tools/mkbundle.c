@@ -0,0 +1,330 @@
+// mkbundle: pack a document root into one bundle file for --bundle.
+//
+// Usage: mkbundle [-z] <doc_root> <out.bundle>
+//   -z  also store a gzip variant of each file when it is at least 10% smaller
+//
+// Regular files are included (symlinks and other types are skipped);
+// "dir/index.html" also answers for "dir/". The output is written to a
+// temporary file and renamed into place, so a server can pick it up as
+// one atomic swap.
+
+#include "bundle.h"
+#include "http.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// One file (or index.html alias) to store.
+typedef struct {
+    char *url;
+    char *path;
+    struct stat st;
+    int alias;               // shares the data of the entry for path
+} item_t;
+
+typedef struct {
+    item_t *v;
+    size_t n;
+    size_t cap;
+} item_list_t;
+
+// Output file being assembled in memory.
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+} out_t;
+
+static int push_item(item_list_t *l, const char *url, const char *path, const struct stat *st, int alias) {
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        item_t *p = realloc(l->v, cap * sizeof(*p));
+        if (!p) return -1;
+        l->v = p;
+        l->cap = cap;
+    }
+    item_t *it = &l->v[l->n];
+    it->url = strdup(url);
+    it->path = strdup(path);
+    if (!it->url || !it->path) {
+        free(it->url);
+        free(it->path);
+        return -1;
+    }
+    it->st = *st;
+    it->alias = alias;
+    l->n++;
+    return 0;
+}
+
+// Collect regular files under dir; url is the matching URL prefix.
+static int walk(item_list_t *l, const char *dir, const char *url) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return -1;
+    }
+
+    int rc = 0;
+    struct dirent *de;
+    while (rc == 0 && (de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        char path[PATH_MAX];
+        char sub[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path) ||
+            snprintf(sub, sizeof(sub), "%s%s", url, de->d_name) >= (int)sizeof(sub) - 1) {
+            fprintf(stderr, "Path too long, skipped: %s/%s\n", dir, de->d_name);
+            continue;
+        }
+
+        struct stat st;
+        if (lstat(path, &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            strcat(sub, "/");
+            rc = walk(l, path, sub);
+        } else if (S_ISREG(st.st_mode)) {
+            rc = push_item(l, sub, path, &st, 0);
+            if (rc == 0 && strcmp(de->d_name, "index.html") == 0) rc = push_item(l, url, path, &st, 1);
+        }
+    }
+    closedir(d);
+    return rc;
+}
+
+static int item_cmp(const void *a, const void *b) {
+    return strcmp(((const item_t *)a)->url, ((const item_t *)b)->url);
+}
+
+// Append n bytes (8-byte aligned start). Returns the offset or -1.
+static long long out_add(out_t *o, const void *p, size_t n) {
+    size_t off = (o->len + 7) & ~(size_t)7;
+    if (off + n > o->cap) {
+        size_t cap = o->cap ? o->cap : 65536;
+        while (cap < off + n) cap *= 2;
+        unsigned char *q = realloc(o->buf, cap);
+        if (!q) return -1;
+        o->buf = q;
+        o->cap = cap;
+    }
+    memset(o->buf + o->len, 0, off - o->len);
+    if (n > 0) memcpy(o->buf + off, p, n);
+    o->len = off + n;
+    return (long long)off;
+}
+
+static int read_file(const char *path, size_t size, unsigned char **out) {
+    *out = malloc(size ? size : 1);
+    if (!*out) return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t r = read(fd, *out + got, size - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    close(fd);
+    return got == size ? 0 : -1;
+}
+
+// gzip (RFC 1952) of data. Returns 0 and a malloc'ed buffer on success.
+static int gzip_data(const unsigned char *data, size_t len, unsigned char **out, size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+
+    size_t cap = deflateBound(&zs, (uLong)len) + 32;
+    *out = malloc(cap);
+    if (!*out) {
+        deflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)(uintptr_t)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = *out;
+    zs.avail_out = (uInt)cap;
+    int rc = deflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+        free(*out);
+        return -1;
+    }
+    return 0;
+}
+
+// Header field block for one variant.
+static int fields_for(char *dst, size_t cap, const item_t *it, size_t len, int gz, int has_gz) {
+    char etag[HTTP_ETAG_MAX];
+    format_etag(&it->st, etag, sizeof(etag));
+
+    // Distinct validator for the encoded variant: "...-gz".
+    if (gz) {
+        size_t n = strlen(etag);
+        if (n + 3 < sizeof(etag)) memcpy(etag + n - 1, "-gz\"", 5);
+    }
+
+    int n = snprintf(dst, cap,
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %zu\r\n"
+                     "ETag: %s\r\n"
+                     "%s%s",
+                     guess_mime_type(it->path), len, etag,
+                     gz ? "Content-Encoding: gzip\r\n" : "",
+                     has_gz ? "Vary: Accept-Encoding\r\n" : "");
+    return (n < 0 || (size_t)n >= cap) ? -1 : n;
+}
+
+int main(int argc, char **argv) {
+    int use_gzip = 0;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "-z") == 0) {
+        use_gzip = 1;
+        argi++;
+    }
+    if (argc - argi != 2) {
+        fprintf(stderr, "Usage: %s [-z] <doc_root> <out.bundle>\n", argv[0]);
+        return 2;
+    }
+    const char *root = argv[argi];
+    const char *out_path = argv[argi + 1];
+
+    item_list_t items = {0};
+    if (walk(&items, root, "/") != 0) return 1;
+    if (items.n > UINT32_MAX) {
+        fprintf(stderr, "Too many files\n");
+        return 1;
+    }
+    qsort(items.v, items.n, sizeof(*items.v), item_cmp);
+
+    // Header and table first; data follows.
+    out_t o = {0};
+    bundle_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BUNDLE_MAGIC, 8);
+    hdr.version = BUNDLE_VERSION;
+    hdr.count = (uint32_t)items.n;
+
+    bundle_entry_t *table = calloc(items.n ? items.n : 1, sizeof(*table));
+    if (!table || out_add(&o, &hdr, sizeof(hdr)) < 0) return 1;
+    long long table_off = out_add(&o, table, items.n * sizeof(*table));
+    if (table_off < 0) return 1;
+    hdr.table_off = (uint64_t)table_off;
+
+    size_t raw_total = 0;
+    size_t gz_files = 0;
+    for (size_t i = 0; i < items.n; i++) {
+        item_t *it = &items.v[i];
+        bundle_entry_t *e = &table[i];
+
+        long long off = out_add(&o, it->url, strlen(it->url));
+        if (off < 0) return 1;
+        e->path_off = (uint64_t)off;
+        e->path_len = (uint32_t)strlen(it->url);
+
+        // index.html aliases share their file's data (filled in below).
+        if (it->alias) continue;
+
+        unsigned char *data = NULL;
+        size_t size = (size_t)it->st.st_size;
+        if (read_file(it->path, size, &data) != 0) {
+            fprintf(stderr, "Cannot read %s\n", it->path);
+            return 1;
+        }
+        raw_total += size;
+
+        unsigned char *gz = NULL;
+        size_t gz_len = 0;
+        int has_gz = use_gzip && size > 0 && gzip_data(data, size, &gz, &gz_len) == 0 &&
+                     gz_len * 10 <= size * 9;
+
+        char fields[1024];
+        int n = fields_for(fields, sizeof(fields), it, size, 0, has_gz);
+        long long f_off = n < 0 ? -1 : out_add(&o, fields, (size_t)n);
+        long long b_off = out_add(&o, data, size);
+        if (f_off < 0 || b_off < 0) return 1;
+        e->fields_off = (uint64_t)f_off;
+        e->fields_len = (uint64_t)n;
+        e->body_off = (uint64_t)b_off;
+        e->body_len = size;
+
+        if (has_gz) {
+            n = fields_for(fields, sizeof(fields), it, gz_len, 1, 1);
+            f_off = n < 0 ? -1 : out_add(&o, fields, (size_t)n);
+            b_off = out_add(&o, gz, gz_len);
+            if (f_off < 0 || b_off < 0) return 1;
+            e->gz_fields_off = (uint64_t)f_off;
+            e->gz_fields_len = (uint64_t)n;
+            e->gz_body_off = (uint64_t)b_off;
+            e->gz_body_len = gz_len;
+            gz_files++;
+        }
+        free(gz);
+        free(data);
+    }
+
+    // "dir/" takes everything but the path from "dir/index.html".
+    for (size_t i = 0; i < items.n; i++) {
+        if (!items.v[i].alias) continue;
+
+        char url[PATH_MAX];
+        snprintf(url, sizeof(url), "%sindex.html", items.v[i].url);
+        item_t key = {.url = url};
+        item_t *file = bsearch(&key, items.v, items.n, sizeof(*items.v), item_cmp);
+        if (!file) return 1;
+
+        bundle_entry_t *e = &table[i];
+        uint64_t path_off = e->path_off;
+        uint32_t path_len = e->path_len;
+        *e = table[file - items.v];
+        e->path_off = path_off;
+        e->path_len = path_len;
+    }
+
+    hdr.size = o.len;
+    memcpy(o.buf, &hdr, sizeof(hdr));
+    memcpy(o.buf + table_off, table, items.n * sizeof(*table));
+
+    // Write next to the target, then rename over it.
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", out_path, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f || fwrite(o.buf, 1, o.len, f) != o.len || fflush(f) != 0 || fsync(fileno(f)) != 0) {
+        perror(tmp);
+        if (f) fclose(f);
+        unlink(tmp);
+        return 1;
+    }
+    fclose(f);
+    if (rename(tmp, out_path) != 0) {
+        perror(out_path);
+        unlink(tmp);
+        return 1;
+    }
+
+    printf("%zu entries, %zu bytes of files, %zu gzip variants, bundle %zu bytes\n",
+           items.n, raw_total, gz_files, o.len);
+
+    for (size_t i = 0; i < items.n; i++) {
+        free(items.v[i].url);
+        free(items.v[i].path);
+    }
+    free(items.v);
+    free(table);
+    free(o.buf);
+    return 0;
+}